@@ -3,7 +3,8 @@
  * @brief Header file for the AlgoExecutionService class template.
  *
  * This file contains the definition and implementation of the AlgoExecutionService class template,
- * which is responsible for executing orders based on market data.
+ * which is responsible for executing orders based on market data. The spread-capture strategy
+ * is assembled from trigger, sizing and side selection policies given as template parameters.
  */
 
 #ifndef ALGO_EXECUTION_SERVICE_HPP
@@ -11,113 +12,531 @@
 
 #include <string>
 #include <vector>
-#include <map>
+#include <stdexcept>
 #include "SOA.hpp"
+#include "CompactId.hpp"
+#include "FlatHashMap.hpp"
+#include "TimerWheel.hpp"
+#include "ProductIndex.hpp"
 #include "MarketDataService.hpp"
 #include "ExecutionService.hpp"
 
 using namespace std;
 
+// Slicing schedules of a parent order
+enum SliceSchedule { TWAP, VWAP };
+
+/**
+ * Parameters of the spread-capture strategy, read by its policies.
+ * Every order carries a hidden quantity in proportion to its visible one.
+ */
+struct AlgoExecutionParams
+{
+    double spreadTolerance = 1.0 / 128;
+    double sizeFraction = 1.0;          // fraction of the touch size sent
+    double fixedQuantity = 1000000;     // size of every order under fixed sizing
+    double hiddenMultiple = 2.0;
+};
+
+
+/**
+ * Trigger policies: whether a book calls for a spread-capture order.
+ * Fire(bestBid, bestOffer, params) is called on every book with both sides.
+ */
+
+// Trade when the spread is wider than the tolerance
+struct WideSpreadTrigger
+{
+    static bool Fire(const Order& bestBid, const Order& bestOffer, const AlgoExecutionParams& params)
+    {
+        return bestOffer.GetPrice() - bestBid.GetPrice() > params.spreadTolerance;
+    }
+};
+
+// Trade when the spread is at most the tolerance
+struct TightSpreadTrigger
+{
+    static bool Fire(const Order& bestBid, const Order& bestOffer, const AlgoExecutionParams& params)
+    {
+        return bestOffer.GetPrice() - bestBid.GetPrice() <= params.spreadTolerance;
+    }
+};
+
+
+/**
+ * Sizing policies: the visible quantity of an order joining a touch.
+ * Size(touch, params) is called with the touch on the side of the order.
+ */
+
+// A fraction of the size at the touch
+struct TouchSizing
+{
+    static double Size(const Order& touch, const AlgoExecutionParams& params)
+    {
+        return touch.GetQuantity() * params.sizeFraction;
+    }
+};
+
+// The same quantity on every order
+struct FixedSizing
+{
+    static double Size(const Order& touch, const AlgoExecutionParams& params)
+    {
+        return params.fixedQuantity;
+    }
+};
+
+
+/**
+ * Side selection policies: whether the next order joins the bid.
+ * Buy(orderCount, bestBid, bestOffer) is called with the number of orders sent so far.
+ * The imbalance policies fall back to alternating when the touch is balanced.
+ */
+
+// Alternate between the bid and the offer
+struct AlternateSides
+{
+    static bool Buy(int orderCount, const Order& bestBid, const Order& bestOffer)
+    {
+        return orderCount % 2 == 0;
+    }
+};
+
+// Join the side with more size at the touch
+struct FollowImbalance
+{
+    static bool Buy(int orderCount, const Order& bestBid, const Order& bestOffer)
+    {
+        double imbalance = bestBid.GetQuantity() - bestOffer.GetQuantity();
+        return imbalance == 0 ? orderCount % 2 == 0 : imbalance > 0;
+    }
+};
+
+// Join the side with less size at the touch
+struct FadeImbalance
+{
+    static bool Buy(int orderCount, const Order& bestBid, const Order& bestOffer)
+    {
+        double imbalance = bestBid.GetQuantity() - bestOffer.GetQuantity();
+        return imbalance == 0 ? orderCount % 2 == 0 : imbalance < 0;
+    }
+};
+
+/**
+ * A parent order worked by the algo as a series of child orders.
+ * Lives in a flat pool; free slots are chained through nextFree.
+ * Type T is the product type.
+ */
+template<typename T>
+struct ParentOrder
+{
+    T product;
+    CompactId parentOrderId;    // tagged with the pool slot
+    int productIndex;
+    PricingSide side;
+    SliceSchedule schedule;
+    double totalQuantity;
+    double sentQuantity;
+    double filledQuantity;
+    double closedQuantity;  // quantity of child orders filled, cancelled or rejected
+    int slices;             // number of child orders to send
+    int slicesSent;
+    int interval;           // book updates between child orders
+    double lastVolume;      // cumulative touch volume of the product at the previous child order
+    bool active;
+    int nextFree;
+};
+
+/**
+ * Algo execution service without its spread-capture strategy.
+ * Keeps the top of book of every product, the order record and the parent orders sliced on
+ * the schedule wheel; the strategy run on each book is left to ExecuteOrder.
+ * Keyed on order identifier.
+ * Type T is the product type.
+ */
 template <class T>
-class AlgoExecutionService : public Service<string, ExecutionOrder<T>>
+class AlgoExecutionServiceBase : public Service<CompactId, ExecutionOrder<T>>
 {
 private:
-    map<string, ExecutionOrder<T>> execution_orders;
+    FlatHashMap<ExecutionOrder<T>> execution_orders;
     int counter;
-    double spread_tol;
+    AlgoExecutionParams params;
+
+    vector<ParentOrder<T>> parents;
+    int free_parent;
+    int parent_counter;
+    TimerWheel schedule_wheel;
+
+    // Last top of book of each product, indexed by product index
+    vector<double> best_bids;
+    vector<double> best_offers;
+    vector<double> touch_volumes;                   // cumulative touch size seen
+    vector<double> touch_volume_averages;           // average touch size per book update
+
+    // Send the next child order of a parent
+    void SendChildOrder(int slot);
+
+protected:
+    // Record the top of book of a product and advance the slicing schedule, returns false if a side is empty
+    bool OnBook(const OrderBook<T>& data, const Order*& bestBid, const Order*& bestOffer);
+
+    // Record and send a spread-capture order
+    void SendOrder(const T& product, PricingSide side, double price, double quantity);
+
+    // Get the number of spread-capture orders sent
+    int GetOrderCounter() const;
 
 public:
 
-    AlgoExecutionService();
+    AlgoExecutionServiceBase(const AlgoExecutionParams& _params);
 
-    ExecutionOrder<T>& GetData(string key);
+    virtual ~AlgoExecutionServiceBase() = default;
+
+    ExecutionOrder<T>& GetData(CompactId key);
 
     void OnMessage(ExecutionOrder<T>& data);
 
-    void ExecuteOrder(const OrderBook<T>& data);
+    // Run the strategy on a book
+    virtual void ExecuteOrder(const OrderBook<T>& data) = 0;
+
+    // Accept a parent order to be sliced into child orders
+    CompactId AddParentOrder(const T& product, PricingSide side, double quantity, SliceSchedule schedule, int slices, int interval);
+
+    // Attribute a fill or the end of a child order back to its parent
+    void OnExecution(const ExecutionOrder<T>& order);
+
+    // Get the quantity filled so far on a parent order
+    double GetParentFilledQuantity(CompactId parentOrderId) const;
+
+    // Whether a parent order still has slices to send or child orders working
+    bool IsParentActive(CompactId parentOrderId) const;
+
+    // Get the parameters of the spread-capture strategy
+    const AlgoExecutionParams& GetParams() const;
+
+    // Get the number of orders still on record
+    int GetOrderCount() const;
+};
+
+
+/**
+ * Algo execution service running a spread-capture strategy made of policies.
+ * Each combination of trigger, sizing and side selection is its own class, so the policies
+ * are inlined into ExecuteOrder and the only indirection per book is the call itself.
+ * Type T is the product type.
+ */
+template <class T, class Trigger = WideSpreadTrigger, class Sizing = TouchSizing, class SideSelection = AlternateSides>
+class AlgoExecutionService final : public AlgoExecutionServiceBase<T>
+{
+public:
+    // ctor
+    AlgoExecutionService(const AlgoExecutionParams& _params = AlgoExecutionParams());
+
+    // Run the strategy on a book
+    void ExecuteOrder(const OrderBook<T>& data) override;
 };
 
 template <typename T>
-AlgoExecutionService<T>::AlgoExecutionService() : counter(0), spread_tol(1.0 / 128)
+AlgoExecutionServiceBase<T>::AlgoExecutionServiceBase(const AlgoExecutionParams& _params) :
+    counter(0), params(_params), free_parent(-1), parent_counter(0)
 {
-    execution_orders = map<string, ExecutionOrder<T>>();
 }
 
 template <typename T>
-ExecutionOrder<T>& AlgoExecutionService<T>::GetData(string key)
+ExecutionOrder<T>& AlgoExecutionServiceBase<T>::GetData(CompactId key)
 {
     return execution_orders[key];
 }
 
 template <typename T>
-void AlgoExecutionService<T>::OnMessage(ExecutionOrder<T>& data)
+void AlgoExecutionServiceBase<T>::OnMessage(ExecutionOrder<T>& data)
 {
     execution_orders[data.GetOrderId()] = data;
 }
 
 /**
- * @brief Executes an order based on the given OrderBook data.
+ * @brief Record the top of book of a product and advance the slicing schedule.
  *
- * This function processes the bid and offer stacks from the provided OrderBook,
- * determines the best bid and offer prices, and executes an order if the spread
- * between the best bid and offer prices exceeds a predefined tolerance.
+ * Every book update records the product's top of book and touch volume and advances the
+ * slicing schedule by one tick, sending the child orders of the parent orders that are due.
  *
  * @tparam T The type of the product being traded.
  * @param data The OrderBook containing bid and offer stacks for the product.
- *
- * The function performs the following steps:
- * 1. Retrieves the product from the OrderBook.
- * 2. Extracts the bid and offer stacks from the OrderBook.
- * 3. Identifies the best bid and offer prices from the stacks.
- * 4. If the spread between the best bid and offer prices exceeds the tolerance,
- *    it executes an order based on the current counter value (alternating between
- *    bid and offer orders).
- * 5. Creates an ExecutionOrder with the determined price, quantity, and side.
- * 6. Stores the ExecutionOrder in the execution_orders map and notifies the service.
+ * @param bestBid Set to the best bid of the book.
+ * @param bestOffer Set to the best offer of the book.
+ * @return false if either side of the book is empty.
  */
 template <typename T>
-void AlgoExecutionService<T>::ExecuteOrder(const OrderBook<T>& data)
+bool AlgoExecutionServiceBase<T>::OnBook(const OrderBook<T>& data, const Order*& bestBid, const Order*& bestOffer)
 {
-    T product = data.GetProduct();
-    vector<Order> bid_stack = data.GetBidStack();
-    vector<Order> offer_stack = data.GetOfferStack();
-    Order best_bid = bid_stack.empty() ? Order() : bid_stack[0];
-    Order best_offer = offer_stack.empty() ? Order() : offer_stack[0];
+    const vector<Order>& bid_stack = data.GetBidStack();
+    const vector<Order>& offer_stack = data.GetOfferStack();
+    if (bid_stack.empty() || offer_stack.empty())
+    {
+        schedule_wheel.Advance([this](int slot) { SendChildOrder(slot); });
+        return false;
+    }
 
+    bestBid = &bid_stack[0];
+    bestOffer = &offer_stack[0];
     for (const auto& e : bid_stack)
     {
-        if (e.GetPrice() > best_bid.GetPrice())
-            best_bid = e;
+        if (e.GetPrice() > bestBid->GetPrice())
+            bestBid = &e;
     }
     for (const auto& e : offer_stack)
     {
-        if (e.GetPrice() < best_offer.GetPrice())
-            best_offer = e;
+        if (e.GetPrice() < bestOffer->GetPrice())
+            bestOffer = &e;
     }
 
-    double orderPrice, orderQuantity;
-    PricingSide side;
-    if (!bid_stack.empty() && !offer_stack.empty() && (best_offer.GetPrice() - best_bid.GetPrice() > spread_tol))
-    {
-        if (counter % 2 == 0) // bid order
-        {
-            orderPrice = best_bid.GetPrice();
-            orderQuantity = best_bid.GetQuantity();
-            side = BID;
-        }
-        else // offer order
-        {
-            orderPrice = best_offer.GetPrice();
-            orderQuantity = best_offer.GetQuantity();
-            side = OFFER;
-        }
-
-        string tradeId = "TRADEID_" + to_string(counter);
-        ExecutionOrder<T> execu_order(product, side, tradeId, MARKET, orderPrice, orderQuantity, 2 * orderQuantity, "", false);
-        execution_orders[execu_order.GetOrderId()] = execu_order;
-        ++counter;
-        Service<string, ExecutionOrder<T>>::Notify(execu_order);
+    int index = GetProductIndex(data.GetProduct().GetProductId());
+    if (index >= (int)best_bids.size())
+    {
+        best_bids.resize(index + 1, 0.0);
+        best_offers.resize(index + 1, 0.0);
+        touch_volumes.resize(index + 1, 0.0);
+        touch_volume_averages.resize(index + 1, 0.0);
     }
+    double touch = bestBid->GetQuantity() + bestOffer->GetQuantity();
+    best_bids[index] = bestBid->GetPrice();
+    best_offers[index] = bestOffer->GetPrice();
+    touch_volumes[index] += touch;
+    double& average = touch_volume_averages[index];
+    average = average == 0 ? touch : 0.99 * average + 0.01 * touch;
+    schedule_wheel.Advance([this](int slot) { SendChildOrder(slot); });
+    return true;
+}
+
+/**
+ * @brief Record and send a spread-capture order.
+ *
+ * The order carries the hidden multiple of the parameters, is stored in the execution_orders
+ * map and the service is notified.
+ *
+ * @tparam T The type of the product being traded.
+ * @param product The product to trade.
+ * @param side The side of the order.
+ * @param price The price of the order.
+ * @param quantity The visible quantity of the order.
+ */
+template <typename T>
+void AlgoExecutionServiceBase<T>::SendOrder(const T& product, PricingSide side, double price, double quantity)
+{
+    CompactId orderId = MakeId(ALGO_ORDER_ID, counter);
+    ExecutionOrder<T> execu_order(product, side, orderId, MARKET, price, quantity, params.hiddenMultiple * quantity, NO_ID, false);
+    execution_orders[execu_order.GetOrderId()] = execu_order;
+    ++counter;
+    Service<CompactId, ExecutionOrder<T>>::Notify(execu_order);
+}
+
+template <typename T>
+int AlgoExecutionServiceBase<T>::GetOrderCounter() const
+{
+    return counter;
+}
+
+/**
+ * @brief Accept a parent order to be sliced into child orders.
+ *
+ * The parent takes a slot in the flat pool, which is tagged on its ID, and its first child
+ * order is scheduled one interval of book updates from now.
+ *
+ * @tparam T The type of the product being traded.
+ * @param product The product to trade.
+ * @param side The side of the parent order.
+ * @param quantity The total quantity to execute.
+ * @param schedule TWAP for equal slices, VWAP for slices weighted by the touch volume seen.
+ * @param slices The number of child orders.
+ * @param interval The number of book updates between child orders.
+ * @return The parent order ID.
+ * @throws runtime_error if more parent orders are live than an ID tag can address.
+ */
+template <typename T>
+CompactId AlgoExecutionServiceBase<T>::AddParentOrder(const T& product, PricingSide side, double quantity, SliceSchedule schedule, int slices, int interval)
+{
+    int slot = free_parent;
+    if (slot == -1)
+    {
+        if (parents.size() > ID_TAG_MASK)
+            throw runtime_error("Too many live parent orders");
+        slot = parents.size();
+        parents.emplace_back();
+    }
+    else
+    {
+        free_parent = parents[slot].nextFree;
+    }
+
+    int index = GetProductIndex(product.GetProductId());
+    ParentOrder<T>& parent = parents[slot];
+    parent.product = product;
+    parent.parentOrderId = MakeId(PARENT_ORDER_ID, parent_counter++, slot);
+    parent.productIndex = index;
+    parent.side = side;
+    parent.schedule = schedule;
+    parent.totalQuantity = quantity;
+    parent.sentQuantity = 0;
+    parent.filledQuantity = 0;
+    parent.closedQuantity = 0;
+    parent.slices = max(1, slices);
+    parent.slicesSent = 0;
+    parent.interval = max(1, interval);
+    parent.lastVolume = index < (int)touch_volumes.size() ? touch_volumes[index] : 0.0;
+    parent.active = true;
+    parent.nextFree = -1;
+
+    schedule_wheel.Schedule(slot, schedule_wheel.GetTick() + parent.interval);
+    return parent.parentOrderId;
+}
+
+/**
+ * @brief Send the next child order of a parent and schedule the one after it.
+ *
+ * A TWAP child is the remaining quantity over the remaining slices. A VWAP child scales the
+ * average slice by the touch volume seen since the previous child relative to the product's
+ * average touch volume over an interval. The last slice always sends what is left. Children
+ * cross the spread at the last top of book of the product and are skipped until one is seen.
+ *
+ * @tparam T The type of the product being traded.
+ * @param slot The pool slot of the parent order.
+ */
+template <typename T>
+void AlgoExecutionServiceBase<T>::SendChildOrder(int slot)
+{
+    ParentOrder<T>& parent = parents[slot];
+    int index = parent.productIndex;
+    if (!parent.active)
+        return;
+    if (index >= (int)best_bids.size() || best_bids[index] == 0)
+    {
+        schedule_wheel.Schedule(slot, schedule_wheel.GetTick() + parent.interval);
+        return;
+    }
+
+    double remaining = parent.totalQuantity - parent.sentQuantity;
+    int slices_left = parent.slices - parent.slicesSent;
+    double quantity = remaining / slices_left;
+    if (parent.schedule == VWAP && slices_left > 1)
+    {
+        double expected = touch_volume_averages[index] * parent.interval;
+        double seen = touch_volumes[index] - parent.lastVolume;
+        double weight = expected > 0 ? seen / expected : 1.0;
+        quantity = min(remaining, parent.totalQuantity / parent.slices * weight);
+    }
+    if (slices_left == 1)
+        quantity = remaining;
+    parent.lastVolume = touch_volumes[index];
+    parent.sentQuantity += quantity;
+    ++parent.slicesSent;
+
+    double price = parent.side == BID ? best_offers[index] : best_bids[index];
+    CompactId child_id = MakeId(CHILD_ORDER_ID, GetIdSequence(parent.parentOrderId), parent.slicesSent);
+    if (parent.slicesSent < parent.slices)
+        schedule_wheel.Schedule(slot, schedule_wheel.GetTick() + parent.interval);
+
+    ExecutionOrder<T> child(parent.product, parent.side, child_id, MARKET, price, quantity, 0, parent.parentOrderId, true);
+    execution_orders[child_id] = child;
+    Service<CompactId, ExecutionOrder<T>>::Notify(child);
+}
+
+/**
+ * @brief Attribute a fill or the end of a child order back to its parent.
+ *
+ * The parent slot is read from the tag of the child's parent order ID. Fills are added to the
+ * parent's filled quantity, and a child order filled, cancelled or rejected closes its
+ * quantity. Once every slice has been sent and closed, the parent is complete and its slot
+ * returns to the pool. An order is dropped from the record once it ends with no hidden
+ * quantity left to work.
+ *
+ * @tparam T The type of the product being traded.
+ * @param order The execution order whose status changed.
+ */
+template <typename T>
+void AlgoExecutionServiceBase<T>::OnExecution(const ExecutionOrder<T>& order)
+{
+    if (order.IsTerminal() && order.GetHiddenQuantity() <= 0)
+        execution_orders.Erase(GetLegOrderId(order.GetOrderId()));
+    if (!order.IsChildOrder())
+        return;
+    int slot = GetIdTag(order.GetParentOrderId());
+    if (slot >= (int)parents.size() || !parents[slot].active || parents[slot].parentOrderId != order.GetParentOrderId())
+        return;
+
+    ParentOrder<T>& parent = parents[slot];
+    if (order.GetStatus() == ORDER_PARTIALLY_FILLED || order.GetStatus() == ORDER_FILLED)
+        parent.filledQuantity += order.GetLastFillQuantity();
+    if (order.IsTerminal())
+        parent.closedQuantity += order.GetVisibleQuantity();
+
+    if (parent.slicesSent == parent.slices && parent.closedQuantity >= parent.sentQuantity - 1e-6)
+    {
+        parent.active = false;
+        parent.nextFree = free_parent;
+        free_parent = slot;
+    }
+}
+
+template <typename T>
+double AlgoExecutionServiceBase<T>::GetParentFilledQuantity(CompactId parentOrderId) const
+{
+    int slot = GetIdTag(parentOrderId);
+    if (slot < (int)parents.size() && parents[slot].parentOrderId == parentOrderId)
+        return parents[slot].filledQuantity;
+    return 0;
+}
+
+template <typename T>
+bool AlgoExecutionServiceBase<T>::IsParentActive(CompactId parentOrderId) const
+{
+    int slot = GetIdTag(parentOrderId);
+    return slot < (int)parents.size() && parents[slot].active && parents[slot].parentOrderId == parentOrderId;
+}
+
+template <typename T>
+const AlgoExecutionParams& AlgoExecutionServiceBase<T>::GetParams() const
+{
+    return params;
+}
+
+template <typename T>
+int AlgoExecutionServiceBase<T>::GetOrderCount() const
+{
+    return execution_orders.GetSize();
+}
+
+
+
+template <class T, class Trigger, class Sizing, class SideSelection>
+AlgoExecutionService<T, Trigger, Sizing, SideSelection>::AlgoExecutionService(const AlgoExecutionParams& _params) :
+    AlgoExecutionServiceBase<T>(_params)
+{
+}
+
+/**
+ * @brief Executes an order based on the given OrderBook data.
+ *
+ * After the base records the book, the trigger decides whether to trade, the side selection
+ * picks the touch to join and the sizing sets the visible quantity; the order is sent at the
+ * price of that touch.
+ *
+ * @tparam T The type of the product being traded.
+ * @param data The OrderBook containing bid and offer stacks for the product.
+ */
+template <class T, class Trigger, class Sizing, class SideSelection>
+void AlgoExecutionService<T, Trigger, Sizing, SideSelection>::ExecuteOrder(const OrderBook<T>& data)
+{
+    const Order* best_bid;
+    const Order* best_offer;
+    if (!this->OnBook(data, best_bid, best_offer))
+        return;
+
+    const AlgoExecutionParams& params = this->GetParams();
+    if (!Trigger::Fire(*best_bid, *best_offer, params))
+        return;
+    bool buy = SideSelection::Buy(this->GetOrderCounter(), *best_bid, *best_offer);
+    const Order& touch = buy ? *best_bid : *best_offer;
+    this->SendOrder(data.GetProduct(), buy ? BID : OFFER, touch.GetPrice(), Sizing::Size(touch, params));
 }
 
 #endif
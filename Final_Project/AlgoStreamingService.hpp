@@ -3,28 +3,116 @@
  * @brief Header file for the AlgoStreamingService class template.
  *
  * This file contains the definition of the AlgoStreamingService class template, which is responsible for managing and publishing two-way prices for financial products.
+ * The quotes are generated by a quote policy given as a template parameter.
  */
 
 #ifndef ALGO_STREAMING_SERVICE_HPP
 #define ALGO_STREAMING_SERVICE_HPP
 
-#include <map>
+#include <cmath>
 #include <random>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include "utils/SOA.hpp"
 #include "utils/Products.hpp"
+#include "utils/ProductIndex.hpp"
 #include "PricingService.hpp"
 #include "StreamingService.hpp"
+#include "PositionService.hpp"
 
+/**
+ * Precomputed quote skew parameters of a product.
+ * The mid is shifted against the inventory and the spread widened with the risk,
+ * both linearly and capped.
+ */
+struct QuoteSkewParams
+{
+    double skewPerUnit;     // mid shift per unit of aggregate position
+    double maxSkew;         // cap on the mid shift
+    double widenPerRisk;    // spread widening per unit of PV01 risk
+    double maxWiden;        // cap on the spread widening
+};
+
+
+/**
+ * Quote policies: the top bid and ask of a two-way price.
+ * Quote(mid, halfSpread, inventory, productIndex, skewParams, bid, ask) sets the bid and ask
+ * from the mid and half spread of the price.
+ */
+
+// Skew the mid against the inventory and widen the spread with the risk
+struct SkewedQuote
+{
+    static void Quote(double mid, double halfSpread, const InventorySnapshot* inventory, int productIndex,
+        const QuoteSkewParams& p, double& bid, double& ask)
+    {
+        if (inventory)
+        {
+            double skew = -inventory->GetPosition(productIndex) * p.skewPerUnit;
+            skew = max(-p.maxSkew, min(p.maxSkew, skew));
+            double widen = min(p.maxWiden, fabs(inventory->GetRisk(productIndex)) * p.widenPerRisk);
+            mid += skew;
+            halfSpread += widen / 2;
+        }
+        bid = mid - halfSpread;
+        ask = mid + halfSpread;
+    }
+};
+
+// Quote symmetrically around the mid
+struct SymmetricQuote
+{
+    static void Quote(double mid, double halfSpread, const InventorySnapshot* inventory, int productIndex,
+        const QuoteSkewParams& p, double& bid, double& ask)
+    {
+        bid = mid - halfSpread;
+        ask = mid + halfSpread;
+    }
+};
+
+
+/**
+ * Algo streaming service without its quote generation.
+ * Keeps the tiers, the skew parameters and the published streams, and builds the ladders
+ * around the top bid and ask that PublishPrice chooses.
+ * Keyed on product identifier.
+ * Type V is the product type.
+ */
 template <class V>
-class AlgoStreamingService : public Service<string, PriceStream<V>>
+class AlgoStreamingServiceBase : public Service<string, PriceStream<V>>
 {
 private:
-    map<string, PriceStream<V>> pricestreams;
-    random_device rd; // Random device for generating random numbers
-    default_random_engine generator{ rd() }; // Random number generator
+    vector<PriceStream<V>> pricestreams;     // indexed by product index
+    default_random_engine generator{ 42 }; // Random number generator, seeded so a replay streams the same sizes
+    const InventorySnapshot* inventory;
+    vector<QuoteSkewParams> skew_params;     // indexed by product index
+    int tier_count;
+    array<double, MAX_STREAM_TIERS> tier_offsets;    // price distance of each tier from the top
+    array<long, MAX_STREAM_TIERS> tier_sizes;        // size multiple of each tier
+
+protected:
+    // Get the inventory snapshot quoted off, or nullptr
+    const InventorySnapshot* GetInventory() const;
+
+    // Get the skew parameters of a product
+    const QuoteSkewParams& GetSkewParams(int productIndex) const;
+
+    // Build the ladders around a top bid and ask and publish them
+    void Stream(const V& product, int productIndex, double bid_price, double ask_price);
 
 public:
+    // ctor
+    AlgoStreamingServiceBase(const InventorySnapshot* _inventory);
+
+    virtual ~AlgoStreamingServiceBase() = default;
+
+    // Set the number of tiers streamed on each side and the price spacing between them
+    void SetTiers(int count, double spacing);
+
+    // Set the skew parameters of a product from its limits
+    void SetSkewParams(const string& productId, double positionLimit, double maxSkew, double riskLimit, double maxWiden);
+
     // Get data on our service given a key
     PriceStream<V>& GetData(string key);
 
@@ -32,47 +120,164 @@ public:
     void OnMessage(PriceStream<V>& data);
 
     // Publish two-way prices
-    void PublishPrice(Price<V>& data);
+    virtual void PublishPrice(Price<V>& data) = 0;
+};
+
+
+/**
+ * Algo streaming service publishing the quotes of a quote policy, inlined into PublishPrice.
+ * Type V is the product type.
+ */
+template <class V, class QuotePolicy = SkewedQuote>
+class AlgoStreamingService final : public AlgoStreamingServiceBase<V>
+{
+public:
+    // ctor
+    AlgoStreamingService(const InventorySnapshot* _inventory = nullptr);
+
+    // Publish two-way prices
+    void PublishPrice(Price<V>& data) override;
 };
 
+/**
+ * @brief Construct the algo streaming service quoting off an inventory snapshot.
+ *
+ * Every product gets default skew parameters of a 1/128 shift at a 50mm position and a
+ * 1/64 widening at 100k of PV01 risk. Without a snapshot the quotes stay symmetric.
+ *
+ * @tparam V The type of the product.
+ * @param _inventory The snapshot of positions and risk, or nullptr for symmetric quotes.
+ */
 template <typename V>
-PriceStream<V>& AlgoStreamingService<V>::GetData(string key)
+AlgoStreamingServiceBase<V>::AlgoStreamingServiceBase(const InventorySnapshot* _inventory) :
+    pricestreams(MAX_PRODUCTS), inventory(_inventory), skew_params(MAX_PRODUCTS)
 {
-    return pricestreams[key];
+    for (auto& p : skew_params)
+        p = QuoteSkewParams{ (1.0 / 128) / 50000000.0, 1.0 / 128, (1.0 / 64) / 100000.0, 1.0 / 64 };
+    SetTiers(MAX_STREAM_TIERS, 1.0 / 128);
 }
 
+/**
+ * @brief Set the number of tiers streamed on each side and the price spacing between them.
+ *
+ * The price offset and size multiple of each tier are computed once here. Tier i is quoted
+ * i spacings behind the top of the ladder with i + 1 times the top visible size.
+ *
+ * @tparam V The type of the product.
+ * @param count The number of tiers on each side, capped to MAX_STREAM_TIERS.
+ * @param spacing The price distance between consecutive tiers.
+ */
 template <typename V>
-void AlgoStreamingService<V>::OnMessage(PriceStream<V>& data)
+void AlgoStreamingServiceBase<V>::SetTiers(int count, double spacing)
 {
-    pricestreams[data.GetProduct().GetProductId()] = data;
+    tier_count = max(1, min(count, MAX_STREAM_TIERS));
+    for (int i = 0; i < MAX_STREAM_TIERS; ++i)
+    {
+        tier_offsets[i] = i * spacing;
+        tier_sizes[i] = i + 1;
+    }
 }
 
 /**
- * @brief Publishes the price data to the streaming service.
- * 
- * This function takes a Price object, extracts the product, calculates the bid and ask prices,
- * generates a random visible size for the orders, creates bid and ask PriceStreamOrder objects,
- * and then creates a PriceStream object. The PriceStream object is stored in the pricestreams
- * map and the service is notified with the new price stream.
- * 
+ * @brief Set the skew parameters of a product from its limits.
+ *
+ * The per-unit coefficients are computed once here, so quoting only multiplies and clamps.
+ *
  * @tparam V The type of the product.
- * @param data The Price object containing the product and price information.
+ * @param productId The product identifier.
+ * @param positionLimit The aggregate position at which the full skew is applied.
+ * @param maxSkew The largest shift of the mid.
+ * @param riskLimit The PV01 risk at which the full widening is applied.
+ * @param maxWiden The largest widening of the spread.
  */
 template <typename V>
-void AlgoStreamingService<V>::PublishPrice(Price<V>& data)
+void AlgoStreamingServiceBase<V>::SetSkewParams(const string& productId, double positionLimit, double maxSkew, double riskLimit, double maxWiden)
+{
+    skew_params[GetProductIndex(productId)] = QuoteSkewParams{ maxSkew / positionLimit, maxSkew, maxWiden / riskLimit, maxWiden };
+}
+
+template <typename V>
+PriceStream<V>& AlgoStreamingServiceBase<V>::GetData(string key)
+{
+    return pricestreams[GetProductIndex(key)];
+}
+
+template <typename V>
+void AlgoStreamingServiceBase<V>::OnMessage(PriceStream<V>& data)
+{
+    pricestreams[GetProductIndex(data.GetProduct().GetProductId())] = data;
+}
+
+template <typename V>
+const InventorySnapshot* AlgoStreamingServiceBase<V>::GetInventory() const
+{
+    return inventory;
+}
+
+template <typename V>
+const QuoteSkewParams& AlgoStreamingServiceBase<V>::GetSkewParams(int productIndex) const
+{
+    return skew_params[productIndex];
+}
+
+/**
+ * @brief Build the ladders around a top bid and ask and publish them.
+ *
+ * A random visible size is drawn for the top tier, and the bid and ask ladders are built
+ * from the precomputed tier offsets and sizes. The PriceStream object is stored in the
+ * product's slot of pricestreams and the service is notified with the new price stream.
+ *
+ * @tparam V The type of the product.
+ * @param product The product quoted.
+ * @param productIndex The dense index of the product.
+ * @param bid_price The top bid.
+ * @param ask_price The top ask.
+ */
+template <typename V>
+void AlgoStreamingServiceBase<V>::Stream(const V& product, int productIndex, double bid_price, double ask_price)
 {
-    V product = data.GetProduct();
-    double bid_price = data.GetMid() - data.GetBidOfferSpread() / 2;
-    double ask_price = data.GetMid() + data.GetBidOfferSpread() / 2;
     uniform_int_distribution<long> distribution(1000000, 1999999);
     long visible_size = distribution(generator); // Generating random visible size
-    PriceStreamOrder bid_order(bid_price, visible_size, 2 * visible_size, BID);
-    PriceStreamOrder ask_order(ask_price, visible_size, 2 * visible_size, OFFER);
-    PriceStream<V> price_stream(data.GetProduct(), bid_order, ask_order);
-
-    pricestreams[price_stream.GetProduct().GetProductId()] = price_stream;
+    array<PriceStreamOrder, MAX_STREAM_TIERS> bid_tiers, ask_tiers;
+    for (int i = 0; i < tier_count; ++i)
+    {
+        long size = tier_sizes[i] * visible_size;
+        bid_tiers[i] = PriceStreamOrder(bid_price - tier_offsets[i], size, 2 * size, BID);
+        ask_tiers[i] = PriceStreamOrder(ask_price + tier_offsets[i], size, 2 * size, OFFER);
+    }
+    PriceStream<V>& price_stream = pricestreams[productIndex];
+    price_stream = PriceStream<V>(product, productIndex, bid_tiers, ask_tiers, tier_count);
     Service<string, PriceStream<V>>::Notify(price_stream);
 }
 
+
+template <typename V, typename QuotePolicy>
+AlgoStreamingService<V, QuotePolicy>::AlgoStreamingService(const InventorySnapshot* _inventory) :
+    AlgoStreamingServiceBase<V>(_inventory)
+{
+}
+
+/**
+ * @brief Publishes the price data to the streaming service.
+ * 
+ * The quote policy sets the top bid and ask from the mid and spread of the price. The
+ * default skewed quote, with an inventory snapshot, shifts the mid against the current
+ * aggregate position (a long position lowers both sides to attract buyers) and widens the
+ * spread with the PV01 risk.
+ * 
+ * @tparam V The type of the product.
+ * @param data The Price object containing the product and price information.
+ */
+template <typename V, typename QuotePolicy>
+void AlgoStreamingService<V, QuotePolicy>::PublishPrice(Price<V>& data)
+{
+    const V& product = data.GetProduct();
+    int index = data.GetProductIndex();
+    double bid_price, ask_price;
+    QuotePolicy::Quote(data.GetMid(), data.GetBidOfferSpread() / 2, this->GetInventory(), index,
+        this->GetSkewParams(index), bid_price, ask_price);
+    this->Stream(product, index, bid_price, ask_price);
+}
+
 #endif
 
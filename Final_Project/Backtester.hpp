@@ -0,0 +1,399 @@
+/**
+ * @file Backtester.hpp
+ * @brief Header file for the Backtester class template.
+ *
+ * This file contains the definition and implementation of the harness that replays recorded
+ * market data through the AlgoExecutionService against a simulated fill model, and sweeps
+ * grids of strategy parameters across threads sharing one mapping of the data.
+ */
+
+#ifndef BACKTESTER_HPP
+#define BACKTESTER_HPP
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include "SOA.hpp"
+#include "Products.hpp"
+#include "Connectors.hpp"
+#include "MappedFile.hpp"
+#include "ProductIndex.hpp"
+#include "MarketDataService.hpp"
+#include "ExecutionService.hpp"
+#include "AlgoExecutionService.hpp"
+#include "StrategyRegistry.hpp"
+
+using namespace std;
+
+/**
+ * Outcome of one backtest.
+ * P&L is in currency for prices quoted per 100 face, marked to the last mid of each product.
+ */
+struct BacktestResult
+{
+    string strategy;
+    AlgoExecutionParams params;
+    long books = 0;
+    long orders = 0;
+    long fills = 0;
+    double orderedQuantity = 0;
+    double filledQuantity = 0;
+    double pnl = 0;
+    double maxPosition = 0;     // largest absolute position reached in a product
+    double seconds = 0;
+};
+
+
+/**
+ * Simulated fill model and books of one backtest.
+ * Every order of the strategy rests at its price, visible and hidden quantity together, for a
+ * fixed number of book updates of its product. A later book whose opposite touch trades
+ * through the order fills it at the order price, up to the size at that touch; whatever is
+ * left when its life runs out is cancelled. Fills and cancels are reported back to the
+ * strategy as order updates, as the execution service does in the live flow.
+ * Type T is the product type.
+ */
+template<typename T>
+class BacktestRun
+{
+private:
+    struct RestingOrder
+    {
+        ExecutionOrder<T> order;
+        int booksLeft;
+    };
+
+    AlgoExecutionServiceBase<T>* algo;
+    int rest_books;
+    vector<vector<RestingOrder>> resting;       // indexed by product index
+    vector<double> positions;
+    vector<double> cash;
+    vector<double> mids;
+    BacktestResult result;
+
+public:
+    // ctor
+    BacktestRun(AlgoExecutionServiceBase<T>* _algo, int _restBooks);
+
+    // Rest a new order of the strategy
+    void OnOrder(const ExecutionOrder<T>& order);
+
+    // Match the resting orders of a product against a new book
+    void OnBook(int productIndex, const OrderBook<T>& book);
+
+    // Get the result, marking the positions to the last mids
+    BacktestResult GetResult() const;
+};
+
+
+template<typename T>
+class BacktestOrderListener;
+
+
+/**
+ * Backtesting harness for the AlgoExecutionService.
+ * The recorded market data file is mapped once, read-only, and each backtest parses the
+ * books straight from the mapping, so any number of workers share one copy of the data.
+ * A sweep runs the grid points over a pool of threads that take the next point as they
+ * finish, each point with its own strategy, built by name from the strategy registry, and
+ * its own fill model.
+ * Type T is the product type.
+ */
+template<typename T>
+class Backtester
+{
+private:
+    MappedFile data;
+    long max_books;
+    int rest_books;
+    vector<T> products;         // indexed by product index
+    StrategyRegistry<T> strategies;
+
+    // Parse one line of market data into a book, returns the product index or -1
+    int ParseBook(const char* begin, const char* end, OrderBook<T>& book) const;
+
+public:
+    // ctor
+    Backtester(const string& path, long _maxBooks = 0, int _restBooks = 5);
+
+    // Run one backtest
+    BacktestResult Run(const string& strategy, const AlgoExecutionParams& params) const;
+
+    // Run a backtest for every point of a grid across threads
+    vector<BacktestResult> Sweep(const vector<pair<string, AlgoExecutionParams>>& grid, int threads = 0) const;
+
+    // Build the grid of every combination of the given strategies and parameter values
+    static vector<pair<string, AlgoExecutionParams>> MakeGrid(const vector<string>& strategies,
+        const vector<double>& spreadTolerances, const vector<double>& sizeFractions);
+
+    // Write the results of a sweep as one line per grid point
+    static void WriteReport(const string& path, const vector<BacktestResult>& results);
+};
+
+
+template <typename T>
+BacktestRun<T>::BacktestRun(AlgoExecutionServiceBase<T>* _algo, int _restBooks) :
+    algo(_algo), rest_books(_restBooks), resting(GetProductCount()), positions(GetProductCount(), 0.0),
+    cash(GetProductCount(), 0.0), mids(GetProductCount(), 0.0)
+{
+    result.params = algo->GetParams();
+}
+
+template <typename T>
+void BacktestRun<T>::OnOrder(const ExecutionOrder<T>& order)
+{
+    int index = GetProductIndex(order.GetProduct().GetProductId());
+    double quantity = order.GetVisibleQuantity() + order.GetHiddenQuantity();
+    ExecutionOrder<T> working(order.GetProduct(), order.GetPricingSide(), order.GetOrderId(), order.GetOrderType(),
+        order.GetPrice(), quantity, 0, order.GetParentOrderId(), order.IsChildOrder());
+    resting[index].push_back(RestingOrder{ working, rest_books });
+    ++result.orders;
+    result.orderedQuantity += quantity;
+}
+
+/**
+ * @brief Match the resting orders of a product against a new book.
+ *
+ * @tparam T The type of the product.
+ * @param productIndex The index of the product of the book.
+ * @param book The new book.
+ */
+template <typename T>
+void BacktestRun<T>::OnBook(int productIndex, const OrderBook<T>& book)
+{
+    ++result.books;
+    const vector<Order>& bids = book.GetBidStack();
+    const vector<Order>& offers = book.GetOfferStack();
+    if (bids.empty() || offers.empty())
+        return;
+    const Order* best_bid = &bids[0];
+    const Order* best_offer = &offers[0];
+    for (const auto& e : bids)
+    {
+        if (e.GetPrice() > best_bid->GetPrice())
+            best_bid = &e;
+    }
+    for (const auto& e : offers)
+    {
+        if (e.GetPrice() < best_offer->GetPrice())
+            best_offer = &e;
+    }
+    mids[productIndex] = (best_bid->GetPrice() + best_offer->GetPrice()) / 2;
+
+    vector<RestingOrder>& orders = resting[productIndex];
+    size_t kept = 0;
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        ExecutionOrder<T>& order = orders[i].order;
+        bool bid = order.GetPricingSide() == BID;
+        const Order& touch = bid ? *best_offer : *best_bid;
+        if (bid ? touch.GetPrice() <= order.GetPrice() : touch.GetPrice() >= order.GetPrice())
+        {
+            double quantity = min(order.GetLeavesQuantity(), double(touch.GetQuantity()));
+            order.AddFill(order.GetPrice(), quantity);
+            order.SetStatus(order.GetLeavesQuantity() > 1e-6 ? ORDER_PARTIALLY_FILLED : ORDER_FILLED);
+            double signed_quantity = bid ? quantity : -quantity;
+            positions[productIndex] += signed_quantity;
+            cash[productIndex] -= signed_quantity * order.GetPrice() / 100;
+            result.maxPosition = max(result.maxPosition, fabs(positions[productIndex]));
+            result.filledQuantity += quantity;
+            ++result.fills;
+            algo->OnExecution(order);
+            if (order.IsTerminal())
+                continue;
+        }
+        if (--orders[i].booksLeft == 0)
+        {
+            order.SetStatus(ORDER_CANCELLED);
+            algo->OnExecution(order);
+            continue;
+        }
+        if (kept != i)
+            orders[kept] = move(orders[i]);
+        ++kept;
+    }
+    orders.erase(orders.begin() + kept, orders.end());
+}
+
+template <typename T>
+BacktestResult BacktestRun<T>::GetResult() const
+{
+    BacktestResult marked = result;
+    for (size_t i = 0; i < positions.size(); ++i)
+        marked.pnl += cash[i] + positions[i] * mids[i] / 100;
+    return marked;
+}
+
+
+template <typename T>
+Backtester<T>::Backtester(const string& path, long _maxBooks, int _restBooks) :
+    data(path), max_books(_maxBooks), rest_books(_restBooks)
+{
+    // Register every product up front: the index is only read once the workers start
+    for (const auto& productId : g_product_Ids)
+        GetProductIndex(productId);
+    for (int i = 0; i < GetProductCount(); ++i)
+    {
+        string productId = g_indexed_product_Ids[i];
+        products.push_back(Bond(productId, CUSIP, g_tickers[productId], g_coupons[productId], g_dates[productId]));
+    }
+}
+
+/**
+ * @brief Parse one line of market data into a book.
+ *
+ * A line is the product identifier followed by five bid and offer prices in fractional
+ * notation, alternating, the same layout the market data connector reads.
+ *
+ * @tparam T The type of the product.
+ * @param begin The first character of the line.
+ * @param end One past the last character of the line.
+ * @param book Set to the parsed book.
+ * @return The index of the product, or -1 if the line is not a book of a known product.
+ */
+template <typename T>
+int Backtester<T>::ParseBook(const char* begin, const char* end, OrderBook<T>& book) const
+{
+    const char* comma = static_cast<const char*>(memchr(begin, ',', end - begin));
+    if (comma == nullptr)
+        return -1;
+    auto found = g_product_index.find(string(begin, comma));
+    if (found == g_product_index.end())
+        return -1;
+
+    vector<Order> bid_stack, offer_stack;
+    bid_stack.reserve(5);
+    offer_stack.reserve(5);
+    const char* field = comma + 1;
+    for (int i = 0; i < 10; ++i)
+    {
+        const char* next = static_cast<const char*>(memchr(field, ',', end - field));
+        if (next == nullptr)
+            next = end;
+        if (field == next)
+            return -1;
+        double price = ConvertFractionalToPrice(string(field, next));
+        if (i % 2 == 0)
+            bid_stack.push_back(Order(price, 1000000 * (i / 2 + 1), BID));
+        else
+            offer_stack.push_back(Order(price, 1000000 * (i / 2 + 1), OFFER));
+        field = next < end ? next + 1 : end;
+    }
+    book = OrderBook<T>(products[found->second], bid_stack, offer_stack);
+    return found->second;
+}
+
+/**
+ * @brief Run one backtest.
+ *
+ * The strategy sees every book after the resting orders of its product are matched against
+ * it, so an order never fills against the book that triggered it.
+ *
+ * @tparam T The type of the product.
+ * @param strategy The name of the strategy in the registry.
+ * @param params The parameters of the strategy.
+ * @return The result of the backtest.
+ * @throws out_of_range if the strategy is not registered.
+ */
+template <typename T>
+BacktestResult Backtester<T>::Run(const string& strategy, const AlgoExecutionParams& params) const
+{
+    auto start = chrono::steady_clock::now();
+    unique_ptr<AlgoExecutionServiceBase<T>> algo = strategies.MakeExecution(strategy, params);
+    BacktestRun<T> run(algo.get(), rest_books);
+    BacktestOrderListener<T> listener(&run);
+    algo->AddListener(&listener);
+
+    const char* cursor = data.GetData();
+    const char* end = cursor + data.GetSize();
+    OrderBook<T> book;
+    long books = 0;
+    while (cursor < end && (max_books == 0 || books < max_books))
+    {
+        const char* eol = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+        if (eol == nullptr)
+            eol = end;
+        int index = ParseBook(cursor, eol, book);
+        cursor = eol + 1;
+        if (index == -1)
+            continue;
+        ++books;
+        run.OnBook(index, book);
+        algo->ExecuteOrder(book);
+    }
+
+    BacktestResult result = run.GetResult();
+    result.strategy = strategy;
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/**
+ * @brief Run a backtest for every point of a grid across threads.
+ *
+ * @tparam T The type of the product.
+ * @param grid The strategies and parameters to test.
+ * @param threads The number of worker threads, 0 for one per core.
+ * @return The results, in the order of the grid.
+ */
+template <typename T>
+vector<BacktestResult> Backtester<T>::Sweep(const vector<pair<string, AlgoExecutionParams>>& grid, int threads) const
+{
+    if (threads <= 0)
+        threads = max(1u, thread::hardware_concurrency());
+    threads = min<int>(threads, grid.size());
+
+    vector<BacktestResult> results(grid.size());
+    atomic<size_t> next(0);
+    vector<thread> workers;
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&]()
+        {
+            for (size_t point = next++; point < grid.size(); point = next++)
+                results[point] = Run(grid[point].first, grid[point].second);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    return results;
+}
+
+template <typename T>
+vector<pair<string, AlgoExecutionParams>> Backtester<T>::MakeGrid(const vector<string>& strategies,
+    const vector<double>& spreadTolerances, const vector<double>& sizeFractions)
+{
+    vector<pair<string, AlgoExecutionParams>> grid;
+    for (const auto& strategy : strategies)
+        for (double tolerance : spreadTolerances)
+            for (double fraction : sizeFractions)
+            {
+                AlgoExecutionParams params;
+                params.spreadTolerance = tolerance;
+                params.sizeFraction = fraction;
+                grid.push_back(make_pair(strategy, params));
+            }
+    return grid;
+}
+
+template <typename T>
+void Backtester<T>::WriteReport(const string& path, const vector<BacktestResult>& results)
+{
+    ofstream out(path);
+    out << "strategy,spread_tol,size_fraction,books,orders,fills,fill_ratio,pnl,max_position,seconds\n";
+    for (const auto& result : results)
+    {
+        out << result.strategy << "," << result.params.spreadTolerance << "," << result.params.sizeFraction << ","
+            << result.books << "," << result.orders << ","
+            << result.fills << "," << (result.orderedQuantity > 0 ? result.filledQuantity / result.orderedQuantity : 0) << ","
+            << result.pnl << "," << result.maxPosition << "," << result.seconds << "\n";
+    }
+}
+
+#endif
@@ -0,0 +1,380 @@
+/**
+ * @file CurveService.hpp
+ * @brief Header file for the ZeroCurve class and the CurveService class template.
+ *
+ * This file contains the definition and implementation of the treasury zero curve bootstrapped
+ * from the on-the-run benchmarks, and the service that keeps it up to date from pricing ticks.
+ */
+
+#ifndef CURVE_SERVICE_HPP
+#define CURVE_SERVICE_HPP
+
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "SOA.hpp"
+#include "ProductIndex.hpp"
+#include "PricingService.hpp"
+#include "DataGenerator.hpp"
+
+using namespace std;
+
+// Number of curve pillars, one per on-the-run benchmark
+const int CURVE_PILLARS = 7;
+
+// Key of the treasury curve in the curve service
+const string UST_CURVE = "UST";
+
+/**
+ * Zero curve with continuously compounded zero rates at the benchmark maturities.
+ * Rates are linearly interpolated between pillars and flat extrapolated outside them.
+ * Times are year fractions (ACT/365) from g_curve_date.
+ */
+class ZeroCurve
+{
+public:
+    // ctor
+    ZeroCurve() = default;
+    ZeroCurve(const array<double, CURVE_PILLARS>& _times, const array<double, CURVE_PILLARS>& _zeroRates);
+
+    // Get the interpolated zero rate at time t
+    double GetZeroRate(double t) const;
+
+    // Get the interpolated discount factor at time t
+    double GetDiscountFactor(double t) const;
+
+    // Get the pillar times
+    const array<double, CURVE_PILLARS>& GetPillarTimes() const;
+
+    // Get the pillar zero rates
+    const array<double, CURVE_PILLARS>& GetZeroRates() const;
+
+    // Set the zero rate of a pillar
+    void SetZeroRate(int pillar, double zeroRate);
+
+private:
+    array<double, CURVE_PILLARS> times{};
+    array<double, CURVE_PILLARS> zeroRates{};
+};
+
+
+/**
+ * A cash flow of a benchmark bond with its precomputed interpolation weights,
+ * so re-pricing it only needs the pillar zero rates.
+ */
+struct CurveCashFlow
+{
+    double time;
+    double amount;
+    int lowPillar;
+    double lowWeight;
+    int highPillar;
+    double highWeight;
+};
+
+
+/**
+ * @brief Build the cash flows of a bond with their interpolation weights against the pillars.
+ *
+ * Flows are semi-annual coupons back from the maturity, plus the principal, per 100 of face;
+ * flows on or before g_curve_date are dropped. Flows outside the pillars are weighted flat
+ * on the nearest pillar.
+ *
+ * @param coupon The annual coupon rate.
+ * @param maturity The maturity date.
+ * @param times The pillar times.
+ * @return The cash flows in time order.
+ */
+vector<CurveCashFlow> MakeCurveCashFlows(double coupon, const date& maturity, const array<double, CURVE_PILLARS>& times)
+{
+    vector<date> pay_dates;
+    for (date d = maturity; d > g_curve_date; d -= months(6))
+        pay_dates.insert(pay_dates.begin(), d);
+
+    vector<CurveCashFlow> flows;
+    for (const date& d : pay_dates)
+    {
+        double t = (d - g_curve_date).days() / 365.0;
+        double amount = 100.0 * coupon / 2 + (d == maturity ? 100.0 : 0.0);
+        if (amount == 0)
+            continue;
+
+        CurveCashFlow flow{ t, amount, 0, 0.0, 0, 1.0 };
+        int hi = 0;
+        while (hi < CURVE_PILLARS - 1 && t > times[hi])
+            ++hi;
+        if (hi > 0 && t > times[hi - 1] && t <= times[hi])
+        {
+            flow.lowPillar = hi - 1;
+            flow.highWeight = (t - times[hi - 1]) / (times[hi] - times[hi - 1]);
+            flow.lowWeight = 1.0 - flow.highWeight;
+        }
+        else
+        {
+            flow.lowPillar = hi;
+        }
+        flow.highPillar = hi;
+        flows.push_back(flow);
+    }
+    return flows;
+}
+
+
+/**
+ * Curve Service bootstrapping the treasury zero curve from the on-the-run benchmark mids.
+ * When a benchmark ticks only its pillar and the longer ones are re-solved, since the
+ * shorter pillars do not depend on it.
+ * Keyed on curve name.
+ * Type T is the product type.
+ */
+template<typename T>
+class CurveService : public Service<string, ZeroCurve>
+{
+private:
+    ZeroCurve curve;
+    vector<int> pillars;                                 // product index -> pillar, -1 if not a benchmark
+    array<double, CURVE_PILLARS> benchmark_prices;
+    vector<CurveCashFlow> cash_flows;                    // all benchmark cash flows, grouped by pillar
+    array<int, CURVE_PILLARS + 1> cash_flow_offsets;     // start of each pillar's flows in cash_flows
+    vector<double> flow_values;                          // discounted value of each flow at the last solve
+    bool flows_stale;                                    // whether the curve was replaced since the last solve
+
+    // Solve the zero rate of a pillar given the shorter pillars
+    void SolvePillar(int pillar, int firstChanged);
+
+public:
+    // ctor
+    CurveService();
+
+    // Get the curve of a key, UST_CURVE being the only one
+    ZeroCurve& GetData(string key);
+
+    // The callback that a Connector should invoke for any new or updated data
+    void OnMessage(ZeroCurve& data);
+
+    // Re-bootstrap the curve from a benchmark price tick
+    void UpdateBenchmark(const Price<T>& price);
+
+    // Get the interpolated discount factor at time t
+    double GetDiscountFactor(double t) const;
+};
+
+
+ZeroCurve::ZeroCurve(const array<double, CURVE_PILLARS>& _times, const array<double, CURVE_PILLARS>& _zeroRates) :
+    times(_times), zeroRates(_zeroRates)
+{
+}
+
+double ZeroCurve::GetZeroRate(double t) const
+{
+    if (t <= times[0])
+        return zeroRates[0];
+    for (int i = 1; i < CURVE_PILLARS; ++i)
+    {
+        if (t <= times[i])
+        {
+            double w = (t - times[i - 1]) / (times[i] - times[i - 1]);
+            return zeroRates[i - 1] + w * (zeroRates[i] - zeroRates[i - 1]);
+        }
+    }
+    return zeroRates[CURVE_PILLARS - 1];
+}
+
+double ZeroCurve::GetDiscountFactor(double t) const
+{
+    return exp(-GetZeroRate(t) * t);
+}
+
+const array<double, CURVE_PILLARS>& ZeroCurve::GetPillarTimes() const
+{
+    return times;
+}
+
+const array<double, CURVE_PILLARS>& ZeroCurve::GetZeroRates() const
+{
+    return zeroRates;
+}
+
+void ZeroCurve::SetZeroRate(int pillar, double zeroRate)
+{
+    zeroRates[pillar] = zeroRate;
+}
+
+
+/**
+ * @brief Construct the curve service and bootstrap an initial curve with all benchmarks at par.
+ *
+ * The semi-annual cash flows of each benchmark are generated once from its coupon and maturity,
+ * and the interpolation weights of every flow are precomputed against the pillar times.
+ *
+ * @tparam T The type of the product.
+ */
+template <typename T>
+CurveService<T>::CurveService()
+{
+    array<double, CURVE_PILLARS> times;
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+    {
+        string id = g_product_Ids[i];
+        int index = GetProductIndex(id);
+        if (index >= (int)pillars.size())
+            pillars.resize(index + 1, -1);
+        pillars[index] = i;
+        times[i] = (g_dates[id] - g_curve_date).days() / 365.0;
+        benchmark_prices[i] = 100.0;
+    }
+    curve = ZeroCurve(times, array<double, CURVE_PILLARS>{});
+
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+    {
+        string id = g_product_Ids[i];
+        double coupon = g_coupons.count(id) ? g_coupons[id] : 0.0;
+        cash_flow_offsets[i] = cash_flows.size();
+        vector<CurveCashFlow> flows = MakeCurveCashFlows(coupon, g_dates[id], times);
+        cash_flows.insert(cash_flows.end(), flows.begin(), flows.end());
+    }
+    cash_flow_offsets[CURVE_PILLARS] = cash_flows.size();
+    flow_values.assign(cash_flows.size(), 0.0);
+
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+        SolvePillar(i, 0);
+    flows_stale = false;
+}
+
+/**
+ * @brief Get the curve of a key.
+ *
+ * @tparam T The type of the product.
+ * @param key The curve name, UST_CURVE.
+ * @return The current treasury curve.
+ * @throws out_of_range if the key is not UST_CURVE.
+ */
+template <typename T>
+ZeroCurve& CurveService<T>::GetData(string key)
+{
+    if (key != UST_CURVE)
+        throw out_of_range("No curve " + key);
+    return curve;
+}
+
+template <typename T>
+void CurveService<T>::OnMessage(ZeroCurve& data)
+{
+    curve = data;
+    flows_stale = true;
+}
+
+/**
+ * @brief Get exp(x), by its Taylor series when x is small.
+ *
+ * Newton steps move a pillar by a fraction of a basis point, so re-discounting a flow by
+ * exp(-weight * time * step) is a few multiplications instead of a call to exp.
+ *
+ * @param x The exponent.
+ * @return exp(x) to double precision.
+ */
+double CurveStepFactor(double x)
+{
+    if (fabs(x) > 1e-3)
+        return exp(x);
+    return 1 + x * (1 + x / 2 * (1 + x / 3 * (1 + x / 4)));
+}
+
+/**
+ * @brief Solve the zero rate of a pillar so that its benchmark reprices to the quoted mid.
+ *
+ * Flows before the previous pillar are fully determined by the shorter pillars. Their
+ * discounted values are kept from the last solve and only recomputed when they touch a
+ * pillar at or after the first one re-solved by this update. Newton's method then only
+ * iterates over the flows that depend on this pillar, discounting them once and then
+ * rescaling each by its step factor. The previous zero rate of the pillar is the starting
+ * guess, which usually converges in one or two iterations for a single tick.
+ *
+ * @tparam T The type of the product.
+ * @param pillar The index of the pillar to solve.
+ * @param firstChanged The first pillar changed by this update; flows below it are unchanged.
+ */
+template <typename T>
+void CurveService<T>::SolvePillar(int pillar, int firstChanged)
+{
+    const array<double, CURVE_PILLARS>& zeros = curve.GetZeroRates();
+    double known_pv = 0;
+    int first = cash_flow_offsets[pillar];
+    int last = cash_flow_offsets[pillar + 1];
+    int k = first;
+    for (; k < last && cash_flows[k].highPillar != pillar; ++k)
+    {
+        const CurveCashFlow& f = cash_flows[k];
+        if (f.highPillar >= firstChanged)
+        {
+            double z = f.lowWeight * zeros[f.lowPillar] + f.highWeight * zeros[f.highPillar];
+            flow_values[k] = f.amount * exp(-z * f.time);
+        }
+        known_pv += flow_values[k];
+    }
+
+    double z_pillar = zeros[pillar];
+    for (int j = k; j < last; ++j)
+    {
+        const CurveCashFlow& f = cash_flows[j];
+        double z = f.lowWeight * zeros[f.lowPillar] + f.highWeight * z_pillar;
+        flow_values[j] = f.amount * exp(-z * f.time);
+    }
+    for (int iter = 0; iter < 20; ++iter)
+    {
+        double pv = known_pv;
+        double dpv = 0;
+        for (int j = k; j < last; ++j)
+        {
+            pv += flow_values[j];
+            dpv -= flow_values[j] * cash_flows[j].highWeight * cash_flows[j].time;
+        }
+        double diff = pv - benchmark_prices[pillar];
+        if (fabs(diff) < 1e-10 || dpv == 0)
+            break;
+        double step = -diff / dpv;
+        z_pillar += step;
+        for (int j = k; j < last; ++j)
+            flow_values[j] *= CurveStepFactor(-cash_flows[j].highWeight * cash_flows[j].time * step);
+    }
+    curve.SetZeroRate(pillar, z_pillar);
+}
+
+/**
+ * @brief Re-bootstrap the curve from a benchmark price tick.
+ *
+ * The pillar is found from the dense product index carried by the price. Non-benchmark
+ * products and unchanged mids are ignored. Otherwise the ticked pillar and every longer
+ * pillar are re-solved and the listeners are notified with the new curve.
+ *
+ * @tparam T The type of the product.
+ * @param price The price tick from the pricing service.
+ */
+template <typename T>
+void CurveService<T>::UpdateBenchmark(const Price<T>& price)
+{
+    int index = price.GetProductIndex();
+    if (index < 0 || index >= (int)pillars.size() || pillars[index] < 0)
+        return;
+
+    int pillar = pillars[index];
+    if (benchmark_prices[pillar] == price.GetMid())
+        return;
+
+    benchmark_prices[pillar] = price.GetMid();
+    int first_changed = flows_stale ? 0 : pillar;
+    for (int i = pillar; i < CURVE_PILLARS; ++i)
+        SolvePillar(i, first_changed);
+    flows_stale = false;
+    Service<string, ZeroCurve>::Notify(curve);
+}
+
+template <typename T>
+double CurveService<T>::GetDiscountFactor(double t) const
+{
+    return curve.GetDiscountFactor(t);
+}
+
+#endif
@@ -0,0 +1,733 @@
+/**
+ * @file ExchangeSimulator.hpp
+ * @brief Header file for the in-process venue simulator behind the execution service.
+ *
+ * This file contains a price-time priority limit order book per product and venue, fed with
+ * street liquidity from the market data snapshots, and the simulated exchange that delivers
+ * orders to those books after a per-venue latency and reports acks, fills, cancels and rejects.
+ * Order nodes come from a preallocated pool, so matching does not allocate.
+ */
+
+#ifndef EXCHANGE_SIMULATOR_HPP
+#define EXCHANGE_SIMULATOR_HPP
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "MarketDataService.hpp"
+
+using namespace std;
+
+enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
+
+enum Market { BROKERTEC, ESPEED, CME };
+
+// Get the name of a market
+string GetMarketName(Market market)
+{
+    if (market == BROKERTEC)
+        return "BROKERTEC";
+    else if (market == ESPEED)
+        return "ESPEED";
+    return "CME";
+}
+
+// Prices are matched in integer ticks of 1/256
+const double EXCHANGE_TICKS_PER_POINT = 256.0;
+
+// Capacity of the price levels on each side of a venue book
+const int MAX_BOOK_LEVELS = 64;
+
+/**
+ * Settings of a simulated venue.
+ */
+struct VenueConfig
+{
+    uint64_t latencyMicros;     // one-way latency from submission to arrival at the venue
+    double liquidityShare;      // share of the market data snapshot displayed on this venue
+    double feePerMillion;       // execution fee per million of face
+};
+
+// Default settings of BROKERTEC, ESPEED and CME, in Market order
+const array<VenueConfig, 3> DEFAULT_VENUE_CONFIGS{ {
+    { 50, 0.5, 2.0 },
+    { 80, 0.3, 1.5 },
+    { 150, 0.2, 1.0 }
+} };
+
+// Reports sent back by the simulated exchange
+enum ExchangeReportType { EXCHANGE_ACK, EXCHANGE_FILL, EXCHANGE_CANCEL, EXCHANGE_REJECT, EXCHANGE_CANCEL_REJECT };
+
+/**
+ * A report from the simulated exchange about one of our orders.
+ * A fill with leaves quantity left is a partial fill. A cancel reject means the order was no
+ * longer on the book when its cancel arrived, and leaves the order as it was.
+ */
+struct ExchangeReport
+{
+    ExchangeReportType type;
+    uint64_t clientRef;
+    Market market;
+    double price;
+    long quantity;
+    long leavesQuantity;
+};
+
+/**
+ * An order resting on a venue book, either street liquidity from market data or our own.
+ * Nodes of a price level are chained in time priority through prev/next.
+ */
+struct ExchangeOrderNode
+{
+    uint64_t clientRef;
+    long quantity;
+    int64_t priceTicks;
+    int prev;
+    int next;
+    bool own;
+    PricingSide side;
+};
+
+/**
+ * A price level with its FIFO of order nodes.
+ */
+struct PriceLevel
+{
+    int64_t priceTicks;
+    int head;
+    int tail;
+};
+
+
+/**
+ * Preallocated pool of order nodes with a free list.
+ */
+class OrderNodePool
+{
+public:
+    // ctor
+    OrderNodePool(int capacity);
+
+    // Take a node from the pool, or -1 if it is exhausted
+    int Allocate();
+
+    // Return a node to the pool
+    void Release(int node);
+
+    // Access a node
+    ExchangeOrderNode& operator[](int node);
+
+private:
+    vector<ExchangeOrderNode> nodes;
+    int free_head;
+};
+
+
+/**
+ * Price-time priority limit order book of one product on one venue.
+ * Own orders never match each other; they trade against street liquidity only.
+ */
+class LimitOrderBook
+{
+public:
+    // ctor
+    LimitOrderBook(OrderNodePool* _pool = nullptr);
+
+    // Has the book received market data yet
+    bool HasMarket() const;
+
+    // Replace the street liquidity with a market data snapshot scaled by the venue share
+    void RefreshStreet(const vector<Order>& bidStack, const vector<Order>& offerStack, double share);
+
+    // Match an incoming order up to a limit, calling onFill(ref, priceTicks, quantity, leaves) per fill
+    template<typename F>
+    long Match(uint64_t ref, PricingSide side, int64_t limitTicks, long quantity, F onFill);
+
+    // Get the street quantity available to an incoming order up to a limit
+    long GetAvailableQuantity(PricingSide side, int64_t limitTicks) const;
+
+    // Rest an own order on the book, returning its node or -1 if the book or pool is full
+    int Rest(uint64_t ref, PricingSide side, int64_t priceTicks, long quantity);
+
+    // Take an own resting order off the book, returning its quantity or -1 if it is not resting
+    long Cancel(uint64_t ref, PricingSide side, int64_t priceTicks);
+
+    // Re-match own resting orders that the new street liquidity crosses
+    template<typename F>
+    void MatchCrossedResting(F onFill);
+
+    // Get the best street price and quantity on a side, returns false if there is none
+    bool GetTouch(PricingSide side, double& price, long& quantity) const;
+
+private:
+    OrderNodePool* pool;
+    vector<PriceLevel> bids;        // best (highest) first
+    vector<PriceLevel> offers;      // best (lowest) first
+    vector<int> scratch;
+    bool has_market;
+
+    // Find the level of a price, inserting it in price order, or -1 if the side is full
+    int FindOrInsertLevel(vector<PriceLevel>& levels, int64_t priceTicks, bool descending);
+
+    // Append a node at the back of a level
+    void Append(PriceLevel& level, int node);
+
+    // Unlink a node from a level
+    void Unlink(PriceLevel& level, int node);
+};
+
+
+/**
+ * A submitted order, or the cancel of one, travelling to its venue.
+ */
+struct PendingArrival
+{
+    uint64_t arrivalMicros;
+    uint64_t sequence;
+    uint64_t clientRef;
+    int productIndex;
+    Market market;
+    PricingSide side;
+    OrderType orderType;
+    int64_t priceTicks;
+    long quantity;
+    bool cancel;
+};
+
+
+/**
+ * Simulated exchange with one limit order book per product and venue.
+ * Submitted orders arrive at their venue after the venue latency; the clock is advanced by
+ * the caller, typically once per market data snapshot.
+ */
+class SimulatedExchange
+{
+public:
+    // ctor
+    SimulatedExchange(int poolCapacity = 1 << 16);
+
+    // Get the settings of a venue
+    const VenueConfig& GetVenueConfig(Market market) const;
+
+    // Change the settings of a venue
+    void SetVenueConfig(Market market, const VenueConfig& config);
+
+    // Get the simulated time in microseconds
+    uint64_t GetTime() const;
+
+    // Get the book of a product on a venue
+    const LimitOrderBook& GetBook(int productIndex, Market market);
+
+    // Send an order to a venue; it arrives after the venue latency
+    void Submit(uint64_t clientRef, int productIndex, Market market, PricingSide side, OrderType orderType, double price, long quantity);
+
+    // Send the cancel of a resting order to its venue; it arrives after the venue latency
+    void Cancel(uint64_t clientRef, int productIndex, Market market, PricingSide side, double price);
+
+    // Process the arrivals due up to a time and move the clock there
+    template<typename F>
+    void AdvanceTo(uint64_t time, F onReport);
+
+    // Refresh the street liquidity of a product on every venue from a snapshot
+    template<typename F>
+    void UpdateMarketData(int productIndex, const vector<Order>& bidStack, const vector<Order>& offerStack, F onReport);
+
+private:
+    OrderNodePool pool;
+    vector<LimitOrderBook> books;       // productIndex * 3 + market
+    array<VenueConfig, 3> venues;
+    vector<PendingArrival> arrivals;    // min-heap on arrival time
+    uint64_t now;
+    uint64_t sequence;
+
+    // Make room for the books of a product
+    LimitOrderBook& Book(int productIndex, Market market);
+
+    // Match an arrived order against its venue book
+    template<typename F>
+    void Arrive(const PendingArrival& order, F onReport);
+};
+
+
+OrderNodePool::OrderNodePool(int capacity) : nodes(capacity), free_head(capacity > 0 ? 0 : -1)
+{
+    for (int i = 0; i < capacity; ++i)
+        nodes[i].next = i + 1 < capacity ? i + 1 : -1;
+}
+
+int OrderNodePool::Allocate()
+{
+    int node = free_head;
+    if (node != -1)
+        free_head = nodes[node].next;
+    return node;
+}
+
+void OrderNodePool::Release(int node)
+{
+    nodes[node].next = free_head;
+    free_head = node;
+}
+
+ExchangeOrderNode& OrderNodePool::operator[](int node)
+{
+    return nodes[node];
+}
+
+
+LimitOrderBook::LimitOrderBook(OrderNodePool* _pool) : pool(_pool), has_market(false)
+{
+    bids.reserve(MAX_BOOK_LEVELS);
+    offers.reserve(MAX_BOOK_LEVELS);
+    scratch.reserve(MAX_BOOK_LEVELS);
+}
+
+bool LimitOrderBook::HasMarket() const
+{
+    return has_market;
+}
+
+int LimitOrderBook::FindOrInsertLevel(vector<PriceLevel>& levels, int64_t priceTicks, bool descending)
+{
+    int i = 0;
+    int n = levels.size();
+    while (i < n && (descending ? levels[i].priceTicks > priceTicks : levels[i].priceTicks < priceTicks))
+        ++i;
+    if (i < n && levels[i].priceTicks == priceTicks)
+        return i;
+    if (n == MAX_BOOK_LEVELS)
+        return -1;
+    levels.insert(levels.begin() + i, PriceLevel{ priceTicks, -1, -1 });
+    return i;
+}
+
+void LimitOrderBook::Append(PriceLevel& level, int node)
+{
+    ExchangeOrderNode& n = (*pool)[node];
+    n.prev = level.tail;
+    n.next = -1;
+    if (level.tail != -1)
+        (*pool)[level.tail].next = node;
+    else
+        level.head = node;
+    level.tail = node;
+}
+
+void LimitOrderBook::Unlink(PriceLevel& level, int node)
+{
+    ExchangeOrderNode& n = (*pool)[node];
+    if (n.prev != -1)
+        (*pool)[n.prev].next = n.next;
+    else
+        level.head = n.next;
+    if (n.next != -1)
+        (*pool)[n.next].prev = n.prev;
+    else
+        level.tail = n.prev;
+}
+
+/**
+ * @brief Replace the street liquidity with a market data snapshot scaled by the venue share.
+ *
+ * Street nodes are returned to the pool and the new ones appended behind any own orders
+ * resting at the same price. Levels left empty are removed.
+ *
+ * @param bidStack The bid stack of the snapshot.
+ * @param offerStack The offer stack of the snapshot.
+ * @param share The share of the snapshot sizes displayed on this venue.
+ */
+void LimitOrderBook::RefreshStreet(const vector<Order>& bidStack, const vector<Order>& offerStack, double share)
+{
+    for (auto* levels : { &bids, &offers })
+    {
+        for (auto& level : *levels)
+        {
+            for (int node = level.head; node != -1;)
+            {
+                int next = (*pool)[node].next;
+                if (!(*pool)[node].own)
+                {
+                    Unlink(level, node);
+                    pool->Release(node);
+                }
+                node = next;
+            }
+        }
+        levels->erase(remove_if(levels->begin(), levels->end(), [](const PriceLevel& l) { return l.head == -1; }), levels->end());
+    }
+
+    for (const auto* stack : { &bidStack, &offerStack })
+    {
+        for (const auto& order : *stack)
+        {
+            long quantity = lround(order.GetQuantity() * share);
+            if (quantity <= 0)
+                continue;
+            bool is_bid = order.GetSide() == BID;
+            int64_t ticks = llround(order.GetPrice() * EXCHANGE_TICKS_PER_POINT);
+            vector<PriceLevel>& levels = is_bid ? bids : offers;
+            int level = FindOrInsertLevel(levels, ticks, is_bid);
+            if (level == -1)
+                continue;
+            int node = pool->Allocate();
+            if (node == -1)
+                return;
+            (*pool)[node] = ExchangeOrderNode{ 0, quantity, ticks, -1, -1, false, order.GetSide() };
+            Append(levels[level], node);
+        }
+    }
+    has_market = true;
+}
+
+/**
+ * @brief Match an incoming order against the street liquidity on the opposite side.
+ *
+ * Levels are walked from the best price while they satisfy the limit, and each level in time
+ * priority. Own resting orders are skipped, so we never trade with ourselves.
+ *
+ * @param ref The client reference of the incoming order.
+ * @param side The side of the incoming order, BID to buy.
+ * @param limitTicks The worst price the incoming order accepts.
+ * @param quantity The quantity of the incoming order.
+ * @param onFill Called with (ref, priceTicks, quantity, leaves) for every fill.
+ * @return The quantity left unfilled.
+ */
+template<typename F>
+long LimitOrderBook::Match(uint64_t ref, PricingSide side, int64_t limitTicks, long quantity, F onFill)
+{
+    vector<PriceLevel>& levels = side == BID ? offers : bids;
+    size_t i = 0;
+    while (quantity > 0 && i < levels.size())
+    {
+        PriceLevel& level = levels[i];
+        if (side == BID ? level.priceTicks > limitTicks : level.priceTicks < limitTicks)
+            break;
+        for (int node = level.head; node != -1 && quantity > 0;)
+        {
+            ExchangeOrderNode& n = (*pool)[node];
+            int next = n.next;
+            if (!n.own)
+            {
+                long fill = min(quantity, n.quantity);
+                n.quantity -= fill;
+                quantity -= fill;
+                if (n.quantity == 0)
+                {
+                    Unlink(level, node);
+                    pool->Release(node);
+                }
+                onFill(ref, level.priceTicks, fill, quantity);
+            }
+            node = next;
+        }
+        if (level.head == -1)
+            levels.erase(levels.begin() + i);
+        else
+            ++i;
+    }
+    return quantity;
+}
+
+long LimitOrderBook::GetAvailableQuantity(PricingSide side, int64_t limitTicks) const
+{
+    const vector<PriceLevel>& levels = side == BID ? offers : bids;
+    long available = 0;
+    for (const auto& level : levels)
+    {
+        if (side == BID ? level.priceTicks > limitTicks : level.priceTicks < limitTicks)
+            break;
+        for (int node = level.head; node != -1; node = (*pool)[node].next)
+        {
+            if (!(*pool)[node].own)
+                available += (*pool)[node].quantity;
+        }
+    }
+    return available;
+}
+
+int LimitOrderBook::Rest(uint64_t ref, PricingSide side, int64_t priceTicks, long quantity)
+{
+    vector<PriceLevel>& levels = side == BID ? bids : offers;
+    int level = FindOrInsertLevel(levels, priceTicks, side == BID);
+    if (level == -1)
+        return -1;
+    int node = pool->Allocate();
+    if (node == -1)
+    {
+        if (levels[level].head == -1)
+            levels.erase(levels.begin() + level);
+        return -1;
+    }
+    (*pool)[node] = ExchangeOrderNode{ ref, quantity, priceTicks, -1, -1, true, side };
+    Append(levels[level], node);
+    return node;
+}
+
+long LimitOrderBook::Cancel(uint64_t ref, PricingSide side, int64_t priceTicks)
+{
+    vector<PriceLevel>& levels = side == BID ? bids : offers;
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        if (levels[i].priceTicks != priceTicks)
+            continue;
+        for (int node = levels[i].head; node != -1; node = (*pool)[node].next)
+        {
+            ExchangeOrderNode& n = (*pool)[node];
+            if (!n.own || n.clientRef != ref)
+                continue;
+            long quantity = n.quantity;
+            Unlink(levels[i], node);
+            pool->Release(node);
+            if (levels[i].head == -1)
+                levels.erase(levels.begin() + i);
+            return quantity;
+        }
+        break;
+    }
+    return -1;
+}
+
+/**
+ * @brief Re-match own resting orders that the new street liquidity crosses.
+ *
+ * Own orders priced through the opposite best street price are taken off the book, matched
+ * as if they had just arrived, and their remainder rests again at the same price.
+ *
+ * @param onFill Called with (ref, priceTicks, quantity, leaves) for every fill.
+ */
+template<typename F>
+void LimitOrderBook::MatchCrossedResting(F onFill)
+{
+    for (PricingSide side : { BID, OFFER })
+    {
+        vector<PriceLevel>& levels = side == BID ? bids : offers;
+        const vector<PriceLevel>& opposite = side == BID ? offers : bids;
+        if (opposite.empty())
+            continue;
+        int64_t best_opposite = opposite[0].priceTicks;
+
+        scratch.clear();
+        for (auto& level : levels)
+        {
+            if (side == BID ? level.priceTicks < best_opposite : level.priceTicks > best_opposite)
+                break;
+            for (int node = level.head; node != -1; node = (*pool)[node].next)
+            {
+                if ((*pool)[node].own && (int)scratch.size() < MAX_BOOK_LEVELS)
+                    scratch.push_back(node);
+            }
+        }
+
+        for (int node : scratch)
+        {
+            ExchangeOrderNode n = (*pool)[node];
+            int level = FindOrInsertLevel(levels, n.priceTicks, side == BID);
+            Unlink(levels[level], node);
+            if (levels[level].head == -1)
+                levels.erase(levels.begin() + level);
+            long leaves = Match(n.clientRef, side, n.priceTicks, n.quantity, onFill);
+            if (leaves > 0)
+            {
+                level = FindOrInsertLevel(levels, n.priceTicks, side == BID);
+                (*pool)[node].quantity = leaves;
+                Append(levels[level], node);
+            }
+            else
+            {
+                pool->Release(node);
+            }
+        }
+    }
+}
+
+bool LimitOrderBook::GetTouch(PricingSide side, double& price, long& quantity) const
+{
+    const vector<PriceLevel>& levels = side == BID ? bids : offers;
+    for (const auto& level : levels)
+    {
+        long street = 0;
+        for (int node = level.head; node != -1; node = (*pool)[node].next)
+        {
+            if (!(*pool)[node].own)
+                street += (*pool)[node].quantity;
+        }
+        if (street > 0)
+        {
+            price = level.priceTicks / EXCHANGE_TICKS_PER_POINT;
+            quantity = street;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+SimulatedExchange::SimulatedExchange(int poolCapacity) :
+    pool(poolCapacity), venues(DEFAULT_VENUE_CONFIGS), now(0), sequence(0)
+{
+    arrivals.reserve(4096);
+}
+
+const VenueConfig& SimulatedExchange::GetVenueConfig(Market market) const
+{
+    return venues[market];
+}
+
+void SimulatedExchange::SetVenueConfig(Market market, const VenueConfig& config)
+{
+    venues[market] = config;
+}
+
+uint64_t SimulatedExchange::GetTime() const
+{
+    return now;
+}
+
+LimitOrderBook& SimulatedExchange::Book(int productIndex, Market market)
+{
+    size_t i = productIndex * 3 + market;
+    while (i >= books.size())
+        books.push_back(LimitOrderBook(&pool));
+    return books[i];
+}
+
+const LimitOrderBook& SimulatedExchange::GetBook(int productIndex, Market market)
+{
+    return Book(productIndex, market);
+}
+
+/**
+ * @brief Send an order to a venue.
+ *
+ * The order is queued to arrive after the venue latency; nothing is matched until the clock
+ * is advanced past its arrival time.
+ */
+void SimulatedExchange::Submit(uint64_t clientRef, int productIndex, Market market, PricingSide side, OrderType orderType, double price, long quantity)
+{
+    PendingArrival order{ now + venues[market].latencyMicros, sequence++, clientRef, productIndex, market, side, orderType,
+        llround(price * EXCHANGE_TICKS_PER_POINT), quantity, false };
+    arrivals.push_back(order);
+    push_heap(arrivals.begin(), arrivals.end(), [](const PendingArrival& a, const PendingArrival& b)
+        { return a.arrivalMicros != b.arrivalMicros ? a.arrivalMicros > b.arrivalMicros : a.sequence > b.sequence; });
+}
+
+/**
+ * @brief Send the cancel of a resting order to its venue.
+ *
+ * The cancel travels with the same latency as orders, so it always arrives after the order it
+ * cancels and may find it already filled.
+ */
+void SimulatedExchange::Cancel(uint64_t clientRef, int productIndex, Market market, PricingSide side, double price)
+{
+    PendingArrival cancel{ now + venues[market].latencyMicros, sequence++, clientRef, productIndex, market, side, LIMIT,
+        llround(price * EXCHANGE_TICKS_PER_POINT), 0, true };
+    arrivals.push_back(cancel);
+    push_heap(arrivals.begin(), arrivals.end(), [](const PendingArrival& a, const PendingArrival& b)
+        { return a.arrivalMicros != b.arrivalMicros ? a.arrivalMicros > b.arrivalMicros : a.sequence > b.sequence; });
+}
+
+/**
+ * @brief Process the arrivals due up to a time and move the clock there.
+ *
+ * Arrivals are matched in time order. Reports may lead the caller to submit new orders,
+ * which are queued behind the current time.
+ *
+ * @param time The new simulated time in microseconds.
+ * @param onReport Called with every ExchangeReport.
+ */
+template<typename F>
+void SimulatedExchange::AdvanceTo(uint64_t time, F onReport)
+{
+    auto later = [](const PendingArrival& a, const PendingArrival& b)
+        { return a.arrivalMicros != b.arrivalMicros ? a.arrivalMicros > b.arrivalMicros : a.sequence > b.sequence; };
+    while (!arrivals.empty() && arrivals.front().arrivalMicros <= time)
+    {
+        pop_heap(arrivals.begin(), arrivals.end(), later);
+        PendingArrival order = arrivals.back();
+        arrivals.pop_back();
+        now = max(now, order.arrivalMicros);
+        Arrive(order, onReport);
+    }
+    now = max(now, time);
+}
+
+/**
+ * @brief Match an arrived order against its venue book.
+ *
+ * Orders on a venue without market data, with no quantity, or of STOP type are rejected.
+ * MARKET orders take any price and IOC orders their limit, with the remainder cancelled.
+ * FOK orders are cancelled unless their whole quantity is available. LIMIT orders rest their
+ * remainder, or have it cancelled if the book or the node pool is full. Cancels take their
+ * order off the book, or are rejected if it is no longer resting.
+ */
+template<typename F>
+void SimulatedExchange::Arrive(const PendingArrival& order, F onReport)
+{
+    LimitOrderBook& book = Book(order.productIndex, order.market);
+    Market market = order.market;
+    if (order.cancel)
+    {
+        long cancelled = book.Cancel(order.clientRef, order.side, order.priceTicks);
+        if (cancelled == -1)
+            onReport(ExchangeReport{ EXCHANGE_CANCEL_REJECT, order.clientRef, market, 0.0, 0, 0 });
+        else
+            onReport(ExchangeReport{ EXCHANGE_CANCEL, order.clientRef, market, 0.0, cancelled, 0 });
+        return;
+    }
+
+    if (!book.HasMarket() || order.quantity <= 0 || order.orderType == STOP)
+    {
+        onReport(ExchangeReport{ EXCHANGE_REJECT, order.clientRef, market, 0.0, 0, 0 });
+        return;
+    }
+
+    int64_t limit = order.priceTicks;
+    if (order.orderType == MARKET)
+        limit = order.side == BID ? numeric_limits<int64_t>::max() : numeric_limits<int64_t>::min();
+    if (order.orderType == FOK && book.GetAvailableQuantity(order.side, limit) < order.quantity)
+    {
+        onReport(ExchangeReport{ EXCHANGE_ACK, order.clientRef, market, 0.0, 0, order.quantity });
+        onReport(ExchangeReport{ EXCHANGE_CANCEL, order.clientRef, market, 0.0, order.quantity, 0 });
+        return;
+    }
+
+    onReport(ExchangeReport{ EXCHANGE_ACK, order.clientRef, market, 0.0, 0, order.quantity });
+    long leaves = book.Match(order.clientRef, order.side, limit, order.quantity,
+        [&](uint64_t ref, int64_t ticks, long quantity, long left)
+        { onReport(ExchangeReport{ EXCHANGE_FILL, ref, market, ticks / EXCHANGE_TICKS_PER_POINT, quantity, left }); });
+    if (leaves == 0)
+        return;
+
+    if (order.orderType == LIMIT && book.Rest(order.clientRef, order.side, limit, leaves) != -1)
+        return;
+    onReport(ExchangeReport{ EXCHANGE_CANCEL, order.clientRef, market, 0.0, leaves, 0 });
+}
+
+/**
+ * @brief Refresh the street liquidity of a product on every venue from a snapshot.
+ *
+ * Each venue displays its share of the snapshot sizes. Own resting orders crossed by the new
+ * street prices are filled.
+ *
+ * @param productIndex The index of the product.
+ * @param bidStack The bid stack of the snapshot.
+ * @param offerStack The offer stack of the snapshot.
+ * @param onReport Called with every ExchangeReport.
+ */
+template<typename F>
+void SimulatedExchange::UpdateMarketData(int productIndex, const vector<Order>& bidStack, const vector<Order>& offerStack, F onReport)
+{
+    for (Market market : { BROKERTEC, ESPEED, CME })
+    {
+        LimitOrderBook& book = Book(productIndex, market);
+        book.RefreshStreet(bidStack, offerStack, venues[market].liquidityShare);
+        book.MatchCrossedResting([&](uint64_t ref, int64_t ticks, long quantity, long left)
+            { onReport(ExchangeReport{ EXCHANGE_FILL, ref, market, ticks / EXCHANGE_TICKS_PER_POINT, quantity, left }); });
+    }
+}
+
+#endif
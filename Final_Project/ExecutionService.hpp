@@ -2,16 +2,42 @@
 #define EXECUTION_SERVICE_HPP
 
 #include <string>
-#include <map>
+#include <cstdint>
+#include <stdexcept>
 #include "SOA.hpp"
+#include "SlabTable.hpp"
+#include "CompactId.hpp"
+#include "FlatHashMap.hpp"
+#include "ProductIndex.hpp"
 #include "MarketDataService.hpp"
+#include "ExchangeSimulator.hpp"
 
-enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
+// States of an execution order
+enum OrderStatus { ORDER_NEW, ORDER_PARTIALLY_FILLED, ORDER_FILLED, ORDER_CANCELLED, ORDER_REJECTED };
+
+// Get the name of an order status
+string GetOrderStatusName(OrderStatus status)
+{
+    switch (status)
+    {
+    case ORDER_NEW:
+        return "NEW";
+    case ORDER_PARTIALLY_FILLED:
+        return "PARTIALLY_FILLED";
+    case ORDER_FILLED:
+        return "FILLED";
+    case ORDER_CANCELLED:
+        return "CANCELLED";
+    default:
+        return "REJECTED";
+    }
+}
 
-enum Market { BROKERTEC, ESPEED, CME };
 
 /**
  * An execution order that can be placed on an exchange.
+ * Once sent, it carries its status and fills as an execution report: the last fill and the
+ * quantity filled so far.
  * Type T is the product type.
  */
 template<typename T>
@@ -20,15 +46,15 @@ class ExecutionOrder
 public:
     // ctor for an order
     ExecutionOrder() = default;
-    ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType,
-        double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId,
+    ExecutionOrder(const T& _product, PricingSide _side, CompactId _orderId, OrderType _orderType,
+        double _price, double _visibleQuantity, double _hiddenQuantity, CompactId _parentOrderId,
         bool _isChildOrder);
 
     // Get the product
     const T& GetProduct() const;
 
     // Get the order ID
-    const string& GetOrderId() const;
+    CompactId GetOrderId() const;
 
     // Get the order type on this order
     OrderType GetOrderType() const;
@@ -43,53 +69,143 @@ public:
     double GetHiddenQuantity() const;
 
     // Get the parent order ID
-    const string& GetParentOrderId() const;
+    CompactId GetParentOrderId() const;
 
     // Is child order?
     bool IsChildOrder() const;
 
     // get pricing side
     PricingSide GetPricingSide() const;
-    
+
+    // Get the price of the last fill
+    double GetLastFillPrice() const;
+
+    // Get the quantity of the last fill
+    double GetLastFillQuantity() const;
+
+    // Get the number of fills so far
+    int GetFillCount() const;
+
+    // Record a fill on this order
+    void AddFill(double price, double quantity);
+
+    // Get the venue the order is routed to
+    Market GetMarket() const;
+
+    // Route the order to a venue
+    void SetMarket(Market _market);
+
+    // Get the status of the order
+    OrderStatus GetStatus() const;
+
+    // Move the order to a new status
+    void SetStatus(OrderStatus _status);
+
+    // Get the quantity filled so far
+    double GetFilledQuantity() const;
+
+    // Get the visible quantity not filled yet
+    double GetLeavesQuantity() const;
+
+    // Is the order filled, cancelled or rejected?
+    bool IsTerminal() const;
+
+    // Get the handle of the order in the execution service, 0 before it is sent
+    uint64_t GetOrderHandle() const;
+
+    // Set the handle of the order in the execution service
+    void SetOrderHandle(uint64_t _orderHandle);
+
+
 private:
     T product;
     PricingSide side;
-    string orderId;
+    CompactId orderId;
     OrderType orderType;
     double price;
     double visibleQuantity;
     double hiddenQuantity;
-    string parentOrderId;
+    CompactId parentOrderId;
     bool isChildOrder;
+    double lastFillPrice = 0;
+    double lastFillQuantity = 0;
+    int fillCount = 0;
+    double filledQuantity = 0;
+    Market market = CME;
+    OrderStatus status = ORDER_NEW;
+    uint64_t orderHandle = 0;
 };
 
 
 /**
  * Service for executing orders on an exchange.
- * Keyed on product identifier.
+ * Orders are sent to a simulated venue per product and market and kept in a slab order table
+ * until they are filled, cancelled or rejected. Listeners get ProcessAdd when an order is
+ * sent and ProcessUpdate on every change of status, with the fill recorded on the order.
+ * Keyed on order identifier; orders are also addressed by their 64-bit handle, which is the
+ * client reference sent to the exchange.
  * Type T is the product type.
  */
 template<typename T>
-class ExecutionService : public Service<string, ExecutionOrder <T> >
+class ExecutionService : public Service<CompactId, ExecutionOrder <T> >
 {
 private:
-    map<string, ExecutionOrder<T>> execution_orders;
+    SimulatedExchange exchange;
+    SlabTable<ExecutionOrder<T>> order_table;           // live orders by handle
+    FlatHashMap<uint64_t> order_handles;                // live orders by order id, latest venue leg
+    uint64_t tick_interval;
+    long ack_count;
+    long fill_count;
+    long cancel_count;
+    long reject_count;
+
+    // Handle a report from the simulated exchange
+    void OnReport(const ExchangeReport& report);
+
+    // Notify listeners of a change of status of an order
+    void NotifyUpdate(ExecutionOrder<T>& order);
+
+    // Drop a filled, cancelled or rejected order from the order table
+    void Release(uint64_t handle, const ExecutionOrder<T>& order);
 
 public:
+    // ctor
+    ExecutionService(uint64_t _tickIntervalMicros = 1000);
+
     // Get data on our service given a key
-    ExecutionOrder<T>& GetData(string key);
+    ExecutionOrder<T>& GetData(CompactId key);
 
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(ExecutionOrder<T>& data);
 
     // Execute an order on a market
     void ExecuteOrder(ExecutionOrder<T>& order, Market market);
-    
+
+    // Cancel the resting remainder of an order, returns false if it is no longer live
+    bool CancelOrder(uint64_t handle);
+
+    // Get a live order by handle, or nullptr once it is filled, cancelled or rejected
+    ExecutionOrder<T>* GetOrder(uint64_t handle);
+
+    // Feed a market data snapshot to the venues and advance the simulated time
+    void OnMarketData(const OrderBook<T>& book);
+
+    // Deliver every order still travelling to its venue, at the end of a run
+    void Flush();
+
+    // Get the simulated exchange
+    SimulatedExchange& GetExchange();
+
+    // Get the number of acks, fills, cancels and rejects received
+    long GetAckCount() const;
+    long GetFillCount() const;
+    long GetCancelCount() const;
+    long GetRejectCount() const;
 };
 
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
+ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, CompactId _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, CompactId _parentOrderId, bool _isChildOrder) :
     product(_product)
 {
     side = _side;
@@ -109,7 +225,7 @@ const T& ExecutionOrder<T>::GetProduct() const
     return product;
 }
 template<typename T>
-const string& ExecutionOrder<T>::GetOrderId() const
+CompactId ExecutionOrder<T>::GetOrderId() const
 {
     return orderId;
 }
@@ -139,7 +255,7 @@ double ExecutionOrder<T>::GetHiddenQuantity() const
 }
 
 template<typename T>
-const string& ExecutionOrder<T>::GetParentOrderId() const
+CompactId ExecutionOrder<T>::GetParentOrderId() const
 {
     return parentOrderId;
 }
@@ -156,24 +272,287 @@ PricingSide ExecutionOrder<T>::GetPricingSide() const
     return side;
 }
 
+template <typename T>
+double ExecutionOrder<T>::GetLastFillPrice() const
+{
+    return lastFillPrice;
+}
 
 template <typename T>
-ExecutionOrder<T>& ExecutionService<T>::GetData(string key)
+double ExecutionOrder<T>::GetLastFillQuantity() const
 {
-    return execution_orders[key];
+    return lastFillQuantity;
+}
+
+template <typename T>
+int ExecutionOrder<T>::GetFillCount() const
+{
+    return fillCount;
+}
+
+template <typename T>
+void ExecutionOrder<T>::AddFill(double price, double quantity)
+{
+    lastFillPrice = price;
+    lastFillQuantity = quantity;
+    filledQuantity += quantity;
+    ++fillCount;
+}
+
+template <typename T>
+OrderStatus ExecutionOrder<T>::GetStatus() const
+{
+    return status;
+}
+
+template <typename T>
+void ExecutionOrder<T>::SetStatus(OrderStatus _status)
+{
+    status = _status;
+}
+
+template <typename T>
+double ExecutionOrder<T>::GetFilledQuantity() const
+{
+    return filledQuantity;
+}
+
+template <typename T>
+double ExecutionOrder<T>::GetLeavesQuantity() const
+{
+    return visibleQuantity - filledQuantity;
+}
+
+template <typename T>
+bool ExecutionOrder<T>::IsTerminal() const
+{
+    return status == ORDER_FILLED || status == ORDER_CANCELLED || status == ORDER_REJECTED;
+}
+
+template <typename T>
+uint64_t ExecutionOrder<T>::GetOrderHandle() const
+{
+    return orderHandle;
+}
+
+template <typename T>
+void ExecutionOrder<T>::SetOrderHandle(uint64_t _orderHandle)
+{
+    orderHandle = _orderHandle;
+}
+
+template <typename T>
+Market ExecutionOrder<T>::GetMarket() const
+{
+    return market;
+}
+
+template <typename T>
+void ExecutionOrder<T>::SetMarket(Market _market)
+{
+    market = _market;
+}
+
+
+/**
+ * @brief Construct the execution service.
+ *
+ * @tparam T The type of the product.
+ * @param _tickIntervalMicros The simulated time between two market data snapshots.
+ */
+template <typename T>
+ExecutionService<T>::ExecutionService(uint64_t _tickIntervalMicros) :
+    tick_interval(_tickIntervalMicros), ack_count(0), fill_count(0), cancel_count(0), reject_count(0)
+{
+}
+
+
+/**
+ * @brief Get a live order by order identifier.
+ *
+ * @throws out_of_range if no order with this identifier is live.
+ */
+template <typename T>
+ExecutionOrder<T>& ExecutionService<T>::GetData(CompactId key)
+{
+    uint64_t* handle = order_handles.Find(key);
+    ExecutionOrder<T>* order = handle == nullptr ? nullptr : order_table.Find(*handle);
+    if (order == nullptr)
+        throw out_of_range("No live execution order " + IdToString(key));
+    return *order;
 }
 
 template <typename T>
 void ExecutionService<T>::OnMessage(ExecutionOrder<T>& data)
 {
-    execution_orders[data.GetProduct().GetProductId()] = data;
+    ExecuteOrder(data, data.GetMarket());
 }
 
+/**
+ * @brief Execute an order on a market.
+ *
+ * The order enters the order table as NEW, listeners get ProcessAdd, and it is sent to the
+ * simulated venue of its product on the given market with its handle as client reference.
+ * Only the visible quantity is shown to the venue.
+ *
+ * @tparam T The type of the product.
+ * @param order The order to execute.
+ * @param market The venue to execute it on.
+ */
 template <typename T>
 void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& order, Market market)
 {
-    execution_orders[order.GetProduct().GetProductId()] = order;
-    Service<string, ExecutionOrder <T> >::Notify(order);
+    uint64_t handle = order_table.Insert(order);
+    ExecutionOrder<T>& live = *order_table.Find(handle);
+    live.SetMarket(market);
+    live.SetStatus(ORDER_NEW);
+    live.SetOrderHandle(handle);
+    order_handles[live.GetOrderId()] = handle;
+
+    Service<CompactId, ExecutionOrder <T> >::Notify(live);
+    exchange.Submit(handle, GetProductIndex(live.GetProduct().GetProductId()), market, live.GetPricingSide(),
+        live.GetOrderType(), live.GetPrice(), lround(live.GetVisibleQuantity()));
+}
+
+/**
+ * @brief Cancel the resting remainder of an order.
+ *
+ * The cancel is sent to the venue of the order; the order moves to CANCELLED when it arrives,
+ * unless it has been filled in the meantime.
+ *
+ * @tparam T The type of the product.
+ * @param handle The handle of the order.
+ * @return false if the order is already filled, cancelled or rejected.
+ */
+template <typename T>
+bool ExecutionService<T>::CancelOrder(uint64_t handle)
+{
+    ExecutionOrder<T>* order = order_table.Find(handle);
+    if (order == nullptr)
+        return false;
+    exchange.Cancel(handle, GetProductIndex(order->GetProduct().GetProductId()), order->GetMarket(),
+        order->GetPricingSide(), order->GetPrice());
+    return true;
+}
+
+template <typename T>
+ExecutionOrder<T>* ExecutionService<T>::GetOrder(uint64_t handle)
+{
+    return order_table.Find(handle);
+}
+
+/**
+ * @brief Feed a market data snapshot to the venues and advance the simulated time.
+ *
+ * Orders arriving before this snapshot are matched first, against the books they would have
+ * found, then the venues of the product are refreshed with the snapshot.
+ *
+ * @tparam T The type of the product.
+ * @param book The market data snapshot.
+ */
+template <typename T>
+void ExecutionService<T>::OnMarketData(const OrderBook<T>& book)
+{
+    auto on_report = [this](const ExchangeReport& report) { OnReport(report); };
+    exchange.AdvanceTo(exchange.GetTime() + tick_interval, on_report);
+    exchange.UpdateMarketData(GetProductIndex(book.GetProduct().GetProductId()), book.GetBidStack(), book.GetOfferStack(), on_report);
+}
+
+template <typename T>
+void ExecutionService<T>::Flush()
+{
+    exchange.AdvanceTo(exchange.GetTime() + tick_interval, [this](const ExchangeReport& report) { OnReport(report); });
+}
+
+/**
+ * @brief Handle a report from the simulated exchange.
+ *
+ * The order is found from the client reference in the order table. Fills move it to
+ * PARTIALLY_FILLED or FILLED, cancels to CANCELLED and rejects to REJECTED; listeners get
+ * ProcessUpdate on each transition, and filled, cancelled or rejected orders are dropped.
+ * Acks and cancel rejects leave the order as it was.
+ *
+ * @tparam T The type of the product.
+ * @param report The exchange report.
+ */
+template <typename T>
+void ExecutionService<T>::OnReport(const ExchangeReport& report)
+{
+    ExecutionOrder<T>* order = order_table.Find(report.clientRef);
+    if (order == nullptr)
+        return;
+
+    switch (report.type)
+    {
+    case EXCHANGE_ACK:
+        ++ack_count;
+        return;
+    case EXCHANGE_FILL:
+        ++fill_count;
+        order->AddFill(report.price, report.quantity);
+        order->SetStatus(report.leavesQuantity == 0 ? ORDER_FILLED : ORDER_PARTIALLY_FILLED);
+        break;
+    case EXCHANGE_CANCEL:
+        ++cancel_count;
+        order->SetStatus(ORDER_CANCELLED);
+        break;
+    case EXCHANGE_REJECT:
+        ++reject_count;
+        order->SetStatus(ORDER_REJECTED);
+        break;
+    case EXCHANGE_CANCEL_REJECT:
+        return;
+    }
+
+    NotifyUpdate(*order);
+    if (order->IsTerminal())
+        Release(report.clientRef, *order);
+}
+
+template <typename T>
+void ExecutionService<T>::NotifyUpdate(ExecutionOrder<T>& order)
+{
+    for (auto& listener : Service<CompactId, ExecutionOrder <T> >::GetListeners())
+        listener->ProcessUpdate(order);
+}
+
+template <typename T>
+void ExecutionService<T>::Release(uint64_t handle, const ExecutionOrder<T>& order)
+{
+    uint64_t* latest = order_handles.Find(order.GetOrderId());
+    if (latest != nullptr && *latest == handle)
+        order_handles.Erase(order.GetOrderId());
+    order_table.Erase(handle);
+}
+
+template <typename T>
+SimulatedExchange& ExecutionService<T>::GetExchange()
+{
+    return exchange;
+}
+
+template <typename T>
+long ExecutionService<T>::GetAckCount() const
+{
+    return ack_count;
+}
+
+template <typename T>
+long ExecutionService<T>::GetFillCount() const
+{
+    return fill_count;
+}
+
+template <typename T>
+long ExecutionService<T>::GetCancelCount() const
+{
+    return cancel_count;
+}
+
+template <typename T>
+long ExecutionService<T>::GetRejectCount() const
+{
+    return reject_count;
 }
 
 #endif
@@ -0,0 +1,288 @@
+/**
+ * @file HedgeService.hpp
+ * @brief Header file for the HedgeService class template.
+ *
+ * This file contains the definition and implementation of the service that sizes hedges in
+ * the benchmark bonds against bucketed or key-rate risk and works them as parent orders.
+ */
+
+#ifndef HEDGE_SERVICE_HPP
+#define HEDGE_SERVICE_HPP
+
+#include <map>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "Throttle.hpp"
+#include "CompactId.hpp"
+#include "RiskService.hpp"
+#include "AlgoExecutionService.hpp"
+
+using namespace std;
+
+/**
+ * Hedge calculator on a stream of sector risk.
+ * Each risk factor is a sector of the stream, a bucketed sector of the risk service or a tenor
+ * of the key-rate risk service, and each hedge instrument has a fixed exposure to every factor
+ * per unit of face. The hedge is the least-squares solution of exposures times quantities
+ * equal to minus the factor risks, with a small ridge so sectors sharing instruments still
+ * solve. The normal matrix only depends on the exposures, so it is Cholesky factorized once
+ * and a new solve is one matrix-vector product and two triangular solves.
+ * Risk updates only mark the hedge stale; it is solved at most once per interval of replay
+ * time, so a replay sends the same parent orders on every run. Each instrument whose hedge
+ * is at least the minimum order size and has no parent order working gets a TWAP parent
+ * order on the algo execution service.
+ * Type T is the product type.
+ */
+template<typename T>
+class HedgeService
+{
+private:
+    vector<T> instruments;
+    map<string, int> factor_positions;          // sector name -> factor
+    vector<double> exposures;                   // factor * instrument count + instrument
+    vector<double> cholesky;                    // lower factor of the normal matrix, row-major
+    vector<double> factor_risks;
+    vector<double> hedges;                      // latest solved quantities, indexed by instrument
+    vector<CompactId> working_parents;          // parent order of each instrument, NO_ID if none
+
+    AlgoExecutionServiceBase<T>* algo;
+    double min_order_size;
+    double slice_size;
+    int slice_interval;
+
+    uint64_t hedge_interval;
+    uint64_t last_hedge;
+    bool dirty;
+    long solve_count;
+    long conflated_count;
+    long parent_order_count;
+
+    // Solve the hedge for the current factor risks
+    void Solve();
+
+    // Send parent orders for the instruments with a hedge to work
+    void SendParentOrders();
+
+public:
+    // ctor
+    HedgeService(const vector<T>& _instruments, const vector<string>& factorNames, const vector<vector<double>>& _exposures,
+        AlgoExecutionServiceBase<T>* _algo = nullptr, double _minOrderSize = 1000000, double _sliceSize = 10000000,
+        int _sliceInterval = 50, uint64_t _hedgeInterval = 100000);
+
+    // Take the latest risk of a sector, ignoring sectors that are not factors
+    void OnRisk(const PV01<BucketedSector<T>>& risk);
+
+    // Solve the hedge if the risk changed since the last solve, without sending orders
+    void Flush();
+
+    // Get the latest hedge quantity of an instrument
+    double GetHedge(int instrument) const;
+
+    // Get the risk of a factor left after the latest hedge
+    double GetResidualRisk(int factor) const;
+
+    // Get the number of hedge instruments
+    int GetInstrumentCount() const;
+
+    // Get the number of hedges solved
+    long GetSolveCount() const;
+
+    // Get the number of risk updates absorbed into a later solve
+    long GetConflatedCount() const;
+
+    // Get the number of parent orders sent
+    long GetParentOrderCount() const;
+};
+
+
+/**
+ * @brief Construct the service and factorize its normal matrix.
+ *
+ * @tparam T The type of the product.
+ * @param _instruments The hedge instruments.
+ * @param factorNames The sector name of each factor.
+ * @param _exposures The risk of one unit of face of each instrument, indexed by factor then instrument.
+ * @param _algo The algo execution service working the hedges, nullptr to only solve them.
+ * @param _minOrderSize The smallest hedge quantity worth a parent order.
+ * @param _sliceSize The largest child order of a parent order.
+ * @param _sliceInterval The number of book updates between child orders.
+ * @param _hedgeInterval The shortest replay time between two solves on new risk.
+ * @throws invalid_argument if the exposures do not match the factors and instruments, or hedge nothing.
+ */
+template <typename T>
+HedgeService<T>::HedgeService(const vector<T>& _instruments, const vector<string>& factorNames,
+    const vector<vector<double>>& _exposures, AlgoExecutionServiceBase<T>* _algo, double _minOrderSize, double _sliceSize,
+    int _sliceInterval, uint64_t _hedgeInterval) :
+    instruments(_instruments), factor_risks(factorNames.size(), 0.0), hedges(_instruments.size(), 0.0),
+    working_parents(_instruments.size(), MakeId(NO_ID, 0)), algo(_algo), min_order_size(_minOrderSize), slice_size(_sliceSize),
+    slice_interval(_sliceInterval), hedge_interval(_hedgeInterval), last_hedge(0), dirty(false), solve_count(0),
+    conflated_count(0), parent_order_count(0)
+{
+    int m = factorNames.size();
+    int n = instruments.size();
+    if (n == 0 || (int)_exposures.size() != m)
+        throw invalid_argument("A hedge needs instruments and one row of exposures per factor");
+    for (int f = 0; f < m; ++f)
+    {
+        if ((int)_exposures[f].size() != n)
+            throw invalid_argument("Factor " + factorNames[f] + " needs one exposure per instrument");
+        factor_positions[factorNames[f]] = f;
+        exposures.insert(exposures.end(), _exposures[f].begin(), _exposures[f].end());
+    }
+
+    // Normal matrix with a ridge relative to its scale
+    vector<double> normal(n * n, 0.0);
+    double trace = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+            for (int f = 0; f < m; ++f)
+                normal[i * n + j] += exposures[f * n + i] * exposures[f * n + j];
+        trace += normal[i * n + i];
+    }
+    if (trace <= 0)
+        throw invalid_argument("The instruments of a hedge have no exposure to its factors");
+    for (int i = 0; i < n; ++i)
+        normal[i * n + i] += 1e-9 * trace / n;
+
+    cholesky.assign(n * n, 0.0);
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j <= i; ++j)
+        {
+            double sum = normal[i * n + j];
+            for (int k = 0; k < j; ++k)
+                sum -= cholesky[i * n + k] * cholesky[j * n + k];
+            cholesky[i * n + j] = i == j ? sqrt(sum) : sum / cholesky[j * n + j];
+        }
+    }
+}
+
+/**
+ * @brief Solve the hedge for the current factor risks.
+ *
+ * The right-hand side is minus the exposures transposed times the risks, then the Cholesky
+ * factor is applied forward and backward.
+ *
+ * @tparam T The type of the product.
+ */
+template <typename T>
+void HedgeService<T>::Solve()
+{
+    int m = factor_risks.size();
+    int n = instruments.size();
+    for (int i = 0; i < n; ++i)
+    {
+        double sum = 0;
+        for (int f = 0; f < m; ++f)
+            sum -= exposures[f * n + i] * factor_risks[f];
+        for (int k = 0; k < i; ++k)
+            sum -= cholesky[i * n + k] * hedges[k];
+        hedges[i] = sum / cholesky[i * n + i];
+    }
+    for (int i = n - 1; i >= 0; --i)
+    {
+        double sum = hedges[i];
+        for (int k = i + 1; k < n; ++k)
+            sum -= cholesky[k * n + i] * hedges[k];
+        hedges[i] = sum / cholesky[i * n + i];
+    }
+    dirty = false;
+    ++solve_count;
+}
+
+/**
+ * @brief Send parent orders for the instruments with a hedge to work.
+ *
+ * An instrument whose last parent order is still working is left alone, since the hedge
+ * solved now does not see its unfilled quantity yet.
+ *
+ * @tparam T The type of the product.
+ */
+template <typename T>
+void HedgeService<T>::SendParentOrders()
+{
+    for (size_t i = 0; i < instruments.size(); ++i)
+    {
+        if (fabs(hedges[i]) < min_order_size)
+            continue;
+        if (GetIdSource(working_parents[i]) != NO_ID && algo->IsParentActive(working_parents[i]))
+            continue;
+        int slices = max(1, int(ceil(fabs(hedges[i]) / slice_size)));
+        working_parents[i] = algo->AddParentOrder(instruments[i], hedges[i] > 0 ? BID : OFFER, fabs(hedges[i]), TWAP,
+            slices, slice_interval);
+        ++parent_order_count;
+    }
+}
+
+template <typename T>
+void HedgeService<T>::OnRisk(const PV01<BucketedSector<T>>& risk)
+{
+    auto found = factor_positions.find(risk.GetProduct().GetName());
+    if (found == factor_positions.end())
+        return;
+    factor_risks[found->second] = risk.GetPV01() * risk.GetQuantity();
+    if (dirty)
+        ++conflated_count;
+    dirty = true;
+
+    if (g_replay_time - last_hedge >= hedge_interval)
+    {
+        last_hedge = g_replay_time;
+        Solve();
+        if (algo != nullptr)
+            SendParentOrders();
+    }
+}
+
+template <typename T>
+void HedgeService<T>::Flush()
+{
+    if (dirty)
+        Solve();
+}
+
+template <typename T>
+double HedgeService<T>::GetHedge(int instrument) const
+{
+    return hedges[instrument];
+}
+
+template <typename T>
+double HedgeService<T>::GetResidualRisk(int factor) const
+{
+    int n = instruments.size();
+    double residual = factor_risks[factor];
+    for (int i = 0; i < n; ++i)
+        residual += exposures[factor * n + i] * hedges[i];
+    return residual;
+}
+
+template <typename T>
+int HedgeService<T>::GetInstrumentCount() const
+{
+    return instruments.size();
+}
+
+template <typename T>
+long HedgeService<T>::GetSolveCount() const
+{
+    return solve_count;
+}
+
+template <typename T>
+long HedgeService<T>::GetConflatedCount() const
+{
+    return conflated_count;
+}
+
+template <typename T>
+long HedgeService<T>::GetParentOrderCount() const
+{
+    return parent_order_count;
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define HISTORICAL_DATA_SERVICE_HPP
 
 #include <string>
+#include <stdexcept>
 #include "SOA.hpp"
 #include "Products.hpp"
 #include "Connectors.hpp"
@@ -10,6 +11,8 @@
 #include "StreamingService.hpp"
 #include "InquiryService.hpp"
 #include "ExecutionService.hpp"
+#include "PnLService.hpp"
+#include "RiskHierarchy.hpp"
 
 /**
  * @class HistoricalDataService
@@ -26,11 +29,10 @@ class HistoricalDataService : Service<string, T>
 public:
     HistoricalDataService() = default;
 
-    // Get data on our service given a key
+    // Get data on our service given a key; the data only lives in the store, so this throws out_of_range
     virtual T& GetData(string key)
     {
-        T tmp;
-        return tmp;
+        throw out_of_range("Historical data is kept in its store, not by the service: " + key);
     }
 
     // The callback that a Connector should invoke for any new or updated data
@@ -85,6 +87,51 @@ public:
 };
 
 
+template <typename V>
+class HistoricalBucketedRiskConnector;
+
+// Historical sector risk, persisted by connector type C: the bucketed risk by default, or the key-rate risk
+template<typename V, typename C = HistoricalBucketedRiskConnector<V> >
+class HistoricalBucketedRiskService : HistoricalDataService<PV01<BucketedSector<V> > >
+{
+private:
+    C* connector;
+
+public:
+    // ctor
+    HistoricalBucketedRiskService() = default;
+    HistoricalBucketedRiskService(C* _connector) : connector(_connector) {}
+
+    // Persist data to a store
+    void PersistData(string persistKey, PV01<BucketedSector<V> >& data) override
+    {
+        connector->Publish(data);
+    }
+};
+
+
+template <typename V>
+class HistoricalAggregateRiskConnector;
+
+template<typename V>
+class HistoricalAggregateRiskService : HistoricalDataService<AggregateRisk>
+{
+private:
+    HistoricalAggregateRiskConnector<V>* connector;
+
+public:
+    // ctor
+    HistoricalAggregateRiskService() = default;
+    HistoricalAggregateRiskService(HistoricalAggregateRiskConnector<V>* _connector) : connector(_connector) {}
+
+    // Persist data to a store
+    void PersistData(string persistKey, AggregateRisk& data) override
+    {
+        connector->Publish(data);
+    }
+};
+
+
 template <typename V>
 class HistoricalStreamingConnector;
 
@@ -150,4 +197,25 @@ public:
     }
 };
 
+template <typename V>
+class HistoricalPnLConnector;
+
+template<typename V>
+class HistoricalPnLService : HistoricalDataService<PnL<V> >
+{
+private:
+    HistoricalPnLConnector<V>* connector;
+
+public:
+    // ctor
+    HistoricalPnLService() = default;
+    HistoricalPnLService(HistoricalPnLConnector<V>* _connector) : connector(_connector) {}
+
+    // Persist data to a store
+    void PersistData(string persistKey, PnL<V>& data) override
+    {
+        connector->Publish(data);
+    }
+};
+
 #endif
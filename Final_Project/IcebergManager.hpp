@@ -0,0 +1,258 @@
+/**
+ * @file IcebergManager.hpp
+ * @brief Header file for the IcebergManager class template.
+ *
+ * This file contains the definition and implementation of the manager that works execution
+ * orders with a hidden quantity as icebergs, showing one visible slice at a time and posting
+ * the next slice from the hidden reserve once the current one is done.
+ */
+
+#ifndef ICEBERG_MANAGER_HPP
+#define ICEBERG_MANAGER_HPP
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include "SOA.hpp"
+#include "CompactId.hpp"
+#include "FlatHashMap.hpp"
+#include "ExecutionService.hpp"
+
+using namespace std;
+
+/**
+ * An order worked as an iceberg.
+ * Lives in a flat pool; free slots are chained through nextFree.
+ * Type T is the product type.
+ */
+template<typename T>
+struct IcebergOrder
+{
+    ExecutionOrder<T> order;        // the order as received, the template of its slices
+    double displayQuantity;         // visible quantity of the order, the average slice
+    double reserveQuantity;         // quantity not posted yet
+    double outstandingQuantity;     // quantity of the current slice still live at the venues
+    double sliceFilledQuantity;
+    double filledQuantity;
+    int slicesPosted;
+    bool active;
+    int nextFree;
+};
+
+
+/**
+ * Iceberg manager between the algo execution service and the router.
+ * Orders without hidden quantity pass through. Orders with one are kept in a flat pool and
+ * posted one visible slice at a time: when every venue leg of a slice is done and it got
+ * fills, the next slice is drawn from the hidden reserve with a randomized size, so the
+ * refresh does not reveal the displayed size. A slice with no fill at all ends the iceberg.
+ * Keyed on order identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class IcebergManager : public Service<CompactId, ExecutionOrder<T> >
+{
+private:
+    vector<IcebergOrder<T>> icebergs;
+    int free_iceberg;
+    FlatHashMap<int> iceberg_slots;         // order id -> pool slot of the live icebergs
+    double size_jitter;
+    double lot_size;
+    uint64_t rng_state;
+    long refresh_count;
+
+    // Post the next slice of an iceberg
+    void PostSlice(int slot);
+
+    // Draw a uniform number in [0, 1)
+    double NextUniform();
+
+public:
+    // ctor
+    IcebergManager(double _sizeJitter = 0.2, double _lotSize = 1000, uint64_t _seed = 0x9E3779B97F4A7C15ULL);
+
+    // Get data on our service given a key
+    ExecutionOrder<T>& GetData(CompactId key);
+
+    // The callback that a Connector should invoke for any new or updated data
+    void OnMessage(ExecutionOrder<T>& data);
+
+    // Accept an order, working it as an iceberg if it has hidden quantity
+    void Submit(const ExecutionOrder<T>& order);
+
+    // Track a fill or the end of a venue leg of a slice
+    void OnExecution(const ExecutionOrder<T>& order);
+
+    // Get the number of live icebergs
+    int GetLiveCount() const;
+
+    // Get the number of slices posted from hidden reserves
+    long GetRefreshCount() const;
+};
+
+
+template <typename T>
+IcebergManager<T>::IcebergManager(double _sizeJitter, double _lotSize, uint64_t _seed) :
+    free_iceberg(-1), size_jitter(_sizeJitter), lot_size(_lotSize), rng_state(_seed ? _seed : 1), refresh_count(0)
+{
+}
+
+template <typename T>
+ExecutionOrder<T>& IcebergManager<T>::GetData(CompactId key)
+{
+    int* slot = iceberg_slots.Find(key);
+    if (slot == nullptr)
+        throw out_of_range("No live iceberg " + IdToString(key));
+    return icebergs[*slot].order;
+}
+
+template <typename T>
+void IcebergManager<T>::OnMessage(ExecutionOrder<T>& data)
+{
+    Submit(data);
+}
+
+template <typename T>
+double IcebergManager<T>::NextUniform()
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Accept an order, working it as an iceberg if it has hidden quantity.
+ *
+ * The iceberg takes a slot in the flat pool with the whole visible and hidden quantity in
+ * reserve, and its first slice is posted at once.
+ *
+ * @tparam T The type of the product.
+ * @param order The order to work.
+ */
+template <typename T>
+void IcebergManager<T>::Submit(const ExecutionOrder<T>& order)
+{
+    if (order.GetHiddenQuantity() <= 0 || order.GetVisibleQuantity() <= 0)
+    {
+        ExecutionOrder<T> passed = order;
+        Service<CompactId, ExecutionOrder<T> >::Notify(passed);
+        return;
+    }
+
+    int slot = free_iceberg;
+    if (slot == -1)
+    {
+        slot = icebergs.size();
+        icebergs.emplace_back();
+    }
+    else
+    {
+        free_iceberg = icebergs[slot].nextFree;
+    }
+
+    IcebergOrder<T>& iceberg = icebergs[slot];
+    iceberg.order = order;
+    iceberg.displayQuantity = order.GetVisibleQuantity();
+    iceberg.reserveQuantity = order.GetVisibleQuantity() + order.GetHiddenQuantity();
+    iceberg.outstandingQuantity = 0;
+    iceberg.sliceFilledQuantity = 0;
+    iceberg.filledQuantity = 0;
+    iceberg.slicesPosted = 0;
+    iceberg.active = true;
+    iceberg.nextFree = -1;
+    iceberg_slots[order.GetOrderId()] = slot;
+    PostSlice(slot);
+}
+
+/**
+ * @brief Post the next slice of an iceberg.
+ *
+ * The first slice shows the visible quantity of the order. Later slices vary it uniformly by
+ * the size jitter either way, in whole lots, and the last one takes what is left.
+ *
+ * @tparam T The type of the product.
+ * @param slot The pool slot of the iceberg.
+ */
+template <typename T>
+void IcebergManager<T>::PostSlice(int slot)
+{
+    IcebergOrder<T>& iceberg = icebergs[slot];
+    double quantity = iceberg.displayQuantity;
+    if (iceberg.slicesPosted > 0)
+    {
+        quantity *= 1.0 + size_jitter * (2.0 * NextUniform() - 1.0);
+        quantity = max(lot_size, round(quantity / lot_size) * lot_size);
+        ++refresh_count;
+    }
+    if (quantity >= iceberg.reserveQuantity - lot_size / 2)
+        quantity = iceberg.reserveQuantity;
+
+    iceberg.reserveQuantity -= quantity;
+    iceberg.outstandingQuantity = quantity;
+    iceberg.sliceFilledQuantity = 0;
+    ++iceberg.slicesPosted;
+
+    const ExecutionOrder<T>& order = iceberg.order;
+    ExecutionOrder<T> slice(order.GetProduct(), order.GetPricingSide(), order.GetOrderId(), order.GetOrderType(),
+        order.GetPrice(), quantity, iceberg.reserveQuantity, order.GetParentOrderId(), order.IsChildOrder());
+    slice.SetMarket(order.GetMarket());
+    Service<CompactId, ExecutionOrder<T> >::Notify(slice);
+}
+
+/**
+ * @brief Track a fill or the end of a venue leg of a slice.
+ *
+ * Fills are added to the slice and the iceberg. Once the legs of the slice are all filled,
+ * cancelled or rejected, the next slice is posted if the slice got fills and reserve is left;
+ * otherwise the iceberg ends and its slot returns to the pool.
+ *
+ * @tparam T The type of the product.
+ * @param order The execution order whose status changed.
+ */
+template <typename T>
+void IcebergManager<T>::OnExecution(const ExecutionOrder<T>& order)
+{
+    int* found = iceberg_slots.Find(GetLegOrderId(order.GetOrderId()));
+    if (found == nullptr)
+        return;
+
+    int slot = *found;
+    IcebergOrder<T>& iceberg = icebergs[slot];
+    if (order.GetStatus() == ORDER_PARTIALLY_FILLED || order.GetStatus() == ORDER_FILLED)
+    {
+        iceberg.sliceFilledQuantity += order.GetLastFillQuantity();
+        iceberg.filledQuantity += order.GetLastFillQuantity();
+    }
+    if (order.IsTerminal())
+        iceberg.outstandingQuantity -= order.GetVisibleQuantity();
+    if (iceberg.outstandingQuantity > 1e-6)
+        return;
+
+    if (iceberg.sliceFilledQuantity > 0 && iceberg.reserveQuantity > 1e-6)
+    {
+        PostSlice(slot);
+        return;
+    }
+    iceberg_slots.Erase(GetLegOrderId(order.GetOrderId()));
+    iceberg.active = false;
+    iceberg.nextFree = free_iceberg;
+    free_iceberg = slot;
+}
+
+template <typename T>
+int IcebergManager<T>::GetLiveCount() const
+{
+    return iceberg_slots.GetSize();
+}
+
+template <typename T>
+long IcebergManager<T>::GetRefreshCount() const
+{
+    return refresh_count;
+}
+
+#endif
@@ -1,9 +1,10 @@
 #ifndef INQUIRY_SERVICE_HPP
 #define INQUIRY_SERVICE_HPP
 
-#include <map>
 #include <string>
 #include "SOA.hpp"
+#include "CompactId.hpp"
+#include "FlatHashMap.hpp"
 #include "TradeBookingService.hpp"
 
  // Various inqyury states
@@ -19,11 +20,11 @@ class Inquiry
 public:
     // ctor
     Inquiry() = default;
-    Inquiry(string _inquiryId, const T& _product, Side _side, long _quantity, 
+    Inquiry(CompactId _inquiryId, const T& _product, Side _side, long _quantity, 
         double _price, InquiryState _state);
 
     // Get the inquiry ID
-    const string& GetInquiryId() const;
+    CompactId GetInquiryId() const;
 
     // Get the product
     const T& GetProduct() const;
@@ -47,7 +48,7 @@ public:
     void SetPrice(double _price);
     
 private:
-    string inquiryId;
+    CompactId inquiryId;
     T product;
     Side side;
     long quantity;
@@ -63,23 +64,23 @@ private:
  * Type T is the product type.
  */
 template<typename T>
-class InquiryService : public Service<string, Inquiry <T> >
+class InquiryService : public Service<CompactId, Inquiry <T> >
 {
 private:
-    map<string, Inquiry<T>> inquiries;
+    FlatHashMap<Inquiry<T>> inquiries;
 
 public:
     // Get data on our service given a key
-    Inquiry<T>& GetData(string key);
+    Inquiry<T>& GetData(CompactId key);
 
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Inquiry<T>& data);
 
     // Send a quote back to the client
-    void SendQuote(const string& inquiryId, double price);
+    void SendQuote(CompactId inquiryId, double price);
 
     // Reject an inquiry from the client
-    void RejectInquiry(const string& inquiryId);
+    void RejectInquiry(CompactId inquiryId);
     
 };
 
@@ -96,7 +97,7 @@ public:
  * @param _state The state of the inquiry.
  */
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T& _product, Side _side, long _quantity, double _price, InquiryState _state) :
+Inquiry<T>::Inquiry(CompactId _inquiryId, const T& _product, Side _side, long _quantity, double _price, InquiryState _state) :
     product(_product)
 {
     inquiryId = _inquiryId;
@@ -107,7 +108,7 @@ Inquiry<T>::Inquiry(string _inquiryId, const T& _product, Side _side, long _quan
 }
 
 template<typename T>
-const string& Inquiry<T>::GetInquiryId() const
+CompactId Inquiry<T>::GetInquiryId() const
 {
     return inquiryId;
 }
@@ -157,7 +158,7 @@ void Inquiry<T>::SetPrice(double _price)
 
 
 template <typename T>
-Inquiry<T>& InquiryService<T>::GetData(string key)
+Inquiry<T>& InquiryService<T>::GetData(CompactId key)
 {
     return inquiries[key];
 }
@@ -179,14 +180,14 @@ void InquiryService<T>::OnMessage(Inquiry<T>& data)
     inquiries[data.GetInquiryId()] = data;
     if (data.GetState() == RECEIVED)
     {
-        string inquiryId = data.GetInquiryId();
+        CompactId inquiryId = data.GetInquiryId();
         this->SendQuote(inquiryId, 100.0);
-        Service<string, Inquiry<T> >::Notify(data);
+        Service<CompactId, Inquiry<T> >::Notify(data);
     }
     else if (data.GetState() == QUOTED)
     {
         data.SetState(DONE);
-        Service<string, Inquiry<T> >::Notify(data);
+        Service<CompactId, Inquiry<T> >::Notify(data);
     }
 }
 
@@ -198,7 +199,7 @@ void InquiryService<T>::OnMessage(Inquiry<T>& data)
  * @param price The price to be set for the inquiry.
  */
 template <typename T>
-void InquiryService<T>::SendQuote(const string& inquiryId, double price)
+void InquiryService<T>::SendQuote(CompactId inquiryId, double price)
 {
     inquiries[inquiryId].SetPrice(price);
 }
@@ -210,7 +211,7 @@ void InquiryService<T>::SendQuote(const string& inquiryId, double price)
  * @param inquiryId The ID of the inquiry to be rejected.
  */
 template <typename T>
-void InquiryService<T>::RejectInquiry(const string& inquiryId)
+void InquiryService<T>::RejectInquiry(CompactId inquiryId)
 {
     inquiries[inquiryId].SetState(REJECTED);
 }
@@ -0,0 +1,324 @@
+/**
+ * @file KeyRateRiskService.hpp
+ * @brief Header file for the KeyRateRiskService class template.
+ *
+ * This file contains the definition and implementation of the service that keeps the
+ * key-rate PV01 of the portfolio at the pillars of the treasury curve.
+ */
+
+#ifndef KEY_RATE_RISK_SERVICE_HPP
+#define KEY_RATE_RISK_SERVICE_HPP
+
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "SOA.hpp"
+#include "Throttle.hpp"
+#include "ProductIndex.hpp"
+#include "CurveService.hpp"
+#include "RiskService.hpp"
+
+using namespace std;
+
+// Key rate tenors, one per curve pillar
+const array<string, CURVE_PILLARS> KEY_RATE_TENORS = { "2Y", "3Y", "5Y", "7Y", "10Y", "20Y", "30Y" };
+
+/**
+ * Key-rate PV01 risk of the portfolio at the curve pillars.
+ * Each product's cash flows are generated once from its coupon and maturity, and every flow
+ * spreads its rate sensitivity over the two pillars it interpolates between. The key-rate
+ * PV01s of one unit of each product are cached, in price points per basis point like the
+ * single PV01s of the risk service, so a position change only moves the tenor risks by the
+ * change in quantity times one cached vector. A new curve marks the cached vectors stale;
+ * they are recomputed at most once per publish interval of replay time, along with
+ * publishing the tenors whose risk changed as a PV01 of a sector named after the tenor. The
+ * tenor sectors are built once and grow by one product when a product is first seen. Flush
+ * publishes the rest.
+ * Keyed on tenor.
+ * Type T is the product type.
+ */
+template<typename T>
+class KeyRateRiskService : public Service<string, PV01<BucketedSector<T>>>
+{
+private:
+    ZeroCurve curve;
+    vector<int> product_slots;                          // product index -> slot, -1 if none
+    vector<T> products;                                 // indexed by slot
+    vector<vector<CurveCashFlow>> cash_flows;           // indexed by slot
+    vector<array<double, CURVE_PILLARS>> key_rates;     // key-rate PV01s of one unit, indexed by slot
+    vector<double> quantities;                          // indexed by slot
+    vector<PV01<BucketedSector<T>>> tenor_pv01s;        // sector of every product per tenor, reused by each publish
+    array<double, CURVE_PILLARS> tenor_risks{};
+    array<char, CURVE_PILLARS> tenor_dirty{};
+
+    uint64_t publish_interval;
+    uint64_t last_publish;
+    bool curve_dirty;
+    long published_count;
+    long conflated_count;
+
+    // Get the slot of a product, adding it if new
+    int GetSlot(const T& product);
+
+    // Compute the key-rate PV01s of one unit of a slot on the current curve
+    void ComputeKeyRates(int slot);
+
+    // Recompute every cached vector and the tenor risks on the current curve
+    void Recompute();
+
+    // Mark a tenor changed since its last publish
+    void Touch(int tenor);
+
+    // Publish the changed tenors once the interval has passed
+    void MaybePublish();
+
+    // Publish every changed tenor
+    void Publish();
+
+public:
+    // ctor
+    KeyRateRiskService(const ZeroCurve& _curve, uint64_t _publishInterval = 1000);
+
+    // Get the risk of a tenor
+    PV01<BucketedSector<T>>& GetData(string key);
+
+    // The callback that a Connector should invoke for any new or updated data
+    void OnMessage(PV01<BucketedSector<T>>& data);
+
+    // Update the position of a product
+    void OnPosition(const Position<T>& position);
+
+    // Take a new curve, recomputing the cached vectors by the next publish
+    void OnCurve(const ZeroCurve& newCurve);
+
+    // Recompute on a pending curve and publish every tenor changed since its last publish
+    void Flush();
+
+    // Get the key-rate PV01s of one unit of a product
+    const array<double, CURVE_PILLARS>& GetProductKeyRates(const T& product);
+
+    // Get the portfolio risk of a tenor
+    double GetTenorRisk(int tenor) const;
+
+    // Get the number of tenor updates published
+    long GetPublishedCount() const;
+
+    // Get the number of tenor changes absorbed into a later publish of the same tenor
+    long GetConflatedCount() const;
+};
+
+
+/**
+ * @brief Construct the service with no position.
+ *
+ * @tparam T The type of the product.
+ * @param _curve The starting curve.
+ * @param _publishInterval The shortest replay time between two recomputes and publishes.
+ */
+template <typename T>
+KeyRateRiskService<T>::KeyRateRiskService(const ZeroCurve& _curve, uint64_t _publishInterval) :
+    curve(_curve), publish_interval(_publishInterval), last_publish(0), curve_dirty(false),
+    published_count(0), conflated_count(0)
+{
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+        tenor_pv01s.push_back(PV01<BucketedSector<T>>(BucketedSector<T>(products, KEY_RATE_TENORS[i]), 0, 1));
+}
+
+template <typename T>
+int KeyRateRiskService<T>::GetSlot(const T& product)
+{
+    int index = GetProductIndex(product.GetProductId());
+    if (index >= (int)product_slots.size())
+        product_slots.resize(index + 1, -1);
+    if (product_slots[index] != -1)
+        return product_slots[index];
+
+    int slot = products.size();
+    product_slots[index] = slot;
+    products.push_back(product);
+    cash_flows.push_back(MakeCurveCashFlows(product.GetCoupon(), product.GetMaturityDate(), curve.GetPillarTimes()));
+    key_rates.push_back(array<double, CURVE_PILLARS>{});
+    quantities.push_back(0.0);
+    ComputeKeyRates(slot);
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+        tenor_pv01s[i].GetProduct().AddProduct(product);
+    return slot;
+}
+
+/**
+ * @brief Compute the key-rate PV01s of one unit of a slot on the current curve.
+ *
+ * A 1bp move of a pillar moves the rate of a flow by its interpolation weight on that pillar,
+ * so the flow's discounted amount times its time and weight, in basis points, goes to each of
+ * its two pillars. The key rates add up to the PV01 of a parallel shift.
+ *
+ * @tparam T The type of the product.
+ * @param slot The slot of the product.
+ */
+template <typename T>
+void KeyRateRiskService<T>::ComputeKeyRates(int slot)
+{
+    array<double, CURVE_PILLARS>& rates = key_rates[slot];
+    rates.fill(0.0);
+    const array<double, CURVE_PILLARS>& zeros = curve.GetZeroRates();
+    for (const CurveCashFlow& f : cash_flows[slot])
+    {
+        double z = f.lowWeight * zeros[f.lowPillar] + f.highWeight * zeros[f.highPillar];
+        double sensitivity = f.amount * exp(-z * f.time) * f.time * 1e-4;
+        rates[f.lowPillar] += f.lowWeight * sensitivity;
+        rates[f.highPillar] += f.highWeight * sensitivity;
+    }
+}
+
+template <typename T>
+void KeyRateRiskService<T>::Recompute()
+{
+    curve_dirty = false;
+    array<double, CURVE_PILLARS> risks{};
+    for (size_t slot = 0; slot < products.size(); ++slot)
+    {
+        ComputeKeyRates(slot);
+        for (int i = 0; i < CURVE_PILLARS; ++i)
+            risks[i] += quantities[slot] * key_rates[slot][i];
+    }
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+    {
+        if (risks[i] != tenor_risks[i])
+            Touch(i);
+        tenor_risks[i] = risks[i];
+    }
+}
+
+template <typename T>
+void KeyRateRiskService<T>::Touch(int tenor)
+{
+    if (tenor_dirty[tenor])
+        ++conflated_count;
+    else
+        tenor_dirty[tenor] = 1;
+}
+
+template <typename T>
+void KeyRateRiskService<T>::MaybePublish()
+{
+    if (g_replay_time - last_publish >= publish_interval)
+    {
+        last_publish = g_replay_time;
+        if (curve_dirty)
+            Recompute();
+        Publish();
+    }
+}
+
+template <typename T>
+void KeyRateRiskService<T>::Publish()
+{
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+    {
+        if (!tenor_dirty[i])
+            continue;
+        tenor_dirty[i] = 0;
+        tenor_pv01s[i].SetPV01(tenor_risks[i]);
+        ++published_count;
+        Service<string, PV01<BucketedSector<T>>>::Notify(tenor_pv01s[i]);
+    }
+}
+
+/**
+ * @brief Get the risk of a tenor.
+ *
+ * @tparam T The type of the product.
+ * @param key The tenor, one of KEY_RATE_TENORS.
+ * @return The PV01 of the tenor's sector at the latest positions.
+ * @throws out_of_range if the key is not a tenor.
+ */
+template <typename T>
+PV01<BucketedSector<T>>& KeyRateRiskService<T>::GetData(string key)
+{
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+    {
+        if (KEY_RATE_TENORS[i] == key)
+        {
+            tenor_pv01s[i].SetPV01(tenor_risks[i]);
+            return tenor_pv01s[i];
+        }
+    }
+    throw out_of_range("No key rate tenor " + key);
+}
+
+template <typename T>
+void KeyRateRiskService<T>::OnMessage(PV01<BucketedSector<T>>& data)
+{
+}
+
+/**
+ * @brief Update the position of a product.
+ *
+ * Each tenor moves by the change in quantity times the product's cached key rate.
+ *
+ * @tparam T The type of the product.
+ * @param position The new position of the product.
+ */
+template <typename T>
+void KeyRateRiskService<T>::OnPosition(const Position<T>& position)
+{
+    int slot = GetSlot(position.GetProduct());
+    double delta = position.GetAggregatePosition() - quantities[slot];
+    if (delta == 0)
+        return;
+    quantities[slot] += delta;
+    const array<double, CURVE_PILLARS>& rates = key_rates[slot];
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+    {
+        if (rates[i] == 0)
+            continue;
+        tenor_risks[i] += delta * rates[i];
+        Touch(i);
+    }
+    MaybePublish();
+}
+
+template <typename T>
+void KeyRateRiskService<T>::OnCurve(const ZeroCurve& newCurve)
+{
+    curve = newCurve;
+    curve_dirty = true;
+    MaybePublish();
+}
+
+template <typename T>
+void KeyRateRiskService<T>::Flush()
+{
+    if (curve_dirty)
+        Recompute();
+    Publish();
+}
+
+template <typename T>
+const array<double, CURVE_PILLARS>& KeyRateRiskService<T>::GetProductKeyRates(const T& product)
+{
+    return key_rates[GetSlot(product)];
+}
+
+template <typename T>
+double KeyRateRiskService<T>::GetTenorRisk(int tenor) const
+{
+    return tenor_risks[tenor];
+}
+
+template <typename T>
+long KeyRateRiskService<T>::GetPublishedCount() const
+{
+    return published_count;
+}
+
+template <typename T>
+long KeyRateRiskService<T>::GetConflatedCount() const
+{
+    return conflated_count;
+}
+
+#endif
@@ -0,0 +1,421 @@
+/**
+ * @file PnLService.hpp
+ * @brief Header file for the PnL and PnLService class templates.
+ *
+ * This file contains the definition and implementation of the service that keeps the
+ * realized and unrealized P&L of every product, from booked trades and pricing mids.
+ */
+
+#ifndef PNL_SERVICE_HPP
+#define PNL_SERVICE_HPP
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+#include "SOA.hpp"
+#include "Throttle.hpp"
+#include "ProductIndex.hpp"
+#include "PricingService.hpp"
+#include "TradeBookingService.hpp"
+
+using namespace std;
+
+/**
+ * P&L of a product across all books, in currency.
+ * Prices are per 100 of face value and quantities are face value.
+ * Type T is the product type.
+ */
+template<typename T>
+class PnL
+{
+public:
+    // ctor
+    PnL() = default;
+    PnL(const T& _product, double _realized, double _unrealized, double _position, double _mid,
+        const array<double, MAX_BOOKS>& _bookPnLs = {});
+
+    // Get the product
+    const T& GetProduct() const;
+
+    // Get the P&L realized by closing trades
+    double GetRealized() const;
+
+    // Get the P&L of the open position marked to the mid
+    double GetUnrealized() const;
+
+    // Get the realized plus unrealized P&L
+    double GetTotal() const;
+
+    // Get the open position
+    double GetPosition() const;
+
+    // Get the mid the position is marked to
+    double GetMid() const;
+
+    // Get the realized plus unrealized P&L of each book, indexed by book index
+    const array<double, MAX_BOOKS>& GetBookPnLs() const;
+
+private:
+    T product;
+    double realized;
+    double unrealized;
+    double position;
+    double mid;
+    array<double, MAX_BOOKS> bookPnLs;
+};
+
+
+/**
+ * P&L Service keeping average costs per product and book and marking open positions to market.
+ * Each trade updates the position and average cost of its book; a trade reducing a position
+ * realizes the difference between its price and the average cost, and one flipping it opens
+ * the rest at its own price. The open position and cost basis of a product are kept summed
+ * across books, so a mid only re-marks the product that ticked, in O(1).
+ * Updates are conflated per product: a changed product is published at most once per
+ * publish interval of replay time with its latest P&L, and Flush publishes whatever is left.
+ * Keyed on product identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class PnLService : public Service<string, PnL<T> >
+{
+private:
+    struct BookCost
+    {
+        double position = 0;
+        double averageCost = 0;
+        double realized = 0;
+    };
+
+    struct ProductState
+    {
+        T product;
+        array<BookCost, MAX_BOOKS> books;
+        double position = 0;    // summed across books
+        double cost = 0;        // position times average cost, summed across books
+        double realized = 0;
+        double unrealized = 0;
+        double mid = 0;         // 0 until the first price
+    };
+
+    vector<ProductState> states;            // indexed by product index
+    vector<PnL<T>> pnls;                    // latest P&L built for each product
+    vector<char> dirty;
+    vector<int> dirty_products;
+    uint64_t publish_interval;
+    uint64_t last_publish;
+    double total_realized;
+    double total_unrealized;
+    long published_count;
+    long conflated_count;
+
+    // Make room for the state of a product index
+    ProductState& Reserve(int productIndex, const T& product);
+
+    // Re-mark the open position of a product to its mid
+    void Mark(ProductState& state);
+
+    // Build the P&L of a product from its state
+    PnL<T> MakePnL(const ProductState& state) const;
+
+    // Queue a changed product, publishing the queue once the interval has passed
+    void Touch(int productIndex);
+
+    // Publish every queued product
+    void Publish();
+
+public:
+    // ctor
+    PnLService(uint64_t _publishInterval = 1000);
+
+    // Get data on our service given a key
+    PnL<T>& GetData(string key);
+
+    // The callback that a Connector should invoke for any new or updated data
+    void OnMessage(PnL<T>& data);
+
+    // Book a trade into the average costs
+    void AddTrade(const Trade<T>& trade);
+
+    // Mark a product to a new mid
+    void OnPrice(const Price<T>& price);
+
+    // Publish every product changed since its last publish, at the end of a run
+    void Flush();
+
+    // Get the realized P&L summed across products
+    double GetTotalRealized() const;
+
+    // Get the unrealized P&L summed across products
+    double GetTotalUnrealized() const;
+
+    // Get the number of P&L updates published
+    long GetPublishedCount() const;
+
+    // Get the number of changes absorbed into a later publish of the same product
+    long GetConflatedCount() const;
+};
+
+
+template<typename T>
+PnL<T>::PnL(const T& _product, double _realized, double _unrealized, double _position, double _mid,
+    const array<double, MAX_BOOKS>& _bookPnLs) :
+    product(_product), realized(_realized), unrealized(_unrealized), position(_position), mid(_mid), bookPnLs(_bookPnLs)
+{
+}
+
+template<typename T>
+const T& PnL<T>::GetProduct() const
+{
+    return product;
+}
+
+template<typename T>
+double PnL<T>::GetRealized() const
+{
+    return realized;
+}
+
+template<typename T>
+double PnL<T>::GetUnrealized() const
+{
+    return unrealized;
+}
+
+template<typename T>
+double PnL<T>::GetTotal() const
+{
+    return realized + unrealized;
+}
+
+template<typename T>
+double PnL<T>::GetPosition() const
+{
+    return position;
+}
+
+template<typename T>
+double PnL<T>::GetMid() const
+{
+    return mid;
+}
+
+template<typename T>
+const array<double, MAX_BOOKS>& PnL<T>::GetBookPnLs() const
+{
+    return bookPnLs;
+}
+
+
+/**
+ * @brief Construct the P&L service.
+ *
+ * @tparam T The type of the product.
+ * @param _publishInterval The shortest replay time between two publishes of the changed products.
+ */
+template <typename T>
+PnLService<T>::PnLService(uint64_t _publishInterval) :
+    publish_interval(_publishInterval), last_publish(0), total_realized(0), total_unrealized(0),
+    published_count(0), conflated_count(0)
+{
+}
+
+template <typename T>
+typename PnLService<T>::ProductState& PnLService<T>::Reserve(int productIndex, const T& product)
+{
+    if (productIndex >= (int)states.size())
+    {
+        states.resize(productIndex + 1);
+        pnls.resize(productIndex + 1);
+        dirty.resize(productIndex + 1, 0);
+    }
+    ProductState& state = states[productIndex];
+    if (state.product.GetProductId().empty())
+        state.product = product;
+    return state;
+}
+
+template <typename T>
+void PnLService<T>::Mark(ProductState& state)
+{
+    double unrealized = state.mid > 0 ? (state.position * state.mid - state.cost) / 100 : 0.0;
+    total_unrealized += unrealized - state.unrealized;
+    state.unrealized = unrealized;
+}
+
+/**
+ * @brief Build the P&L of a product from its state.
+ *
+ * Each book's P&L is what it realized plus its open position marked from its own average cost.
+ *
+ * @tparam T The type of the product.
+ * @param state The state of the product.
+ * @return The P&L of the product.
+ */
+template <typename T>
+PnL<T> PnLService<T>::MakePnL(const ProductState& state) const
+{
+    array<double, MAX_BOOKS> book_pnls{};
+    for (int b = 0; b < GetBookCount(); ++b)
+    {
+        const BookCost& book = state.books[b];
+        book_pnls[b] = book.realized + (state.mid > 0 ? book.position * (state.mid - book.averageCost) / 100 : 0.0);
+    }
+    return PnL<T>(state.product, state.realized, state.unrealized, state.position, state.mid, book_pnls);
+}
+
+template <typename T>
+void PnLService<T>::Touch(int productIndex)
+{
+    if (dirty[productIndex])
+    {
+        ++conflated_count;
+    }
+    else
+    {
+        dirty[productIndex] = 1;
+        dirty_products.push_back(productIndex);
+    }
+
+    if (g_replay_time - last_publish >= publish_interval)
+    {
+        last_publish = g_replay_time;
+        Publish();
+    }
+}
+
+template <typename T>
+void PnLService<T>::Publish()
+{
+    for (int index : dirty_products)
+    {
+        const ProductState& state = states[index];
+        dirty[index] = 0;
+        pnls[index] = MakePnL(state);
+        ++published_count;
+        Service<string, PnL<T> >::Notify(pnls[index]);
+    }
+    dirty_products.clear();
+}
+
+/**
+ * @brief Get data on our service given a key.
+ *
+ * @tparam T The type of the product.
+ * @param key The product identifier.
+ * @return The current P&L of the product.
+ * @throws out_of_range if the product has neither traded nor been priced.
+ */
+template <typename T>
+PnL<T>& PnLService<T>::GetData(string key)
+{
+    auto found = g_product_index.find(key);
+    if (found == g_product_index.end() || found->second >= (int)states.size()
+        || states[found->second].product.GetProductId().empty())
+        throw out_of_range("No P&L for product " + key);
+    const ProductState& state = states[found->second];
+    pnls[found->second] = MakePnL(state);
+    return pnls[found->second];
+}
+
+template <typename T>
+void PnLService<T>::OnMessage(PnL<T>& data)
+{
+}
+
+/**
+ * @brief Book a trade into the average cost of its book.
+ *
+ * @tparam T The type of the product.
+ * @param trade The trade.
+ */
+template <typename T>
+void PnLService<T>::AddTrade(const Trade<T>& trade)
+{
+    int index = GetProductIndex(trade.GetProduct().GetProductId());
+    ProductState& state = Reserve(index, trade.GetProduct());
+    BookCost& book = state.books[trade.GetBookIndex()];
+    double quantity = trade.GetSide() == BUY ? trade.GetQuantity() : -trade.GetQuantity();
+    double price = trade.GetPrice();
+
+    double old_cost = book.position * book.averageCost;
+    if (book.position == 0 || (book.position > 0) == (quantity > 0))
+    {
+        book.averageCost = (old_cost + quantity * price) / (book.position + quantity);
+        book.position += quantity;
+    }
+    else
+    {
+        double closed = min(abs(quantity), abs(book.position));
+        double realized = closed * (price - book.averageCost) * (book.position > 0 ? 1 : -1) / 100;
+        book.realized += realized;
+        state.realized += realized;
+        total_realized += realized;
+        book.position += quantity;
+        if (book.position == 0)
+            book.averageCost = 0;
+        else if ((book.position > 0) == (quantity > 0))
+            book.averageCost = price;
+    }
+    state.position += quantity;
+    state.cost += book.position * book.averageCost - old_cost;
+
+    Mark(state);
+    Touch(index);
+}
+
+/**
+ * @brief Mark a product to a new mid.
+ *
+ * Only the product that ticked is re-marked.
+ *
+ * @tparam T The type of the product.
+ * @param price The new price of the product.
+ */
+template <typename T>
+void PnLService<T>::OnPrice(const Price<T>& price)
+{
+    int index = GetProductIndex(price.GetProduct().GetProductId());
+    ProductState& state = Reserve(index, price.GetProduct());
+    state.mid = price.GetMid();
+    if (state.position == 0 && state.unrealized == 0)
+        return;
+    Mark(state);
+    Touch(index);
+}
+
+template <typename T>
+void PnLService<T>::Flush()
+{
+    Publish();
+}
+
+template <typename T>
+double PnLService<T>::GetTotalRealized() const
+{
+    return total_realized;
+}
+
+template <typename T>
+double PnLService<T>::GetTotalUnrealized() const
+{
+    return total_unrealized;
+}
+
+template <typename T>
+long PnLService<T>::GetPublishedCount() const
+{
+    return published_count;
+}
+
+template <typename T>
+long PnLService<T>::GetConflatedCount() const
+{
+    return conflated_count;
+}
+
+#endif
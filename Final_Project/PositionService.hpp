@@ -5,11 +5,24 @@
 
 #include <string>
 #include <map>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 #include "SOA.hpp"
+#include "ProductIndex.hpp"
 #include "TradeBookingService.hpp"
 
 using namespace std;
 
+/**
+ * Position of a product across the trading books.
+ * Books are dense indices into a fixed array, and the aggregate across books is kept up to
+ * date by every update, so reading it is O(1). The book positions are read through a view
+ * of the array; GetAllPositions copies them into a map keyed by book name.
+ * Type T is the product type.
+ */
 template<typename T>
 class Position
 {
@@ -24,22 +37,72 @@ public:
     // Get the position quantity
     double GetPosition(string& book);
 
+    // Get the position quantity of a book by its index
+    double GetPosition(int bookIndex) const;
+
+    // Get the positions of every book, indexed by book index
+    const array<double, MAX_BOOKS>& GetBookPositions() const;
+
+    // Get the number of books with a position slot, one past the highest book traded
+    int GetBookCount() const;
+
     // Return all positions
-    map<string, double> GetAllPositions();
+    map<string, double> GetAllPositions() const;
 
     // Get the aggregate position
-    double GetAggregatePosition();
+    double GetAggregatePosition() const;
 
     // Update the position
     void UpdatePosition(string& book, double quantity, Side side);
 
+    // Update the position of a book by its index
+    void UpdatePosition(int bookIndex, double quantity, Side side);
+
 private:
     T product;
-    map<string, double> positions;
+    array<double, MAX_BOOKS> positions{};   // indexed by book index
+    double aggregate = 0;
+    int bookCount = 0;
 };
 
 
 
+/**
+ * Lock-free snapshot of the aggregate position and PV01 risk of every product.
+ * Written by the position and risk listeners and read by the quoting and order logic
+ * without taking a lock. Indexed by product index.
+ */
+class InventorySnapshot
+{
+public:
+    // ctor
+    InventorySnapshot();
+
+    // Get the aggregate position of a product
+    double GetPosition(int productIndex) const;
+
+    // Get the PV01 risk (PV01 times quantity) of a product
+    double GetRisk(int productIndex) const;
+
+    // Publish the aggregate position of a product
+    void SetPosition(int productIndex, double position);
+
+    // Publish the PV01 risk of a product
+    void SetRisk(int productIndex, double risk);
+
+    // Get the position of a product in a book
+    double GetBookPosition(int productIndex, int bookIndex) const;
+
+    // Publish the position of a product in a book
+    void SetBookPosition(int productIndex, int bookIndex, double position);
+
+private:
+    unique_ptr<atomic<double>[]> positions;
+    unique_ptr<atomic<double>[]> risks;
+    unique_ptr<atomic<double>[]> book_positions;    // productIndex * MAX_BOOKS + bookIndex
+};
+
+
 /**
  * Position Service to manage positions across multiple books and secruties.
  * Keyed on product identifier.
@@ -66,6 +129,50 @@ public:
 };
 
 
+InventorySnapshot::InventorySnapshot() :
+    positions(new atomic<double>[MAX_PRODUCTS]), risks(new atomic<double>[MAX_PRODUCTS]),
+    book_positions(new atomic<double>[MAX_PRODUCTS * MAX_BOOKS])
+{
+    for (int i = 0; i < MAX_PRODUCTS; ++i)
+    {
+        positions[i].store(0.0, memory_order_relaxed);
+        risks[i].store(0.0, memory_order_relaxed);
+    }
+    for (int i = 0; i < MAX_PRODUCTS * MAX_BOOKS; ++i)
+        book_positions[i].store(0.0, memory_order_relaxed);
+}
+
+double InventorySnapshot::GetPosition(int productIndex) const
+{
+    return positions[productIndex].load(memory_order_acquire);
+}
+
+double InventorySnapshot::GetRisk(int productIndex) const
+{
+    return risks[productIndex].load(memory_order_acquire);
+}
+
+void InventorySnapshot::SetPosition(int productIndex, double position)
+{
+    positions[productIndex].store(position, memory_order_release);
+}
+
+void InventorySnapshot::SetRisk(int productIndex, double risk)
+{
+    risks[productIndex].store(risk, memory_order_release);
+}
+
+double InventorySnapshot::GetBookPosition(int productIndex, int bookIndex) const
+{
+    return book_positions[productIndex * MAX_BOOKS + bookIndex].load(memory_order_acquire);
+}
+
+void InventorySnapshot::SetBookPosition(int productIndex, int bookIndex, double position)
+{
+    book_positions[productIndex * MAX_BOOKS + bookIndex].store(position, memory_order_release);
+}
+
+
 template <typename T>
 Position<T>::Position(const T& _product): product(_product) {}
 
@@ -78,33 +185,55 @@ const T& Position<T>::GetProduct() const
 template<typename T>
 double Position<T>::GetPosition(string& book)
 {
-    return positions[book];
+    return GetPosition(GetBookIndex(book));
 }
 
-template <typename T>
-map<string, double> Position<T>::GetAllPositions()
+template<typename T>
+double Position<T>::GetPosition(int bookIndex) const
+{
+    return positions[bookIndex];
+}
+
+template<typename T>
+const array<double, MAX_BOOKS>& Position<T>::GetBookPositions() const
 {
     return positions;
 }
 
+template<typename T>
+int Position<T>::GetBookCount() const
+{
+    return bookCount;
+}
+
 template <typename T>
-double Position<T>::GetAggregatePosition()
+map<string, double> Position<T>::GetAllPositions() const
 {
-    double aggregate_pos = 0;
-    for (const auto& p : positions)
-    {
-        aggregate_pos += p.second;
-    }
-    return aggregate_pos;
+    map<string, double> all_positions;
+    for (int i = 0; i < bookCount; ++i)
+        all_positions[GetBookName(i)] = positions[i];
+    return all_positions;
+}
+
+template <typename T>
+double Position<T>::GetAggregatePosition() const
+{
+    return aggregate;
 }
 
 template <typename T>
 void Position<T>::UpdatePosition(string& book, double quantity, Side side)
 {
-    if (side == BUY)
-        positions[book] += quantity;
-    else
-        positions[book] -= quantity;
+    UpdatePosition(GetBookIndex(book), quantity, side);
+}
+
+template <typename T>
+void Position<T>::UpdatePosition(int bookIndex, double quantity, Side side)
+{
+    double signed_quantity = side == BUY ? quantity : -quantity;
+    positions[bookIndex] += signed_quantity;
+    aggregate += signed_quantity;
+    bookCount = max(bookCount, bookIndex + 1);
 }
 
 
@@ -134,25 +263,15 @@ void PositionService<T>::OnMessage(Position<T>& data)
 template <typename T>
 void PositionService<T>::AddTrade(const Trade<T>& trade)
 {
-    T product = trade.GetProduct();
-    string product_id = product.GetProductId();
-    string book = trade.GetBook();
-    double quantity = trade.GetQuantity();
-    Side side = trade.GetSide();
+    const T& product = trade.GetProduct();
+    const string& product_id = product.GetProductId();
 
     auto it = positions.find(product_id);
-    if (it != positions.end())
-    {
-        it->second.UpdatePosition(book, quantity, side);
-    }
-    else
-    {
-        Position<T> pos(product);
-        pos.UpdatePosition(book, quantity, side);
-        positions.insert(pair<string, Position<T>>(product_id, pos));
-    }
+    if (it == positions.end())
+        it = positions.insert(pair<string, Position<T>>(product_id, Position<T>(product))).first;
+    it->second.UpdatePosition(trade.GetBookIndex(), trade.GetQuantity(), trade.GetSide());
 
-    Service<string, Position <T> >::Notify(positions[product_id]);
+    Service<string, Position <T> >::Notify(it->second);
 }
 
 #endif
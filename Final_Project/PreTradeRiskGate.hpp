@@ -0,0 +1,361 @@
+/**
+ * @file PreTradeRiskGate.hpp
+ * @brief Header file for the PreTradeRiskGate class template.
+ *
+ * This file contains the definition and implementation of the gate that checks every
+ * execution order against position, size, price and message-rate limits before it is routed
+ * to the venues, rejecting the orders that would breach one.
+ */
+
+#ifndef PRE_TRADE_RISK_GATE_HPP
+#define PRE_TRADE_RISK_GATE_HPP
+
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include "SOA.hpp"
+#include "Throttle.hpp"
+#include "CompactId.hpp"
+#include "ProductIndex.hpp"
+#include "PositionService.hpp"
+#include "PricingService.hpp"
+#include "ExecutionService.hpp"
+
+using namespace std;
+
+// Reasons for rejecting an order before it is routed
+enum RiskRejectReason { REJECT_KILL_SWITCH, REJECT_ORDER_SIZE, REJECT_PRICE_COLLAR, REJECT_POSITION, REJECT_BOOK_POSITION, REJECT_MESSAGE_RATE, REJECT_REASON_COUNT };
+
+// Get the name of a reject reason
+string GetRejectReasonName(RiskRejectReason reason)
+{
+    switch (reason)
+    {
+    case REJECT_KILL_SWITCH: return "kill switch";
+    case REJECT_ORDER_SIZE: return "order size";
+    case REJECT_PRICE_COLLAR: return "price collar";
+    case REJECT_POSITION: return "position";
+    case REJECT_BOOK_POSITION: return "book position";
+    case REJECT_MESSAGE_RATE: return "message rate";
+    default: return "unknown";
+    }
+}
+
+
+/**
+ * Pre-trade limits of a product. Unset limits are infinite.
+ * Position limits apply to the absolute position; the collar is the largest distance of the
+ * order price from the latest mid.
+ */
+struct PreTradeLimits
+{
+    double maxOrderSize = numeric_limits<double>::infinity();
+    double maxPosition = numeric_limits<double>::infinity();
+    double maxBookPosition = numeric_limits<double>::infinity();
+    double priceCollar = numeric_limits<double>::infinity();
+};
+
+
+/**
+ * Pre-trade risk gate between the iceberg manager and the router.
+ * Every order is checked against the kill switch, its product's maximum order size, a price
+ * collar around the latest mid of the pricing service, the product and per-book position
+ * limits and a message-rate limit, in that order. Limits live in a flat array indexed by
+ * product index, and positions and mids are read from lock-free snapshots, so a check is a
+ * handful of loads and compares. The message rate is counted against book updates rather
+ * than the wall clock, so a replay makes the same decisions on any host. Accepted orders
+ * are passed on and their quantity is held as open exposure until it fills or ends;
+ * rejected orders are reported back as an update with status ORDER_REJECTED, and counted
+ * per reason.
+ * Keyed on order identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class PreTradeRiskGate : public Service<CompactId, ExecutionOrder<T> >
+{
+private:
+    const InventorySnapshot* inventory;
+    const PriceSnapshot* prices;
+    vector<PreTradeLimits> limits;              // indexed by product index
+    unique_ptr<atomic<double>[]> exposures;     // signed quantity accepted and still open, by product index
+    atomic<bool> killed;
+    bool rate_limited;
+    TokenBucket rate_limit;
+    uint64_t book_updates;                      // book updates seen, the clock of the rate limit
+    atomic<long> accepted;
+    atomic<long> rejections[REJECT_REASON_COUNT];
+
+    // Add to the open exposure of a product
+    void AddExposure(int productIndex, double quantity);
+
+public:
+    // ctor
+    PreTradeRiskGate(const InventorySnapshot* _inventory, const PriceSnapshot* _prices,
+        double _messagesPerUpdate = numeric_limits<double>::infinity(), double _burst = 1000);
+
+    // Get data on our service given a key
+    ExecutionOrder<T>& GetData(CompactId key);
+
+    // The callback that a Connector should invoke for any new or updated data
+    void OnMessage(ExecutionOrder<T>& data);
+
+    // Set the limits of a product
+    void SetLimits(const string& productId, const PreTradeLimits& productLimits);
+
+    // Get the limits of a product
+    const PreTradeLimits& GetLimits(const string& productId);
+
+    // Set the limits of every product
+    void SetDefaultLimits(const PreTradeLimits& productLimits);
+
+    // Check an order of a product index against the limits, returns false and the reason if it breaches one
+    bool Check(const ExecutionOrder<T>& order, int productIndex, RiskRejectReason& reason);
+
+    // Pass an order on if it passes the checks, reject it otherwise
+    void Submit(const ExecutionOrder<T>& order);
+
+    // Release the open exposure of a fill or of an order that ended
+    void OnExecution(const ExecutionOrder<T>& order);
+
+    // Advance the clock of the message-rate limit by one book update
+    void OnBookUpdate();
+
+    // Engage or release the kill switch
+    void SetKillSwitch(bool engaged);
+
+    // Check whether the kill switch is engaged
+    bool IsKilled() const;
+
+    // Get the open exposure of a product
+    double GetExposure(const string& productId);
+
+    // Get the number of orders accepted
+    long GetAcceptedCount() const;
+
+    // Get the number of orders rejected for a reason
+    long GetRejectCount(RiskRejectReason reason) const;
+};
+
+
+template <typename T>
+PreTradeRiskGate<T>::PreTradeRiskGate(const InventorySnapshot* _inventory, const PriceSnapshot* _prices,
+    double _messagesPerUpdate, double _burst) :
+    inventory(_inventory), prices(_prices), limits(MAX_PRODUCTS), exposures(new atomic<double>[MAX_PRODUCTS]),
+    killed(false), rate_limited(!isinf(_messagesPerUpdate)), rate_limit(_messagesPerUpdate, _burst), book_updates(0), accepted(0)
+{
+    for (int i = 0; i < MAX_PRODUCTS; ++i)
+        exposures[i].store(0.0, memory_order_relaxed);
+    for (int i = 0; i < REJECT_REASON_COUNT; ++i)
+        rejections[i].store(0, memory_order_relaxed);
+}
+
+template <typename T>
+ExecutionOrder<T>& PreTradeRiskGate<T>::GetData(CompactId key)
+{
+    throw out_of_range("The pre-trade risk gate does not keep orders");
+}
+
+template <typename T>
+void PreTradeRiskGate<T>::OnMessage(ExecutionOrder<T>& data)
+{
+    Submit(data);
+}
+
+template <typename T>
+void PreTradeRiskGate<T>::SetLimits(const string& productId, const PreTradeLimits& productLimits)
+{
+    limits[GetProductIndex(productId)] = productLimits;
+}
+
+template <typename T>
+const PreTradeLimits& PreTradeRiskGate<T>::GetLimits(const string& productId)
+{
+    return limits[GetProductIndex(productId)];
+}
+
+template <typename T>
+void PreTradeRiskGate<T>::SetDefaultLimits(const PreTradeLimits& productLimits)
+{
+    limits.assign(MAX_PRODUCTS, productLimits);
+}
+
+template <typename T>
+void PreTradeRiskGate<T>::AddExposure(int productIndex, double quantity)
+{
+    // atomic<double> has no fetch_add before C++20
+    double current = exposures[productIndex].load(memory_order_relaxed);
+    while (!exposures[productIndex].compare_exchange_weak(current, current + quantity, memory_order_acq_rel))
+        ;
+}
+
+/**
+ * @brief Check an order against the limits.
+ *
+ * Only the visible quantity is checked, since that is what goes to the venues; the hidden
+ * reserve of an iceberg comes back through the gate slice by slice.
+ * Position checks are conservative: the whole order and all open exposure are assumed to
+ * land in the same book, and an order is only refused on position if it moves the position
+ * further from flat beyond the limit, so orders that reduce a breach still go through.
+ * The message-rate token is only taken once every other check has passed.
+ *
+ * @tparam T The type of the product.
+ * @param order The order to check.
+ * @param productIndex The product index of the order.
+ * @param reason Set to the first limit breached.
+ * @return true if the order passes every check.
+ */
+template <typename T>
+bool PreTradeRiskGate<T>::Check(const ExecutionOrder<T>& order, int productIndex, RiskRejectReason& reason)
+{
+    if (killed.load(memory_order_acquire))
+    {
+        reason = REJECT_KILL_SWITCH;
+        return false;
+    }
+
+    const PreTradeLimits& productLimits = limits[productIndex];
+    double quantity = order.GetVisibleQuantity();
+    if (quantity > productLimits.maxOrderSize)
+    {
+        reason = REJECT_ORDER_SIZE;
+        return false;
+    }
+
+    if (!isinf(productLimits.priceCollar))
+    {
+        double mid = prices->GetMid(productIndex);
+        if (mid <= 0 || fabs(order.GetPrice() - mid) > productLimits.priceCollar)
+        {
+            reason = REJECT_PRICE_COLLAR;
+            return false;
+        }
+    }
+
+    double signedQuantity = order.GetPricingSide() == BID ? quantity : -quantity;
+    double exposure = exposures[productIndex].load(memory_order_acquire);
+    double before = inventory->GetPosition(productIndex) + exposure;
+    double after = before + signedQuantity;
+    if (fabs(after) > productLimits.maxPosition && fabs(after) > fabs(before))
+    {
+        reason = REJECT_POSITION;
+        return false;
+    }
+
+    if (!isinf(productLimits.maxBookPosition))
+    {
+        for (int book = 0; book < GetBookCount(); ++book)
+        {
+            before = inventory->GetBookPosition(productIndex, book) + exposure;
+            after = before + signedQuantity;
+            if (fabs(after) > productLimits.maxBookPosition && fabs(after) > fabs(before))
+            {
+                reason = REJECT_BOOK_POSITION;
+                return false;
+            }
+        }
+    }
+
+    if (rate_limited && !rate_limit.TryConsume(book_updates))
+    {
+        reason = REJECT_MESSAGE_RATE;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Pass an order on if it passes the checks, reject it otherwise.
+ *
+ * @tparam T The type of the product.
+ * @param order The order to check.
+ */
+template <typename T>
+void PreTradeRiskGate<T>::Submit(const ExecutionOrder<T>& order)
+{
+    RiskRejectReason reason;
+    ExecutionOrder<T> checked = order;
+    int index = GetProductIndex(order.GetProduct().GetProductId());
+    if (Check(order, index, reason))
+    {
+        double quantity = order.GetVisibleQuantity();
+        AddExposure(index, order.GetPricingSide() == BID ? quantity : -quantity);
+        accepted.fetch_add(1, memory_order_relaxed);
+        Service<CompactId, ExecutionOrder<T> >::Notify(checked);
+        return;
+    }
+
+    rejections[reason].fetch_add(1, memory_order_relaxed);
+    checked.SetStatus(ORDER_REJECTED);
+    for (auto& listener : Service<CompactId, ExecutionOrder<T> >::GetListeners())
+        listener->ProcessUpdate(checked);
+}
+
+/**
+ * @brief Release the open exposure of a fill or of an order that ended.
+ *
+ * A fill moves its quantity from open exposure into the position; a cancel or reject
+ * releases the quantity that was still open.
+ *
+ * @tparam T The type of the product.
+ * @param order The execution order whose status changed.
+ */
+template <typename T>
+void PreTradeRiskGate<T>::OnExecution(const ExecutionOrder<T>& order)
+{
+    double released;
+    switch (order.GetStatus())
+    {
+    case ORDER_PARTIALLY_FILLED:
+    case ORDER_FILLED:
+        released = order.GetLastFillQuantity();
+        break;
+    case ORDER_CANCELLED:
+    case ORDER_REJECTED:
+        released = order.GetLeavesQuantity();
+        break;
+    default:
+        return;
+    }
+    AddExposure(GetProductIndex(order.GetProduct().GetProductId()), order.GetPricingSide() == BID ? -released : released);
+}
+
+template <typename T>
+void PreTradeRiskGate<T>::OnBookUpdate()
+{
+    ++book_updates;
+}
+
+template <typename T>
+void PreTradeRiskGate<T>::SetKillSwitch(bool engaged)
+{
+    killed.store(engaged, memory_order_release);
+}
+
+template <typename T>
+bool PreTradeRiskGate<T>::IsKilled() const
+{
+    return killed.load(memory_order_acquire);
+}
+
+template <typename T>
+double PreTradeRiskGate<T>::GetExposure(const string& productId)
+{
+    return exposures[GetProductIndex(productId)].load(memory_order_acquire);
+}
+
+template <typename T>
+long PreTradeRiskGate<T>::GetAcceptedCount() const
+{
+    return accepted.load(memory_order_relaxed);
+}
+
+template <typename T>
+long PreTradeRiskGate<T>::GetRejectCount(RiskRejectReason reason) const
+{
+    return rejections[reason].load(memory_order_relaxed);
+}
+
+#endif
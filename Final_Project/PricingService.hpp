@@ -3,7 +3,10 @@
 
 #include <string>
 #include <map>
+#include <atomic>
+#include <memory>
 #include "SOA.hpp"
+#include "ProductIndex.hpp"
 
 using namespace std;
 
@@ -28,10 +31,36 @@ public:
     // Get the bid/offer spread around the mid
     double GetBidOfferSpread() const;
 
+    // Get the dense index of the product, resolved once when the price is built
+    int GetProductIndex() const;
+
 private:
     T product;
     double mid;
     double bidOfferSpread;
+    int productIndex = -1;
+};
+
+
+/**
+ * Latest mid price of every product in a flat array indexed by product index.
+ * Written by a listener on the pricing service and read lock-free by the pre-trade checks;
+ * a mid of 0 means no price has been seen yet.
+ */
+class PriceSnapshot
+{
+public:
+    // ctor
+    PriceSnapshot();
+
+    // Get the latest mid of a product
+    double GetMid(int productIndex) const;
+
+    // Publish the latest mid of a product
+    void SetMid(int productIndex, double mid);
+
+private:
+    unique_ptr<atomic<double>[]> mids;
 };
 
 
@@ -60,7 +89,7 @@ public:
 
 template<typename T>
 Price<T>::Price(const T& _product, double _mid, double _bidOfferSpread) :
-    product(_product)
+    product(_product), productIndex(::GetProductIndex(_product.GetProductId()))
 {
     mid = _mid;
     bidOfferSpread = _bidOfferSpread;
@@ -84,6 +113,29 @@ double Price<T>::GetBidOfferSpread() const
     return bidOfferSpread;
 }
 
+template<typename T>
+int Price<T>::GetProductIndex() const
+{
+    return productIndex;
+}
+
+
+PriceSnapshot::PriceSnapshot() : mids(new atomic<double>[MAX_PRODUCTS])
+{
+    for (int i = 0; i < MAX_PRODUCTS; ++i)
+        mids[i].store(0.0, memory_order_relaxed);
+}
+
+double PriceSnapshot::GetMid(int productIndex) const
+{
+    return mids[productIndex].load(memory_order_acquire);
+}
+
+void PriceSnapshot::SetMid(int productIndex, double mid)
+{
+    mids[productIndex].store(mid, memory_order_release);
+}
+
 
 template <typename T>
 Price<T>& PricingService<T>::GetData(string key)
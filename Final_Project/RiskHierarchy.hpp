@@ -0,0 +1,464 @@
+/**
+ * @file RiskHierarchy.hpp
+ * @brief Header file for the AggregateRisk class and the RiskHierarchy class template.
+ *
+ * This file contains the definition and implementation of the tree that aggregates positions,
+ * PV01 and P&L from books up to desks and the firm, and across product families.
+ */
+
+#ifndef RISK_HIERARCHY_HPP
+#define RISK_HIERARCHY_HPP
+
+#include <map>
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "SOA.hpp"
+#include "Throttle.hpp"
+#include "ProductIndex.hpp"
+#include "PositionService.hpp"
+#include "PnLService.hpp"
+#include "DataGenerator.hpp"
+
+using namespace std;
+
+// Levels of the aggregation tree, each with its own publication stream
+enum AggregationLevel { BOOK_LEVEL, DESK_LEVEL, FAMILY_LEVEL, FIRM_LEVEL };
+
+// Number of aggregation levels
+const int AGGREGATION_LEVELS = 4;
+
+// Get the name of an aggregation level
+string GetAggregationLevelName(AggregationLevel level)
+{
+    switch (level)
+    {
+    case BOOK_LEVEL: return "book";
+    case DESK_LEVEL: return "desk";
+    case FAMILY_LEVEL: return "family";
+    case FIRM_LEVEL: return "firm";
+    default: return "unknown";
+    }
+}
+
+/**
+ * Position, PV01 and P&L aggregated at one node of the risk hierarchy.
+ */
+class AggregateRisk
+{
+public:
+    // ctor
+    AggregateRisk() = default;
+    AggregateRisk(const string& _name, AggregationLevel _level);
+
+    // Get the name of the node
+    const string& GetName() const;
+
+    // Get the level of the node
+    AggregationLevel GetLevel() const;
+
+    // Get the position summed under the node
+    double GetPosition() const;
+
+    // Get the PV01 summed under the node
+    double GetPV01() const;
+
+    // Get the P&L summed under the node
+    double GetPnL() const;
+
+    // Move the sums by the changes of one leaf
+    void Apply(double positionDelta, double pv01Delta, double pnlDelta);
+
+private:
+    string name;
+    AggregationLevel level;
+    double position = 0;
+    double pv01 = 0;
+    double pnl = 0;
+};
+
+
+/**
+ * Aggregation of positions, PV01 and P&L up a tree of books, desks and the firm.
+ * Books roll up into their desk and desks into the firm; a book that is not registered rolls
+ * straight into the firm. Product families group products across every book and roll up into
+ * nothing else, since the firm already holds every book. The hierarchy keeps the last
+ * position, PV01 and P&L of each product in each book, so an update only carries the change
+ * of the books that moved, and each change is added to the book's chain of ancestors and the
+ * product's family: O(depth) per changed book, with nothing re-aggregated.
+ * Each level has its own stream of listeners, conflated per node: a changed node goes out at
+ * most once per publish interval of replay time of its level with its latest sums, and Flush
+ * publishes the rest.
+ * PV01 per unit of position is read from the same table as the risk service.
+ * Type T is the product type.
+ */
+template<typename T>
+class RiskHierarchy
+{
+private:
+    struct LevelStream
+    {
+        vector<ServiceListener<AggregateRisk>*> listeners;
+        uint64_t publishInterval = 1000;
+        uint64_t lastPublish = 0;
+        vector<int> dirtyNodes;
+        long publishedCount = 0;
+        long conflatedCount = 0;
+    };
+
+    struct LeafState
+    {
+        double position = 0;
+        double pnl = 0;
+    };
+
+    vector<AggregateRisk> nodes;
+    vector<int> parents;                            // parent of each node, -1 for roots
+    vector<char> dirty;                             // indexed by node
+    map<string, int> node_positions;                // node name -> node
+    array<int, MAX_BOOKS> book_nodes;               // book index -> book node, the firm if unregistered
+    vector<int> product_families;                   // product index -> family node, -1 if none
+    vector<double> unit_pv01s;                      // PV01 of one unit, indexed by product index
+    vector<array<LeafState, MAX_BOOKS>> leaves;     // indexed by product index
+    array<LevelStream, AGGREGATION_LEVELS> streams;
+    int firm;
+
+    // Add a node under a parent
+    int AddNode(const string& name, AggregationLevel level, int parent);
+
+    // Make room for a product index
+    void Reserve(int productIndex, const string& productId);
+
+    // Add the change of one product in one book to its ancestors and family
+    void Propagate(int productIndex, int bookIndex, double positionDelta, double pv01Delta, double pnlDelta);
+
+    // Queue a changed node on the stream of its level
+    void Touch(int node);
+
+    // Publish the levels whose interval has passed
+    void MaybePublish();
+
+    // Publish every queued node of a level
+    void Publish(int level);
+
+public:
+    // ctor
+    RiskHierarchy(const string& firmName = "FIRM");
+
+    // Add a desk under the firm
+    void AddDesk(const string& desk);
+
+    // Add a book under a desk
+    void AddBook(const string& book, const string& desk);
+
+    // Add a product family over a set of products
+    void AddFamily(const string& family, const vector<string>& productIds);
+
+    // Set the shortest replay time between two publishes of a level
+    void SetPublishInterval(AggregationLevel level, uint64_t interval);
+
+    // Add a listener to the stream of a level
+    void AddListener(AggregationLevel level, ServiceListener<AggregateRisk>* listener);
+
+    // Take the new positions of a product, moving the nodes above the books that changed
+    void OnPosition(const Position<T>& position);
+
+    // Take the new P&L of a product, moving the nodes above the books that changed
+    void OnPnL(const PnL<T>& pnl);
+
+    // Publish every node changed since its last publish, at the end of a run
+    void Flush();
+
+    // Get the sums of a node
+    const AggregateRisk& GetNode(const string& name) const;
+
+    // Get the number of updates published by a level
+    long GetPublishedCount(AggregationLevel level) const;
+
+    // Get the number of node changes of a level absorbed into a later publish of the same node
+    long GetConflatedCount(AggregationLevel level) const;
+};
+
+
+AggregateRisk::AggregateRisk(const string& _name, AggregationLevel _level) :
+    name(_name), level(_level)
+{
+}
+
+const string& AggregateRisk::GetName() const
+{
+    return name;
+}
+
+AggregationLevel AggregateRisk::GetLevel() const
+{
+    return level;
+}
+
+double AggregateRisk::GetPosition() const
+{
+    return position;
+}
+
+double AggregateRisk::GetPV01() const
+{
+    return pv01;
+}
+
+double AggregateRisk::GetPnL() const
+{
+    return pnl;
+}
+
+void AggregateRisk::Apply(double positionDelta, double pv01Delta, double pnlDelta)
+{
+    position += positionDelta;
+    pv01 += pv01Delta;
+    pnl += pnlDelta;
+}
+
+
+/**
+ * @brief Construct the hierarchy with only the firm, every book rolling into it.
+ *
+ * @tparam T The type of the product.
+ * @param firmName The name of the firm node.
+ */
+template <typename T>
+RiskHierarchy<T>::RiskHierarchy(const string& firmName)
+{
+    firm = AddNode(firmName, FIRM_LEVEL, -1);
+    book_nodes.fill(firm);
+}
+
+/**
+ * @brief Add a node under a parent.
+ *
+ * @tparam T The type of the product.
+ * @param name The name of the node.
+ * @param level The level of the node.
+ * @param parent The parent node, -1 for a root.
+ * @return The node.
+ * @throws invalid_argument if a node of that name exists.
+ */
+template <typename T>
+int RiskHierarchy<T>::AddNode(const string& name, AggregationLevel level, int parent)
+{
+    if (node_positions.count(name) != 0)
+        throw invalid_argument("Node " + name + " is already in the risk hierarchy");
+    int node = nodes.size();
+    nodes.push_back(AggregateRisk(name, level));
+    parents.push_back(parent);
+    dirty.push_back(0);
+    node_positions[name] = node;
+    return node;
+}
+
+template <typename T>
+void RiskHierarchy<T>::AddDesk(const string& desk)
+{
+    AddNode(desk, DESK_LEVEL, firm);
+}
+
+/**
+ * @brief Add a book under a desk.
+ *
+ * Books must be added before any position reaches them.
+ *
+ * @tparam T The type of the product.
+ * @param book The name of the book.
+ * @param desk The name of its desk.
+ * @throws invalid_argument if the desk is unknown or the book already added.
+ */
+template <typename T>
+void RiskHierarchy<T>::AddBook(const string& book, const string& desk)
+{
+    auto found = node_positions.find(desk);
+    if (found == node_positions.end() || nodes[found->second].GetLevel() != DESK_LEVEL)
+        throw invalid_argument("No desk " + desk + " in the risk hierarchy");
+    book_nodes[GetBookIndex(book)] = AddNode(book, BOOK_LEVEL, found->second);
+}
+
+/**
+ * @brief Add a product family over a set of products.
+ *
+ * Families must be added before any position reaches their products; a product belongs to
+ * at most one family, the last one added.
+ *
+ * @tparam T The type of the product.
+ * @param family The name of the family.
+ * @param productIds The identifiers of its products.
+ */
+template <typename T>
+void RiskHierarchy<T>::AddFamily(const string& family, const vector<string>& productIds)
+{
+    int node = AddNode(family, FAMILY_LEVEL, -1);
+    for (const auto& id : productIds)
+    {
+        int index = GetProductIndex(id);
+        Reserve(index, id);
+        product_families[index] = node;
+    }
+}
+
+template <typename T>
+void RiskHierarchy<T>::SetPublishInterval(AggregationLevel level, uint64_t interval)
+{
+    streams[level].publishInterval = interval;
+}
+
+template <typename T>
+void RiskHierarchy<T>::AddListener(AggregationLevel level, ServiceListener<AggregateRisk>* listener)
+{
+    streams[level].listeners.push_back(listener);
+}
+
+template <typename T>
+void RiskHierarchy<T>::Reserve(int productIndex, const string& productId)
+{
+    if (productIndex >= (int)leaves.size())
+    {
+        leaves.resize(productIndex + 1);
+        product_families.resize(productIndex + 1, -1);
+        unit_pv01s.resize(productIndex + 1, 0.0);
+    }
+    if (unit_pv01s[productIndex] == 0 && g_PV01s.count(productId) != 0)
+        unit_pv01s[productIndex] = g_PV01s[productId];
+}
+
+template <typename T>
+void RiskHierarchy<T>::Propagate(int productIndex, int bookIndex, double positionDelta, double pv01Delta, double pnlDelta)
+{
+    for (int node = book_nodes[bookIndex]; node != -1; node = parents[node])
+    {
+        nodes[node].Apply(positionDelta, pv01Delta, pnlDelta);
+        Touch(node);
+    }
+    int family = product_families[productIndex];
+    if (family != -1)
+    {
+        nodes[family].Apply(positionDelta, pv01Delta, pnlDelta);
+        Touch(family);
+    }
+}
+
+template <typename T>
+void RiskHierarchy<T>::Touch(int node)
+{
+    LevelStream& stream = streams[nodes[node].GetLevel()];
+    if (dirty[node])
+    {
+        ++stream.conflatedCount;
+    }
+    else
+    {
+        dirty[node] = 1;
+        stream.dirtyNodes.push_back(node);
+    }
+}
+
+template <typename T>
+void RiskHierarchy<T>::MaybePublish()
+{
+    for (int level = 0; level < AGGREGATION_LEVELS; ++level)
+    {
+        LevelStream& stream = streams[level];
+        if (!stream.dirtyNodes.empty() && g_replay_time - stream.lastPublish >= stream.publishInterval)
+        {
+            stream.lastPublish = g_replay_time;
+            Publish(level);
+        }
+    }
+}
+
+template <typename T>
+void RiskHierarchy<T>::Publish(int level)
+{
+    LevelStream& stream = streams[level];
+    for (int node : stream.dirtyNodes)
+    {
+        dirty[node] = 0;
+        ++stream.publishedCount;
+        for (auto listener : stream.listeners)
+            listener->ProcessAdd(nodes[node]);
+    }
+    stream.dirtyNodes.clear();
+}
+
+template <typename T>
+void RiskHierarchy<T>::OnPosition(const Position<T>& position)
+{
+    const string& product_id = position.GetProduct().GetProductId();
+    int index = GetProductIndex(product_id);
+    Reserve(index, product_id);
+    const array<double, MAX_BOOKS>& book_positions = position.GetBookPositions();
+    array<LeafState, MAX_BOOKS>& leaf = leaves[index];
+    for (int b = 0; b < GetBookCount(); ++b)
+    {
+        double delta = book_positions[b] - leaf[b].position;
+        if (delta == 0)
+            continue;
+        leaf[b].position = book_positions[b];
+        Propagate(index, b, delta, delta * unit_pv01s[index], 0.0);
+    }
+    MaybePublish();
+}
+
+template <typename T>
+void RiskHierarchy<T>::OnPnL(const PnL<T>& pnl)
+{
+    const string& product_id = pnl.GetProduct().GetProductId();
+    int index = GetProductIndex(product_id);
+    Reserve(index, product_id);
+    const array<double, MAX_BOOKS>& book_pnls = pnl.GetBookPnLs();
+    array<LeafState, MAX_BOOKS>& leaf = leaves[index];
+    for (int b = 0; b < GetBookCount(); ++b)
+    {
+        double delta = book_pnls[b] - leaf[b].pnl;
+        if (delta == 0)
+            continue;
+        leaf[b].pnl = book_pnls[b];
+        Propagate(index, b, 0.0, 0.0, delta);
+    }
+    MaybePublish();
+}
+
+template <typename T>
+void RiskHierarchy<T>::Flush()
+{
+    for (int level = 0; level < AGGREGATION_LEVELS; ++level)
+        Publish(level);
+}
+
+/**
+ * @brief Get the sums of a node.
+ *
+ * @tparam T The type of the product.
+ * @param name The name of the node.
+ * @return The sums of the node.
+ * @throws out_of_range if there is no node of that name.
+ */
+template <typename T>
+const AggregateRisk& RiskHierarchy<T>::GetNode(const string& name) const
+{
+    auto found = node_positions.find(name);
+    if (found == node_positions.end())
+        throw out_of_range("No node " + name + " in the risk hierarchy");
+    return nodes[found->second];
+}
+
+template <typename T>
+long RiskHierarchy<T>::GetPublishedCount(AggregationLevel level) const
+{
+    return streams[level].publishedCount;
+}
+
+template <typename T>
+long RiskHierarchy<T>::GetConflatedCount(AggregationLevel level) const
+{
+    return streams[level].conflatedCount;
+}
+
+#endif
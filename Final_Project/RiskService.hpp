@@ -1,9 +1,15 @@
 #ifndef RISK_SERVICE_HPP
 #define RISK_SERVICE_HPP
 
+#include <map>
+#include <cmath>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <stdexcept>
 #include "SOA.hpp"
+#include "Throttle.hpp"
+#include "ProductIndex.hpp"
 #include "PositionService.hpp"
 #include "DataGenerator.hpp"
 
@@ -21,9 +27,15 @@ public:
 
     // Get the product on this PV01 value
     const T& GetProduct() const;
+
+    // Get the product on this PV01 value, to change it in place
+    T& GetProduct();
     
     // Get the PV01 value
     double GetPV01() const;
+
+    // Change the PV01 value
+    void SetPV01(double _pv01);
     
     // Get the quantity that this risk value is associated with
     double GetQuantity() const;
@@ -54,6 +66,9 @@ public:
     // Get the products associated with this bucket
     const vector<T>& GetProducts() const;
 
+    // Add a product to this bucket
+    void AddProduct(const T& product);
+
     // Get the name of the bucket
     const string& GetName() const;
 
@@ -63,8 +78,33 @@ private:
 };
 
 
+// When the risk service publishes the risk of a product
+enum RiskPublishMode { PUBLISH_EVERY_UPDATE, PUBLISH_ON_CHANGE, PUBLISH_THROTTLED, PUBLISH_AT_BATCH_END };
+
+/**
+ * Publish policy of the per-product risk stream.
+ * Under every mode but PUBLISH_EVERY_UPDATE an update held back stays pending, and
+ * FlushRisk publishes every pending product at the end of a batch. The throttle interval
+ * is in replay time, so every mode publishes the same updates on every run.
+ */
+struct RiskPublishPolicy
+{
+    RiskPublishMode mode = PUBLISH_EVERY_UPDATE;
+    double changeThreshold = 0;     // smallest move of PV01 risk since the last publish, under PUBLISH_ON_CHANGE
+    uint64_t interval = 0;          // shortest replay time between two publishes of a product, under PUBLISH_THROTTLED
+};
+
+
 /**
  * Risk Service to vend out risk for a particular security and across a risk bucketed sector.
+ * Bucketed sectors are registered up front, and each product keeps the list of the sectors
+ * containing it, so a new position moves every sector it belongs to by the change in its
+ * risk without walking any sector. Sector risk is its own stream, published to the bucket
+ * listeners and conflated per sector: a changed sector goes out at most once per publish
+ * interval of replay time with its latest risk, and FlushBuckets publishes whatever is left.
+ * The risk of every product is kept current on each position, in a slot per product index,
+ * and goes to the current risk listeners at once, while its publication to the service
+ * listeners follows the publish policy.
  * Keyed on product identifier.
  * Type T is the product type.
  */
@@ -72,11 +112,49 @@ template<typename T>
 class RiskService : public Service<string, PV01 <T> >
 {
 private:
-    map<string, PV01 <T> > pv01s;
+    vector<PV01<T>> pv01s;                      // indexed by product index, empty product if none
+    vector<double> product_risks;               // PV01 times quantity, indexed by product index
+    vector<vector<int>> product_buckets;        // sectors containing each product, indexed by product index
+    vector<BucketedSector<T>> sectors;
+    map<string, int> sector_positions;          // sector name -> position in sectors
+    vector<double> bucket_risks;                // indexed like sectors
+    vector<char> bucket_dirty;
+    vector<int> dirty_buckets;
+    vector<ServiceListener<PV01<BucketedSector<T>>>*> bucket_listeners;
+    vector<ServiceListener<PV01<T>>*> current_listeners;
+    uint64_t publish_interval;
+    uint64_t last_publish;
+    long bucket_published_count;
+    long bucket_conflated_count;
+
+    RiskPublishPolicy policy;
+    vector<double> published_risks;             // risk at the last publish, indexed by product index
+    vector<uint64_t> published_times;           // replay time of the last publish, indexed by product index
+    vector<char> risk_pending;                  // held back since the last publish
+    vector<char> risk_queued;                   // in pending_products
+    vector<int> pending_products;
+    uint64_t last_sweep;
+    long risk_published_count;
+    long risk_held_count;
+
+    // Make room for a product index
+    void Reserve(int productIndex);
+
+    // Publish the risk of a product now or hold it, following the policy
+    void EmitRisk(int productIndex);
+
+    // Publish the risk of a product to the service listeners
+    void PublishRisk(int productIndex);
+
+    // Move the sectors of a product by the change in its risk
+    void ApplyRisk(int productIndex, double risk);
+
+    // Publish every changed sector to the bucket listeners
+    void PublishBuckets();
 
 public:
     // ctor
-    RiskService() = default;
+    RiskService(uint64_t _publishInterval = 1000);
     
     // Get data on our service given a key
     PV01 <T>& GetData(string key);
@@ -90,6 +168,35 @@ public:
     // Get the bucketed risk for the bucket sector
     PV01<BucketedSector<T>> GetBucketedRisk(const BucketedSector<T>& _sector) const;
 
+    // Register a bucketed sector whose risk is kept and published
+    void AddBucketedSector(const BucketedSector<T>& sector);
+
+    // Add a listener to the bucketed risk stream
+    void AddBucketListener(ServiceListener<PV01<BucketedSector<T>>>* listener);
+
+    // Publish every sector changed since its last publish, at the end of a run
+    void FlushBuckets();
+
+    // Get the number of bucketed risk updates published
+    long GetBucketPublishedCount() const;
+
+    // Get the number of sector changes absorbed into a later publish of the same sector
+    long GetBucketConflatedCount() const;
+
+    // Add a listener to the risk of every position, ahead of the publish policy
+    void AddCurrentRiskListener(ServiceListener<PV01<T>>* listener);
+
+    // Set when the risk of a product is published
+    void SetPublishPolicy(const RiskPublishPolicy& _policy);
+
+    // Publish every product whose risk is held back, at the end of a batch
+    void FlushRisk();
+
+    // Get the number of product risk updates published
+    long GetRiskPublishedCount() const;
+
+    // Get the number of product risk updates held back by the policy
+    long GetRiskHeldCount() const;
 };
 
 
@@ -107,12 +214,24 @@ const T& PV01<T>::GetProduct() const
     return product;
 }
 
+template <typename T>
+T& PV01<T>::GetProduct()
+{
+    return product;
+}
+
 template <typename T>
 double PV01<T>::GetPV01() const
 {
     return pv01;
 }
 
+template <typename T>
+void PV01<T>::SetPV01(double _pv01)
+{
+    pv01 = _pv01;
+}
+
 template <typename T>
 double PV01<T>::GetQuantity() const
 {
@@ -139,6 +258,12 @@ const vector<T>& BucketedSector<T>::GetProducts() const
     return products;
 }
 
+template<typename T>
+void BucketedSector<T>::AddProduct(const T& product)
+{
+    products.push_back(product);
+}
+
 template<typename T>
 const string& BucketedSector<T>::GetName() const
 {
@@ -146,16 +271,56 @@ const string& BucketedSector<T>::GetName() const
 }
 
 
+/**
+ * @brief Construct the risk service.
+ *
+ * @tparam T The type of the product.
+ * @param _publishInterval The shortest replay time between two publishes of the changed sectors.
+ */
+template <typename T>
+RiskService<T>::RiskService(uint64_t _publishInterval) :
+    publish_interval(_publishInterval), last_publish(0), bucket_published_count(0), bucket_conflated_count(0),
+    last_sweep(0), risk_published_count(0), risk_held_count(0)
+{
+}
+
+/**
+ * @brief Get the current risk of a product, published or not.
+ *
+ * @tparam T The type of the product.
+ * @param key The product identifier.
+ * @return The PV01 of the product at its latest position.
+ * @throws out_of_range if the product has no position.
+ */
 template <typename T>
 PV01<T>& RiskService<T>::GetData(string key)
 {
-    return pv01s.find(key)->second;
+    auto found = g_product_index.find(key);
+    if (found == g_product_index.end() || found->second >= (int)pv01s.size()
+        || pv01s[found->second].GetProduct().GetProductId().empty())
+        throw out_of_range("No risk for product " + key);
+    return pv01s[found->second];
 }
 
 template <typename T>
 void RiskService<T>::OnMessage(PV01<T>& data)
 {
-    pv01s[data.GetProduct().GetProductId()] = data;
+    int index = GetProductIndex(data.GetProduct().GetProductId());
+    Reserve(index);
+    pv01s[index] = data;
+}
+
+template <typename T>
+void RiskService<T>::Reserve(int productIndex)
+{
+    if (productIndex >= (int)pv01s.size())
+    {
+        pv01s.resize(productIndex + 1);
+        published_risks.resize(productIndex + 1, 0.0);
+        published_times.resize(productIndex + 1, 0);
+        risk_pending.resize(productIndex + 1, 0);
+        risk_queued.resize(productIndex + 1, 0);
+    }
 }
 
 /**
@@ -164,29 +329,242 @@ void RiskService<T>::OnMessage(PV01<T>& data)
  * @tparam T The type of the product.
  * @param position The position to be added.
  * 
- * This function retrieves the product from the given position, obtains its product ID,
- * and calculates the aggregate position quantity. It then uses the global PV01 value
- * for the product to create a new PV01 object, which is stored in the pv01s map.
- * Finally, it notifies the service with the new PV01 object.
+ * The first position of a product builds its PV01 from the global PV01 table; later ones
+ * only move its quantity to the aggregate position. The bucketed sectors containing the
+ * product move by the change in its risk and the current risk listeners get the new risk,
+ * then the risk is published or held back following the publish policy.
  */
 template <typename T>
 void RiskService<T>::AddPosition(Position<T>& position)
 {
-    T product = position.GetProduct();
-    string product_id = product.GetProductId();
+    const T& product = position.GetProduct();
+    int index = GetProductIndex(product.GetProductId());
+    Reserve(index);
+    PV01<T>& pv01 = pv01s[index];
+    if (pv01.GetProduct().GetProductId().empty())
+        pv01 = PV01<T>(product, g_PV01s[product.GetProductId()], 0.0);
     double quantity = position.GetAggregatePosition();
-    double pv = g_PV01s[product_id];
+    pv01.UpdateQuantity(quantity - pv01.GetQuantity());
 
-    PV01<T> new_pv01(product, pv, quantity);
-    pv01s[product_id] = new_pv01;
-    Service<string, PV01 <T> >::Notify(new_pv01);
+    ApplyRisk(index, pv01.GetPV01() * quantity);
+    for (auto listener : current_listeners)
+        listener->ProcessAdd(pv01);
+    EmitRisk(index);
+}
+
+/**
+ * @brief Publish the risk of a product now or hold it, following the policy.
+ *
+ * A held product is queued as pending. Under PUBLISH_THROTTLED the pending products whose
+ * interval has passed are also swept once per interval, so a product that stops trading
+ * still gets its last risk out.
+ *
+ * @tparam T The type of the product.
+ * @param productIndex The product index.
+ */
+template <typename T>
+void RiskService<T>::EmitRisk(int productIndex)
+{
+    bool publish = true;
+    if (policy.mode == PUBLISH_ON_CHANGE)
+    {
+        publish = fabs(product_risks[productIndex] - published_risks[productIndex]) >= policy.changeThreshold;
+    }
+    else if (policy.mode == PUBLISH_THROTTLED)
+    {
+        publish = g_replay_time - published_times[productIndex] >= policy.interval;
+        if (g_replay_time - last_sweep >= policy.interval)
+        {
+            last_sweep = g_replay_time;
+            size_t kept = 0;
+            for (int pending : pending_products)
+            {
+                if (risk_pending[pending] && pending != productIndex && g_replay_time - published_times[pending] >= policy.interval)
+                    PublishRisk(pending);
+                if (risk_pending[pending])
+                    pending_products[kept++] = pending;
+                else
+                    risk_queued[pending] = 0;
+            }
+            pending_products.resize(kept);
+        }
+    }
+    else if (policy.mode == PUBLISH_AT_BATCH_END)
+    {
+        publish = false;
+    }
+
+    if (publish)
+    {
+        PublishRisk(productIndex);
+        return;
+    }
+    ++risk_held_count;
+    risk_pending[productIndex] = 1;
+    if (!risk_queued[productIndex])
+    {
+        risk_queued[productIndex] = 1;
+        pending_products.push_back(productIndex);
+    }
+}
+
+template <typename T>
+void RiskService<T>::PublishRisk(int productIndex)
+{
+    risk_pending[productIndex] = 0;
+    published_risks[productIndex] = product_risks[productIndex];
+    if (policy.mode == PUBLISH_THROTTLED)
+        published_times[productIndex] = g_replay_time;
+    ++risk_published_count;
+    Service<string, PV01 <T> >::Notify(pv01s[productIndex]);
+}
+
+template <typename T>
+void RiskService<T>::ApplyRisk(int productIndex, double risk)
+{
+    if (productIndex >= (int)product_risks.size())
+    {
+        product_risks.resize(productIndex + 1, 0.0);
+        product_buckets.resize(productIndex + 1);
+    }
+    double delta = risk - product_risks[productIndex];
+    product_risks[productIndex] = risk;
+    if (product_buckets[productIndex].empty())
+        return;
+
+    for (int bucket : product_buckets[productIndex])
+    {
+        bucket_risks[bucket] += delta;
+        if (bucket_dirty[bucket])
+        {
+            ++bucket_conflated_count;
+        }
+        else
+        {
+            bucket_dirty[bucket] = 1;
+            dirty_buckets.push_back(bucket);
+        }
+    }
+
+    if (g_replay_time - last_publish >= publish_interval)
+    {
+        last_publish = g_replay_time;
+        PublishBuckets();
+    }
+}
+
+template <typename T>
+void RiskService<T>::PublishBuckets()
+{
+    for (int bucket : dirty_buckets)
+    {
+        bucket_dirty[bucket] = 0;
+        PV01<BucketedSector<T>> bucket_pv01(sectors[bucket], bucket_risks[bucket], 1);
+        ++bucket_published_count;
+        for (auto listener : bucket_listeners)
+            listener->ProcessAdd(bucket_pv01);
+    }
+    dirty_buckets.clear();
+}
+
+/**
+ * @brief Register a bucketed sector whose risk is kept and published.
+ *
+ * The sector starts from the current risk of its products and is added to the membership
+ * list of each of them. A sector registered again under the same name is ignored.
+ *
+ * @tparam T The type of the product.
+ * @param sector The sector.
+ */
+template <typename T>
+void RiskService<T>::AddBucketedSector(const BucketedSector<T>& sector)
+{
+    if (sector_positions.count(sector.GetName()) != 0)
+        return;
+    int bucket = sectors.size();
+    sectors.push_back(sector);
+    sector_positions[sector.GetName()] = bucket;
+    bucket_risks.push_back(0.0);
+    bucket_dirty.push_back(0);
+    for (const auto& product : sector.GetProducts())
+    {
+        int index = GetProductIndex(product.GetProductId());
+        if (index >= (int)product_risks.size())
+        {
+            product_risks.resize(index + 1, 0.0);
+            product_buckets.resize(index + 1);
+        }
+        product_buckets[index].push_back(bucket);
+        bucket_risks[bucket] += product_risks[index];
+    }
+}
+
+template <typename T>
+void RiskService<T>::AddBucketListener(ServiceListener<PV01<BucketedSector<T>>>* listener)
+{
+    bucket_listeners.push_back(listener);
+}
+
+template <typename T>
+void RiskService<T>::AddCurrentRiskListener(ServiceListener<PV01<T>>* listener)
+{
+    current_listeners.push_back(listener);
+}
+
+template <typename T>
+void RiskService<T>::FlushBuckets()
+{
+    PublishBuckets();
+}
+
+template <typename T>
+void RiskService<T>::SetPublishPolicy(const RiskPublishPolicy& _policy)
+{
+    policy = _policy;
+}
+
+template <typename T>
+void RiskService<T>::FlushRisk()
+{
+    for (int index : pending_products)
+    {
+        if (risk_pending[index])
+            PublishRisk(index);
+        risk_queued[index] = 0;
+    }
+    pending_products.clear();
+}
+
+template <typename T>
+long RiskService<T>::GetRiskPublishedCount() const
+{
+    return risk_published_count;
+}
+
+template <typename T>
+long RiskService<T>::GetRiskHeldCount() const
+{
+    return risk_held_count;
+}
+
+template <typename T>
+long RiskService<T>::GetBucketPublishedCount() const
+{
+    return bucket_published_count;
+}
+
+template <typename T>
+long RiskService<T>::GetBucketConflatedCount() const
+{
+    return bucket_conflated_count;
 }
 
 /**
  * @brief Get the bucketed risk for a given sector.
  * 
  * This function calculates the PV01 (Price Value of a Basis Point) for a given 
- * BucketedSector by summing up the PV01 values of all products within the sector.
+ * BucketedSector. A registered sector is read from its running total; any other sector
+ * sums the PV01 values of its products, skipping the products without risk.
  * 
  * @tparam T The type of the product in the sector.
  * @param sector The BucketedSector for which the bucketed risk is to be calculated.
@@ -195,14 +573,18 @@ void RiskService<T>::AddPosition(Position<T>& position)
 template<typename T>
 PV01<BucketedSector<T>> RiskService<T>::GetBucketedRisk(const BucketedSector<T>& sector) const
 {
-    BucketedSector<T> bucketedSector = sector;
+    auto registered = sector_positions.find(sector.GetName());
+    if (registered != sector_positions.end())
+        return PV01<BucketedSector<T>>(sector, bucket_risks[registered->second], 1);
+
     double pv01 = 0;
     for (auto& p : sector.GetProducts())
     {
-        string id = p.GetProductId();
-        pv01 += (pv01s[id].GetPV01() * pv01s[id].GetQuantity());
+        auto found = g_product_index.find(p.GetProductId());
+        if (found != g_product_index.end() && found->second < (int)product_risks.size())
+            pv01 += product_risks[found->second];
     }
-    return PV01<BucketedSector<T>>(bucketedSector, pv01, 1);
+    return PV01<BucketedSector<T>>(sector, pv01, 1);
 }
 
 #endif
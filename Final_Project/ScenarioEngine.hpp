@@ -0,0 +1,425 @@
+/**
+ * @file ScenarioEngine.hpp
+ * @brief Header file for the CurveScenario struct and the ScenarioEngine class template.
+ *
+ * This file contains the definition and implementation of the stress engine that revalues
+ * the portfolio under a set of zero curve scenarios.
+ */
+
+#ifndef SCENARIO_ENGINE_HPP
+#define SCENARIO_ENGINE_HPP
+
+#include <array>
+#include <cmath>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "Throttle.hpp"
+#include "ThreadPool.hpp"
+#include "ProductIndex.hpp"
+#include "CurveService.hpp"
+#include "PositionService.hpp"
+
+using namespace std;
+
+// Number of scenarios handled together by the vectorized loops, scenario arrays are padded to it
+const int SCENARIO_LANES = 4;
+
+// Kinds of curve scenarios
+enum ScenarioType { PARALLEL_SHIFT, TWIST, BUTTERFLY, HISTORICAL_SHOCK };
+
+/**
+ * Curve scenario as a shift of the zero rate of every pillar, in decimal.
+ * Shifts between pillars are interpolated like the rates themselves.
+ */
+struct CurveScenario
+{
+    string name;
+    ScenarioType type;
+    array<double, CURVE_PILLARS> shifts;
+};
+
+// Build a scenario shifting every pillar by the same number of basis points
+CurveScenario MakeParallelScenario(double bp)
+{
+    CurveScenario scenario{ "parallel " + to_string(int(bp)) + "bp", PARALLEL_SHIFT, {} };
+    scenario.shifts.fill(bp * 1e-4);
+    return scenario;
+}
+
+// Build a scenario rotating the curve around a pivot time, the longest pillar moving bp more than the shortest
+CurveScenario MakeTwistScenario(double bp, double pivot, const array<double, CURVE_PILLARS>& times)
+{
+    CurveScenario scenario{ "twist " + to_string(int(bp)) + "bp", TWIST, {} };
+    double span = times[CURVE_PILLARS - 1] - times[0];
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+        scenario.shifts[i] = bp * 1e-4 * (times[i] - pivot) / span;
+    return scenario;
+}
+
+// Build a scenario moving the wings by bp and the belly around a time by -bp, linearly in between
+CurveScenario MakeButterflyScenario(double bp, double belly, const array<double, CURVE_PILLARS>& times)
+{
+    CurveScenario scenario{ "butterfly " + to_string(int(bp)) + "bp", BUTTERFLY, {} };
+    double reach = max(belly - times[0], times[CURVE_PILLARS - 1] - belly);
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+        scenario.shifts[i] = bp * 1e-4 * (2 * fabs(times[i] - belly) / reach - 1);
+    return scenario;
+}
+
+
+/**
+ * Stress engine revaluing the portfolio under curve scenarios.
+ * Every product has a row holding its P&L per unit of face value under each scenario, from a
+ * full revaluation of its cash flows on the shifted curve; the portfolio P&L of a scenario is
+ * the sum over products of position times row entry. Rows only depend on the curve, so a
+ * position change only moves the cached totals by the change in quantity times the row of its
+ * product, and a new product only values its own row. Rows are laid out scenario-major and
+ * padded to SCENARIO_LANES so the loops over scenarios vectorize. A new curve revalues every
+ * row across the thread pool, at most once per revaluation interval of replay time; curves in
+ * between are conflated. Curves are also sampled into a history whose successive moves become the
+ * historical shock scenarios.
+ * Type T is the product type.
+ */
+template<typename T>
+class ScenarioEngine
+{
+private:
+    ThreadPool* pool;
+    ZeroCurve curve;
+    vector<CurveScenario> scenarios;
+    int padded_count;                       // scenario count rounded up to SCENARIO_LANES
+    vector<double> pillar_shifts;           // pillar * padded_count + scenario
+
+    vector<int> product_slots;              // product index -> slot, -1 if none
+    vector<T> products;                     // indexed by slot
+    vector<vector<CurveCashFlow>> cash_flows;   // indexed by slot
+    vector<double> quantities;              // indexed by slot
+    vector<double> rows;                    // slot * padded_count + scenario, P&L per unit of face
+    vector<double> totals;                  // portfolio P&L of each scenario
+
+    uint64_t revalue_interval;
+    uint64_t last_revalue;
+    bool curve_dirty;
+    long revaluation_count;
+
+    int sample_every;
+    long curve_updates;
+    size_t history_size;
+    deque<array<double, CURVE_PILLARS>> history;    // sampled zero rates, oldest first
+
+    // Get the slot of a product, adding it if new
+    int GetSlot(const T& product);
+
+    // Lay out the shifts of every scenario and make room for the rows
+    void Layout();
+
+    // Value the row of a slot on the current curve
+    void ValueRow(int slot);
+
+    // Add quantity times the row of a slot to the totals
+    void AddToTotals(int slot, double quantity);
+
+public:
+    // ctor
+    ScenarioEngine(ThreadPool* _pool, const ZeroCurve& _curve, uint64_t _revalueInterval = 10000,
+        int _sampleEvery = 10000, size_t _historySize = 1001);
+
+    // Add a scenario, revaluing every row
+    void AddScenario(const CurveScenario& scenario);
+
+    // Add parallel shifts, twists and butterflies from 5bp up to the given size in 5bp steps, both ways
+    void AddStandardScenarios(double maxBp = 100);
+
+    // Add a shock scenario for each move between successive sampled curves, up to a count, the latest first
+    int AddHistoricalScenarios(int count);
+
+    // Update the position of a product
+    void OnPosition(const Position<T>& position);
+
+    // Take a new curve, revaluing if the interval has passed
+    void OnCurve(const ZeroCurve& newCurve);
+
+    // Revalue every row on the current curve and rebuild the totals
+    void Revalue();
+
+    // Revalue if a curve arrived since the last revaluation
+    void Flush();
+
+    // Get the number of scenarios
+    int GetScenarioCount() const;
+
+    // Get a scenario
+    const CurveScenario& GetScenario(int scenario) const;
+
+    // Get the portfolio P&L of a scenario
+    double GetScenarioPnL(int scenario) const;
+
+    // Get the P&L of a product's position under a scenario
+    double GetProductScenarioPnL(const string& productId, int scenario) const;
+
+    // Get the scenario with the lowest portfolio P&L, or -1 without scenarios
+    int GetWorstScenario() const;
+
+    // Get the number of full revaluations
+    long GetRevaluationCount() const;
+};
+
+
+/**
+ * @brief Construct the engine with no scenario and no position.
+ *
+ * @tparam T The type of the product.
+ * @param _pool The thread pool full revaluations run on.
+ * @param _curve The starting curve.
+ * @param _revalueInterval The shortest replay time between two revaluations on new curves.
+ * @param _sampleEvery The number of curve updates between two samples of the history.
+ * @param _historySize The number of sampled curves kept.
+ */
+template <typename T>
+ScenarioEngine<T>::ScenarioEngine(ThreadPool* _pool, const ZeroCurve& _curve, uint64_t _revalueInterval,
+    int _sampleEvery, size_t _historySize) :
+    pool(_pool), curve(_curve), padded_count(0), revalue_interval(_revalueInterval), last_revalue(0),
+    curve_dirty(false), revaluation_count(0), sample_every(_sampleEvery), curve_updates(0), history_size(_historySize)
+{
+}
+
+template <typename T>
+int ScenarioEngine<T>::GetSlot(const T& product)
+{
+    int index = GetProductIndex(product.GetProductId());
+    if (index >= (int)product_slots.size())
+        product_slots.resize(index + 1, -1);
+    if (product_slots[index] != -1)
+        return product_slots[index];
+
+    int slot = products.size();
+    product_slots[index] = slot;
+    products.push_back(product);
+    cash_flows.push_back(MakeCurveCashFlows(product.GetCoupon(), product.GetMaturityDate(), curve.GetPillarTimes()));
+    quantities.push_back(0.0);
+    rows.resize(rows.size() + padded_count, 0.0);
+    ValueRow(slot);
+    return slot;
+}
+
+/**
+ * @brief Value the row of a slot on the current curve.
+ *
+ * Each cash flow is discounted once on the base curve, then scaled by the discount factor
+ * of its interpolated shift under every scenario.
+ *
+ * @tparam T The type of the product.
+ * @param slot The slot of the product.
+ */
+template <typename T>
+void ScenarioEngine<T>::ValueRow(int slot)
+{
+    double* row = rows.data() + size_t(slot) * padded_count;
+    fill(row, row + padded_count, 0.0);
+    const array<double, CURVE_PILLARS>& zeros = curve.GetZeroRates();
+    double base_price = 0;
+    for (const CurveCashFlow& f : cash_flows[slot])
+    {
+        double z = f.lowWeight * zeros[f.lowPillar] + f.highWeight * zeros[f.highPillar];
+        double base = f.amount * exp(-z * f.time);
+        base_price += base;
+        const double* low = pillar_shifts.data() + size_t(f.lowPillar) * padded_count;
+        const double* high = pillar_shifts.data() + size_t(f.highPillar) * padded_count;
+        for (int s = 0; s < padded_count; ++s)
+            row[s] += base * exp(-(f.lowWeight * low[s] + f.highWeight * high[s]) * f.time);
+    }
+    for (int s = 0; s < padded_count; ++s)
+        row[s] = (row[s] - base_price) / 100;
+    for (int s = scenarios.size(); s < padded_count; ++s)
+        row[s] = 0;
+}
+
+template <typename T>
+void ScenarioEngine<T>::AddToTotals(int slot, double quantity)
+{
+    const double* row = rows.data() + size_t(slot) * padded_count;
+    double* sums = totals.data();
+    for (int s = 0; s < padded_count; s += SCENARIO_LANES)
+        for (int k = 0; k < SCENARIO_LANES; ++k)
+            sums[s + k] += quantity * row[s + k];
+}
+
+template <typename T>
+void ScenarioEngine<T>::Layout()
+{
+    padded_count = (scenarios.size() + SCENARIO_LANES - 1) / SCENARIO_LANES * SCENARIO_LANES;
+    pillar_shifts.assign(size_t(CURVE_PILLARS) * padded_count, 0.0);
+    for (size_t s = 0; s < scenarios.size(); ++s)
+        for (int i = 0; i < CURVE_PILLARS; ++i)
+            pillar_shifts[size_t(i) * padded_count + s] = scenarios[s].shifts[i];
+    rows.assign(products.size() * padded_count, 0.0);
+}
+
+/**
+ * @brief Add a scenario, revaluing every row.
+ *
+ * @tparam T The type of the product.
+ * @param scenario The scenario.
+ */
+template <typename T>
+void ScenarioEngine<T>::AddScenario(const CurveScenario& scenario)
+{
+    scenarios.push_back(scenario);
+    Layout();
+    Revalue();
+}
+
+template <typename T>
+void ScenarioEngine<T>::AddStandardScenarios(double maxBp)
+{
+    const array<double, CURVE_PILLARS>& times = curve.GetPillarTimes();
+    for (double bp = 5; bp <= maxBp; bp += 5)
+    {
+        for (double sign : { 1.0, -1.0 })
+        {
+            scenarios.push_back(MakeParallelScenario(sign * bp));
+            scenarios.push_back(MakeTwistScenario(sign * bp, times[CURVE_PILLARS / 2], times));
+            scenarios.push_back(MakeButterflyScenario(sign * bp, times[CURVE_PILLARS / 2], times));
+        }
+    }
+    Layout();
+    Revalue();
+}
+
+/**
+ * @brief Add a shock scenario for each move between successive sampled curves.
+ *
+ * @tparam T The type of the product.
+ * @param count The largest number of scenarios to add.
+ * @return The number of scenarios added.
+ */
+template <typename T>
+int ScenarioEngine<T>::AddHistoricalScenarios(int count)
+{
+    int added = 0;
+    for (int i = history.size() - 1; i > 0 && added < count; --i, ++added)
+    {
+        CurveScenario scenario{ "historical " + to_string(added + 1), HISTORICAL_SHOCK, {} };
+        for (int p = 0; p < CURVE_PILLARS; ++p)
+            scenario.shifts[p] = history[i][p] - history[i - 1][p];
+        scenarios.push_back(scenario);
+    }
+    if (added > 0)
+    {
+        Layout();
+        Revalue();
+    }
+    return added;
+}
+
+/**
+ * @brief Update the position of a product.
+ *
+ * Only the product's contribution to the totals moves, by the change in its aggregate
+ * quantity times its row.
+ *
+ * @tparam T The type of the product.
+ * @param position The new position of the product.
+ */
+template <typename T>
+void ScenarioEngine<T>::OnPosition(const Position<T>& position)
+{
+    int slot = GetSlot(position.GetProduct());
+    double quantity = position.GetAggregatePosition();
+    double delta = quantity - quantities[slot];
+    if (delta == 0)
+        return;
+    quantities[slot] = quantity;
+    AddToTotals(slot, delta);
+}
+
+template <typename T>
+void ScenarioEngine<T>::OnCurve(const ZeroCurve& newCurve)
+{
+    curve = newCurve;
+    curve_dirty = true;
+    if (++curve_updates % sample_every == 0)
+    {
+        history.push_back(curve.GetZeroRates());
+        if (history.size() > history_size)
+            history.pop_front();
+    }
+
+    if (g_replay_time - last_revalue >= revalue_interval)
+    {
+        last_revalue = g_replay_time;
+        Revalue();
+    }
+}
+
+/**
+ * @brief Revalue every row on the current curve and rebuild the totals.
+ *
+ * The rows are valued across the thread pool, one product per iteration.
+ *
+ * @tparam T The type of the product.
+ */
+template <typename T>
+void ScenarioEngine<T>::Revalue()
+{
+    curve_dirty = false;
+    ++revaluation_count;
+    pool->ParallelFor(products.size(), [this](size_t slot) { ValueRow(slot); });
+    totals.assign(padded_count, 0.0);
+    for (size_t slot = 0; slot < products.size(); ++slot)
+        AddToTotals(slot, quantities[slot]);
+}
+
+template <typename T>
+void ScenarioEngine<T>::Flush()
+{
+    if (curve_dirty)
+        Revalue();
+}
+
+template <typename T>
+int ScenarioEngine<T>::GetScenarioCount() const
+{
+    return scenarios.size();
+}
+
+template <typename T>
+const CurveScenario& ScenarioEngine<T>::GetScenario(int scenario) const
+{
+    return scenarios[scenario];
+}
+
+template <typename T>
+double ScenarioEngine<T>::GetScenarioPnL(int scenario) const
+{
+    return totals[scenario];
+}
+
+template <typename T>
+double ScenarioEngine<T>::GetProductScenarioPnL(const string& productId, int scenario) const
+{
+    auto found = g_product_index.find(productId);
+    if (found == g_product_index.end() || found->second >= (int)product_slots.size() || product_slots[found->second] == -1)
+        return 0.0;
+    int slot = product_slots[found->second];
+    return quantities[slot] * rows[size_t(slot) * padded_count + scenario];
+}
+
+template <typename T>
+int ScenarioEngine<T>::GetWorstScenario() const
+{
+    if (scenarios.empty())
+        return -1;
+    return min_element(totals.begin(), totals.begin() + scenarios.size()) - totals.begin();
+}
+
+template <typename T>
+long ScenarioEngine<T>::GetRevaluationCount() const
+{
+    return revaluation_count;
+}
+
+#endif
@@ -0,0 +1,329 @@
+/**
+ * @file ShardedPositionService.hpp
+ * @brief Header file for the ShardedPositionService class template.
+ *
+ * This file contains the definition and implementation of the position keeper that spreads
+ * products over shards, each owned by one worker thread fed through lock-free queues.
+ */
+
+#ifndef SHARDED_POSITION_SERVICE_HPP
+#define SHARDED_POSITION_SERVICE_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include "SPSCQueue.hpp"
+#include "ProductIndex.hpp"
+#include "TradeBookingService.hpp"
+
+using namespace std;
+
+/**
+ * Position keeper sharded by product across worker threads.
+ * Every product hashes to one shard, and only the worker of that shard writes its positions,
+ * so positions need no lock. Each producer thread, one per trade source, gets its own
+ * single-producer single-consumer queue to every shard and must only submit under its own
+ * number. Workers apply trades in batches and publish their positions as atomics, with a
+ * sequence number around each batch so the total and applied count of a shard can be read
+ * as one consistent snapshot from any thread.
+ * Products must be registered in the product index before producer threads start.
+ * Type T is the product type.
+ */
+template<typename T>
+class ShardedPositionService
+{
+private:
+    struct PositionUpdate
+    {
+        int productIndex;
+        int bookIndex;
+        double quantity;    // signed, negative for sells
+    };
+
+    struct Shard
+    {
+        vector<unique_ptr<SPSCQueue<PositionUpdate>>> queues;   // indexed by producer
+        unique_ptr<atomic<double>[]> aggregates;                // indexed by product index
+        unique_ptr<atomic<double>[]> book_positions;            // productIndex * MAX_BOOKS + bookIndex
+        atomic<uint64_t> version;       // odd while a batch is being applied
+        atomic<double> total;           // aggregate position summed across the shard's products
+        atomic<uint64_t> applied;       // number of trades applied
+        thread worker;
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    int producer_count;
+    atomic<bool> running;
+
+    // Get the shard a product hashes to
+    int GetShard(int productIndex) const;
+
+    // Apply the queued trades of a shard until stopped
+    void Work(Shard& shard);
+
+public:
+    // ctor
+    ShardedPositionService(int shardCount, int producerCount = 1, size_t queueCapacity = 4096);
+
+    // dtor, stops the workers once every queued trade is applied
+    ~ShardedPositionService();
+
+    ShardedPositionService(const ShardedPositionService&) = delete;
+    ShardedPositionService& operator=(const ShardedPositionService&) = delete;
+
+    // Queue a trade from a producer to the shard of its product
+    void Submit(int producer, const Trade<T>& trade);
+
+    // Wait until every trade submitted so far is applied
+    void Sync() const;
+
+    // Get the aggregate position of a product
+    double GetAggregatePosition(const string& productId) const;
+
+    // Get the position of a product in a book
+    double GetBookPosition(const string& productId, int bookIndex) const;
+
+    // Get the aggregate position across every product and the trades it reflects, from one snapshot of each shard
+    void GetSnapshot(double& totalPosition, uint64_t& appliedCount) const;
+
+    // Get the aggregate position across every product
+    double GetTotalPosition() const;
+
+    // Get the number of trades applied
+    uint64_t GetAppliedCount() const;
+
+    // Get the number of shards
+    int GetShardCount() const;
+};
+
+
+/**
+ * @brief Construct the service and start one worker per shard.
+ *
+ * @tparam T The type of the product.
+ * @param shardCount The number of shards and worker threads.
+ * @param producerCount The number of producer threads submitting trades.
+ * @param queueCapacity The capacity of each producer to shard queue, a power of two.
+ */
+template <typename T>
+ShardedPositionService<T>::ShardedPositionService(int shardCount, int producerCount, size_t queueCapacity) :
+    producer_count(producerCount), running(true)
+{
+    if (shardCount < 1 || producerCount < 1)
+        throw invalid_argument("A sharded position service needs at least one shard and one producer");
+    for (int s = 0; s < shardCount; ++s)
+    {
+        unique_ptr<Shard> shard(new Shard);
+        for (int p = 0; p < producerCount; ++p)
+            shard->queues.emplace_back(new SPSCQueue<PositionUpdate>(queueCapacity));
+        shard->aggregates.reset(new atomic<double>[MAX_PRODUCTS]);
+        shard->book_positions.reset(new atomic<double>[MAX_PRODUCTS * MAX_BOOKS]);
+        for (int i = 0; i < MAX_PRODUCTS; ++i)
+            shard->aggregates[i].store(0.0, memory_order_relaxed);
+        for (int i = 0; i < MAX_PRODUCTS * MAX_BOOKS; ++i)
+            shard->book_positions[i].store(0.0, memory_order_relaxed);
+        shard->version.store(0, memory_order_relaxed);
+        shard->total.store(0.0, memory_order_relaxed);
+        shard->applied.store(0, memory_order_relaxed);
+        shards.push_back(move(shard));
+    }
+    for (auto& shard : shards)
+        shard->worker = thread(&ShardedPositionService<T>::Work, this, ref(*shard));
+}
+
+template <typename T>
+ShardedPositionService<T>::~ShardedPositionService()
+{
+    running.store(false, memory_order_release);
+    for (auto& shard : shards)
+        shard->worker.join();
+}
+
+template <typename T>
+int ShardedPositionService<T>::GetShard(int productIndex) const
+{
+    return ((uint32_t(productIndex) * 2654435761u) >> 16) % shards.size();
+}
+
+/**
+ * @brief Apply the queued trades of a shard until stopped.
+ *
+ * The worker drains up to a batch from each producer queue in turn and applies it inside one
+ * snapshot version. When every queue is empty it yields, then sleeps, so an idle shard
+ * leaves its core to the producers.
+ *
+ * @tparam T The type of the product.
+ * @param shard The shard owned by the calling worker.
+ */
+template <typename T>
+void ShardedPositionService<T>::Work(Shard& shard)
+{
+    const int BATCH_SIZE = 256;
+    PositionUpdate batch[BATCH_SIZE];
+    int idle = 0;
+    while (true)
+    {
+        bool stopping = !running.load(memory_order_acquire);
+        bool drained = true;
+        for (auto& queue : shard.queues)
+        {
+            int n = 0;
+            while (n < BATCH_SIZE && queue->TryPop(batch[n]))
+                ++n;
+            if (n == 0)
+                continue;
+            drained = false;
+
+            uint64_t version = shard.version.load(memory_order_relaxed);
+            shard.version.store(version + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            double total = shard.total.load(memory_order_relaxed);
+            for (int i = 0; i < n; ++i)
+            {
+                const PositionUpdate& update = batch[i];
+                atomic<double>& aggregate = shard.aggregates[update.productIndex];
+                atomic<double>& book = shard.book_positions[update.productIndex * MAX_BOOKS + update.bookIndex];
+                aggregate.store(aggregate.load(memory_order_relaxed) + update.quantity, memory_order_relaxed);
+                book.store(book.load(memory_order_relaxed) + update.quantity, memory_order_relaxed);
+                total += update.quantity;
+            }
+            shard.total.store(total, memory_order_relaxed);
+            shard.applied.store(shard.applied.load(memory_order_relaxed) + n, memory_order_release);
+            shard.version.store(version + 2, memory_order_release);
+        }
+
+        if (!drained)
+        {
+            idle = 0;
+        }
+        else if (stopping)
+        {
+            return;
+        }
+        else if (++idle < 64)
+        {
+            this_thread::yield();
+        }
+        else
+        {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+}
+
+/**
+ * @brief Queue a trade from a producer to the shard of its product.
+ *
+ * Waits for room if the queue is full.
+ *
+ * @tparam T The type of the product.
+ * @param producer The number of the calling producer, below the producer count.
+ * @param trade The trade.
+ * @throws out_of_range if the product is not registered in the product index.
+ */
+template <typename T>
+void ShardedPositionService<T>::Submit(int producer, const Trade<T>& trade)
+{
+    auto found = g_product_index.find(trade.GetProduct().GetProductId());
+    if (found == g_product_index.end())
+        throw out_of_range("Product " + trade.GetProduct().GetProductId() + " is not registered");
+    PositionUpdate update{ found->second, trade.GetBookIndex(),
+        trade.GetSide() == BUY ? trade.GetQuantity() : -trade.GetQuantity() };
+    SPSCQueue<PositionUpdate>& queue = *shards[GetShard(found->second)]->queues[producer];
+    while (!queue.TryPush(update))
+        this_thread::yield();
+}
+
+template <typename T>
+void ShardedPositionService<T>::Sync() const
+{
+    for (const auto& shard : shards)
+    {
+        uint64_t pushed = 0;
+        for (const auto& queue : shard->queues)
+            pushed += queue->GetPushedCount();
+        while (shard->applied.load(memory_order_acquire) < pushed)
+            this_thread::yield();
+    }
+}
+
+template <typename T>
+double ShardedPositionService<T>::GetAggregatePosition(const string& productId) const
+{
+    auto found = g_product_index.find(productId);
+    if (found == g_product_index.end())
+        return 0.0;
+    return shards[GetShard(found->second)]->aggregates[found->second].load(memory_order_acquire);
+}
+
+template <typename T>
+double ShardedPositionService<T>::GetBookPosition(const string& productId, int bookIndex) const
+{
+    auto found = g_product_index.find(productId);
+    if (found == g_product_index.end())
+        return 0.0;
+    return shards[GetShard(found->second)]->book_positions[found->second * MAX_BOOKS + bookIndex].load(memory_order_acquire);
+}
+
+/**
+ * @brief Get the aggregate position across every product and the trades it reflects.
+ *
+ * Each shard is read between two equal even versions, so its total and applied count
+ * come from the same batch.
+ *
+ * @tparam T The type of the product.
+ * @param totalPosition The aggregate position summed across shards.
+ * @param appliedCount The number of trades applied to that position.
+ */
+template <typename T>
+void ShardedPositionService<T>::GetSnapshot(double& totalPosition, uint64_t& appliedCount) const
+{
+    totalPosition = 0;
+    appliedCount = 0;
+    for (const auto& shard : shards)
+    {
+        uint64_t before, after, applied;
+        double total;
+        do
+        {
+            before = shard->version.load(memory_order_acquire);
+            total = shard->total.load(memory_order_relaxed);
+            applied = shard->applied.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            after = shard->version.load(memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+        totalPosition += total;
+        appliedCount += applied;
+    }
+}
+
+template <typename T>
+double ShardedPositionService<T>::GetTotalPosition() const
+{
+    double total;
+    uint64_t applied;
+    GetSnapshot(total, applied);
+    return total;
+}
+
+template <typename T>
+uint64_t ShardedPositionService<T>::GetAppliedCount() const
+{
+    uint64_t applied = 0;
+    for (const auto& shard : shards)
+        applied += shard->applied.load(memory_order_acquire);
+    return applied;
+}
+
+template <typename T>
+int ShardedPositionService<T>::GetShardCount() const
+{
+    return shards.size();
+}
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * @file SmartOrderRouter.hpp
+ * @brief Header file for the SmartOrderRouter class template.
+ *
+ * This file contains the definition and implementation of the router that splits execution
+ * orders across BROKERTEC, ESPEED and CME from the displayed liquidity, fees and latency of
+ * each venue.
+ */
+
+#ifndef SMART_ORDER_ROUTER_HPP
+#define SMART_ORDER_ROUTER_HPP
+
+#include <array>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "SOA.hpp"
+#include "CompactId.hpp"
+#include "ProductIndex.hpp"
+#include "MarketDataService.hpp"
+#include "ExecutionService.hpp"
+
+using namespace std;
+
+const int VENUE_COUNT = 3;
+
+/**
+ * Precomputed routing of one product and side: the venues from the cheapest effective price
+ * to the most expensive, with the quantity displayed at the touch of each.
+ */
+struct RouteTable
+{
+    array<Market, VENUE_COUNT> venues;
+    array<long, VENUE_COUNT> displayed;
+    bool valid;
+};
+
+
+/**
+ * Smart order router splitting execution orders across venues.
+ * The routing of each product is recomputed on every book update, so routing an order
+ * only walks the venues once. Routed orders are not kept here; each venue leg has its own
+ * id and is tracked by the execution service.
+ * Keyed on order identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class SmartOrderRouter : public Service<CompactId, ExecutionOrder<T> >
+{
+private:
+    SimulatedExchange* exchange;
+    double latency_cost;                    // price points of adverse selection per microsecond
+    vector<array<RouteTable, 2>> routes;    // indexed by product index, then side of the order
+
+public:
+    // ctor
+    SmartOrderRouter(SimulatedExchange* _exchange, double _latencyCostPerMicro = (1.0 / 256) / 1000);
+
+    // Get data on our service given a key, which always throws as the router keeps no orders
+    ExecutionOrder<T>& GetData(CompactId key);
+
+    // The callback that a Connector should invoke for any new or updated data, routing the order
+    void OnMessage(ExecutionOrder<T>& data);
+
+    // Recompute the routing of a product after a book update
+    void OnMarketData(const OrderBook<T>& book);
+
+    // Split an order across venues and publish one order per venue
+    void Route(const ExecutionOrder<T>& order);
+};
+
+
+template <typename T>
+SmartOrderRouter<T>::SmartOrderRouter(SimulatedExchange* _exchange, double _latencyCostPerMicro) :
+    exchange(_exchange), latency_cost(_latencyCostPerMicro)
+{
+}
+
+/**
+ * @brief Get an order routed by the router.
+ *
+ * @tparam T The type of the product.
+ * @param key The order identifier.
+ * @throws out_of_range always, since routed orders live in the execution service.
+ */
+template <typename T>
+ExecutionOrder<T>& SmartOrderRouter<T>::GetData(CompactId key)
+{
+    throw out_of_range("The router keeps no orders; look up " + IdToString(key) + " on the execution service");
+}
+
+template <typename T>
+void SmartOrderRouter<T>::OnMessage(ExecutionOrder<T>& data)
+{
+    Route(data);
+}
+
+/**
+ * @brief Recompute the routing of a product after a book update.
+ *
+ * For each side, the effective price of a venue is its touch price made worse by its fee
+ * (per million of face, converted to price points) and by the cost of its latency. Venues
+ * are ranked on it once here, together with the street quantity displayed at their touch.
+ *
+ * @tparam T The type of the product.
+ * @param book The updated order book.
+ */
+template <typename T>
+void SmartOrderRouter<T>::OnMarketData(const OrderBook<T>& book)
+{
+    int index = GetProductIndex(book.GetProduct().GetProductId());
+    if (index >= (int)routes.size())
+        routes.resize(index + 1, array<RouteTable, 2>{ { RouteTable{ {}, {}, false }, RouteTable{ {}, {}, false } } });
+
+    for (PricingSide side : { BID, OFFER })
+    {
+        RouteTable& table = routes[index][side];
+        array<double, VENUE_COUNT> effective;
+        int count = 0;
+        for (Market market : { BROKERTEC, ESPEED, CME })
+        {
+            double price;
+            long quantity;
+            if (!exchange->GetBook(index, market).GetTouch(side == BID ? OFFER : BID, price, quantity))
+                continue;
+            const VenueConfig& config = exchange->GetVenueConfig(market);
+            double cost = config.feePerMillion / 10000.0 + config.latencyMicros * latency_cost;
+            effective[count] = side == BID ? price + cost : -(price - cost);
+            table.venues[count] = market;
+            table.displayed[count] = quantity;
+            ++count;
+        }
+        for (int i = 1; i < count; ++i)       // insertion sort, cheapest first
+        {
+            for (int j = i; j > 0 && effective[j] < effective[j - 1]; --j)
+            {
+                swap(effective[j], effective[j - 1]);
+                swap(table.venues[j], table.venues[j - 1]);
+                swap(table.displayed[j], table.displayed[j - 1]);
+            }
+        }
+        for (int i = count; i < VENUE_COUNT; ++i)
+            table.displayed[i] = 0;
+        table.valid = count > 0;
+    }
+}
+
+/**
+ * @brief Split an order across venues and publish one order per venue.
+ *
+ * The venues are filled in their precomputed order up to their displayed quantity, and
+ * whatever is left goes to the cheapest venue. Each venue order keeps the parent of the
+ * original order, and its id is the original id with the venue leg set, so the orders on
+ * different venues can be told apart downstream. Before any book update for the product,
+ * the whole order keeps the venue and id it already carries.
+ *
+ * @tparam T The type of the product.
+ * @param order The order to route.
+ */
+template <typename T>
+void SmartOrderRouter<T>::Route(const ExecutionOrder<T>& order)
+{
+    int index = GetProductIndex(order.GetProduct().GetProductId());
+    if (index >= (int)routes.size() || !routes[index][order.GetPricingSide()].valid)
+    {
+        ExecutionOrder<T> venue_order = order;
+        Service<CompactId, ExecutionOrder<T> >::Notify(venue_order);
+        return;
+    }
+
+    const RouteTable& table = routes[index][order.GetPricingSide()];
+    double total = order.GetVisibleQuantity();
+    array<double, VENUE_COUNT> legs{};
+    double remaining = total;
+    for (int i = 0; i < VENUE_COUNT && remaining > 0; ++i)
+    {
+        legs[i] = min(remaining, (double)table.displayed[i]);
+        remaining -= legs[i];
+    }
+    legs[0] += remaining;
+
+    for (int i = 0; i < VENUE_COUNT; ++i)
+    {
+        if (legs[i] <= 0)
+            continue;
+        double hidden = total > 0 ? order.GetHiddenQuantity() * legs[i] / total : 0;
+        ExecutionOrder<T> venue_order(order.GetProduct(), order.GetPricingSide(), MakeVenueLegId(order.GetOrderId(), table.venues[i]),
+            order.GetOrderType(), order.GetPrice(), legs[i], hidden, order.GetParentOrderId(), order.IsChildOrder());
+        venue_order.SetMarket(table.venues[i]);
+        Service<CompactId, ExecutionOrder<T> >::Notify(venue_order);
+    }
+}
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * @file StrategyRegistry.hpp
+ * @brief Header file for the StrategyRegistry class template.
+ *
+ * This file contains the definition and implementation of the registry that maps strategy
+ * names from configuration to the policy combinations of the algo execution and algo
+ * streaming services compiled into the program.
+ */
+
+#ifndef STRATEGY_REGISTRY_HPP
+#define STRATEGY_REGISTRY_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <functional>
+#include "PositionService.hpp"
+#include "AlgoExecutionService.hpp"
+#include "AlgoStreamingService.hpp"
+
+using namespace std;
+
+/**
+ * Registry of the algo strategies that can be selected by name at run time.
+ * Execution strategies are named "<trigger>-<sizing>-<side>", for example
+ * "wide-touch-alternate", the strategy the services default to; streaming strategies are
+ * named after their quote policy. Every combination is instantiated when the registry is
+ * built, so choosing one by name only picks a factory.
+ * Type T is the product type.
+ */
+template<typename T>
+class StrategyRegistry
+{
+private:
+    map<string, function<unique_ptr<AlgoExecutionServiceBase<T>>(const AlgoExecutionParams&)>> execution_strategies;
+    map<string, function<unique_ptr<AlgoStreamingServiceBase<T>>(const InventorySnapshot*)>> streaming_strategies;
+
+    // Register the execution strategies of a trigger and sizing with every side selection
+    template<typename Trigger, typename Sizing>
+    void RegisterSides(const string& prefix);
+
+public:
+    // ctor
+    StrategyRegistry();
+
+    // Register an execution strategy under a name
+    template<typename Trigger, typename Sizing, typename SideSelection>
+    void RegisterExecution(const string& name);
+
+    // Register a streaming strategy under a name
+    template<typename QuotePolicy>
+    void RegisterStreaming(const string& name);
+
+    // Build the execution service of a strategy
+    unique_ptr<AlgoExecutionServiceBase<T>> MakeExecution(const string& name, const AlgoExecutionParams& params = AlgoExecutionParams()) const;
+
+    // Build the streaming service of a strategy
+    unique_ptr<AlgoStreamingServiceBase<T>> MakeStreaming(const string& name, const InventorySnapshot* inventory = nullptr) const;
+
+    // Get the names of the execution strategies
+    vector<string> GetExecutionNames() const;
+
+    // Get the names of the streaming strategies
+    vector<string> GetStreamingNames() const;
+};
+
+
+template <typename T>
+StrategyRegistry<T>::StrategyRegistry()
+{
+    RegisterSides<WideSpreadTrigger, TouchSizing>("wide-touch-");
+    RegisterSides<WideSpreadTrigger, FixedSizing>("wide-fixed-");
+    RegisterSides<TightSpreadTrigger, TouchSizing>("tight-touch-");
+    RegisterSides<TightSpreadTrigger, FixedSizing>("tight-fixed-");
+    RegisterStreaming<SkewedQuote>("skewed");
+    RegisterStreaming<SymmetricQuote>("symmetric");
+}
+
+template <typename T>
+template <typename Trigger, typename Sizing>
+void StrategyRegistry<T>::RegisterSides(const string& prefix)
+{
+    RegisterExecution<Trigger, Sizing, AlternateSides>(prefix + "alternate");
+    RegisterExecution<Trigger, Sizing, FollowImbalance>(prefix + "follow");
+    RegisterExecution<Trigger, Sizing, FadeImbalance>(prefix + "fade");
+}
+
+template <typename T>
+template <typename Trigger, typename Sizing, typename SideSelection>
+void StrategyRegistry<T>::RegisterExecution(const string& name)
+{
+    execution_strategies[name] = [](const AlgoExecutionParams& params)
+    {
+        return unique_ptr<AlgoExecutionServiceBase<T>>(new AlgoExecutionService<T, Trigger, Sizing, SideSelection>(params));
+    };
+}
+
+template <typename T>
+template <typename QuotePolicy>
+void StrategyRegistry<T>::RegisterStreaming(const string& name)
+{
+    streaming_strategies[name] = [](const InventorySnapshot* inventory)
+    {
+        return unique_ptr<AlgoStreamingServiceBase<T>>(new AlgoStreamingService<T, QuotePolicy>(inventory));
+    };
+}
+
+/**
+ * @brief Build the execution service of a strategy.
+ *
+ * @tparam T The type of the product.
+ * @param name The name of the strategy.
+ * @param params The parameters of the strategy.
+ * @return The execution service.
+ * @throws out_of_range if no strategy has the name.
+ */
+template <typename T>
+unique_ptr<AlgoExecutionServiceBase<T>> StrategyRegistry<T>::MakeExecution(const string& name, const AlgoExecutionParams& params) const
+{
+    auto found = execution_strategies.find(name);
+    if (found == execution_strategies.end())
+        throw out_of_range("Unknown execution strategy " + name);
+    return found->second(params);
+}
+
+/**
+ * @brief Build the streaming service of a strategy.
+ *
+ * @tparam T The type of the product.
+ * @param name The name of the strategy.
+ * @param inventory The snapshot of positions and risk quoted off, or nullptr.
+ * @return The streaming service.
+ * @throws out_of_range if no strategy has the name.
+ */
+template <typename T>
+unique_ptr<AlgoStreamingServiceBase<T>> StrategyRegistry<T>::MakeStreaming(const string& name, const InventorySnapshot* inventory) const
+{
+    auto found = streaming_strategies.find(name);
+    if (found == streaming_strategies.end())
+        throw out_of_range("Unknown streaming strategy " + name);
+    return found->second(inventory);
+}
+
+template <typename T>
+vector<string> StrategyRegistry<T>::GetExecutionNames() const
+{
+    vector<string> names;
+    for (const auto& strategy : execution_strategies)
+        names.push_back(strategy.first);
+    return names;
+}
+
+template <typename T>
+vector<string> StrategyRegistry<T>::GetStreamingNames() const
+{
+    vector<string> names;
+    for (const auto& strategy : streaming_strategies)
+        names.push_back(strategy.first);
+    return names;
+}
+
+#endif
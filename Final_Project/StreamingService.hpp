@@ -1,9 +1,13 @@
 #ifndef STREAMING_SERVICE_HPP
 #define STREAMING_SERVICE_HPP
 
+#include <array>
 #include <string>
 #include <map>
+#include <vector>
 #include "SOA.hpp"
+#include "Throttle.hpp"
+#include "ProductIndex.hpp"
 #include "MarketDataService.hpp"
 
 /**
@@ -77,8 +81,14 @@ private:
 };
 
 
+// Capacity of the ladder on each side of a price stream
+const int MAX_STREAM_TIERS = 5;
+
 /**
  * Price Stream with a two-way market.
+ * Each side is a ladder of up to MAX_STREAM_TIERS price/size tiers stored inline,
+ * so the whole ladder is a single contiguous record. Tier 0 is the top of the ladder.
+ * The dense index of the product travels with the stream, like the price it is built from.
  * Type T is the product type.
  */
 template<typename T>
@@ -88,25 +98,45 @@ public:
     // ctor
     PriceStream() = default;
     PriceStream(const T& _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder);
+    PriceStream(const T& _product, int _productIndex, const array<PriceStreamOrder, MAX_STREAM_TIERS>& _bidTiers,
+        const array<PriceStreamOrder, MAX_STREAM_TIERS>& _offerTiers, int _tierCount);
 
     // Get the product
     const T& GetProduct() const;
 
-    // Get the bid order
+    // Get the bid order at the top of the ladder
     const PriceStreamOrder& GetBidOrder() const;
 
-    // Get the offer order
+    // Get the offer order at the top of the ladder
     const PriceStreamOrder& GetOfferOrder() const;
 
+    // Get the number of tiers on each side
+    int GetTierCount() const;
+
+    // Get the bid order of a tier
+    const PriceStreamOrder& GetBidTier(int tier) const;
+
+    // Get the offer order of a tier
+    const PriceStreamOrder& GetOfferTier(int tier) const;
+
+    // Get the dense index of the product
+    int GetProductIndex() const;
+
 private:
     T product;
-    PriceStreamOrder bidOrder;
-    PriceStreamOrder offerOrder;
+    int productIndex = -1;
+    int tierCount = 0;
+    array<PriceStreamOrder, MAX_STREAM_TIERS> bidTiers;
+    array<PriceStreamOrder, MAX_STREAM_TIERS> offerTiers;
 };
 
 
 /**
  * Streaming service to publish two-way prices.
+ * Quotes are rate limited per product by a token bucket timed on the count of quotes
+ * published to the service, so a replay streams the same quotes whatever the host speed.
+ * A quote that cannot be sent replaces the pending quote of its product, and pending
+ * quotes are released once their bucket refills.
  * Keyed on product identifier.
  * Type T is the product type.
  */
@@ -115,8 +145,26 @@ class StreamingService : public Service<string, PriceStream <T> >
 {
 private:
     map<string, PriceStream<T>> pricestreams;
+    uint64_t event_count;                   // quotes published so far, the clock of the buckets
+    long events_per_quote;
+    TokenBucket bucket_template;
+    vector<TokenBucket> buckets;            // indexed by product index
+    vector<PriceStream<T>> pending;         // latest unsent quote of each product
+    vector<char> has_pending;
+    vector<int> pending_products;
+    long sent_count;
+    long conflated_count;
+
+    // Make room for the per-product state of a product index
+    void Reserve(int productIndex);
+
+    // Send a quote to the listeners
+    void Send(PriceStream<T>& priceStream);
 
 public:
+    // ctor
+    StreamingService(long eventsPerQuote = 10, double burst = 20);
+
     // Get data on our service given a key
     PriceStream<T>& GetData(string key);
 
@@ -125,15 +173,27 @@ public:
 
     // Publish two-way prices
     void PublishPrice(PriceStream<T>& priceStream); 
+
+    // Send the pending quotes whose bucket has refilled
+    void ReleasePending();
+
+    // Send every pending quote regardless of the rate limit, at the end of a run
+    void Flush();
+
+    // Get the number of quotes sent
+    long GetSentCount() const;
+
+    // Get the number of quotes replaced by a newer quote before they could be sent
+    long GetConflatedCount() const;
 };
 
 
-PriceStreamOrder::PriceStreamOrder(double price, long visibleQuantity, long hiddenQuantity, PricingSide side)
+PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
 {
-    price = price;
-    visibleQuantity = visibleQuantity;
-    hiddenQuantity = hiddenQuantity;
-    side = side;
+    price = _price;
+    visibleQuantity = _visibleQuantity;
+    hiddenQuantity = _hiddenQuantity;
+    side = _side;
 }
 
 PricingSide PriceStreamOrder::GetSide() const
@@ -159,7 +219,16 @@ long PriceStreamOrder::GetHiddenQuantity() const
 
 template<typename T>
 PriceStream<T>::PriceStream(const T& _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder) :
-    product(_product), bidOrder(_bidOrder), offerOrder(_offerOrder)
+    product(_product), productIndex(::GetProductIndex(_product.GetProductId())), tierCount(1)
+{
+    bidTiers[0] = _bidOrder;
+    offerTiers[0] = _offerOrder;
+}
+
+template<typename T>
+PriceStream<T>::PriceStream(const T& _product, int _productIndex, const array<PriceStreamOrder, MAX_STREAM_TIERS>& _bidTiers,
+    const array<PriceStreamOrder, MAX_STREAM_TIERS>& _offerTiers, int _tierCount) :
+    product(_product), productIndex(_productIndex), tierCount(_tierCount), bidTiers(_bidTiers), offerTiers(_offerTiers)
 {
 }
 
@@ -172,15 +241,71 @@ const T& PriceStream<T>::GetProduct() const
 template<typename T>
 const PriceStreamOrder& PriceStream<T>::GetBidOrder() const
 {
-    return bidOrder;
+    return bidTiers[0];
 }
 
 template<typename T>
 const PriceStreamOrder& PriceStream<T>::GetOfferOrder() const
 {
-    return offerOrder;
+    return offerTiers[0];
 }
 
+template<typename T>
+int PriceStream<T>::GetTierCount() const
+{
+    return tierCount;
+}
+
+template<typename T>
+const PriceStreamOrder& PriceStream<T>::GetBidTier(int tier) const
+{
+    return bidTiers[tier];
+}
+
+template<typename T>
+const PriceStreamOrder& PriceStream<T>::GetOfferTier(int tier) const
+{
+    return offerTiers[tier];
+}
+
+template<typename T>
+int PriceStream<T>::GetProductIndex() const
+{
+    return productIndex;
+}
+
+
+/**
+ * @brief Construct the streaming service with a per-product quote rate limit.
+ *
+ * @tparam T The type of the product.
+ * @param eventsPerQuote The number of quotes published to the service, across all products,
+ * for each quote a product may send in the long run.
+ * @param burst The number of quotes a product can send back to back.
+ */
+template <typename T>
+StreamingService<T>::StreamingService(long eventsPerQuote, double burst) :
+    event_count(0), events_per_quote(max(1L, eventsPerQuote)), bucket_template(1.0 / events_per_quote, burst),
+    sent_count(0), conflated_count(0)
+{
+}
+
+template <typename T>
+void StreamingService<T>::Reserve(int productIndex)
+{
+    if (productIndex < (int)buckets.size())
+        return;
+    buckets.resize(productIndex + 1, bucket_template);
+    pending.resize(productIndex + 1);
+    has_pending.resize(productIndex + 1, 0);
+}
+
+template <typename T>
+void StreamingService<T>::Send(PriceStream<T>& priceStream)
+{
+    ++sent_count;
+    Service<string, PriceStream<T> >::Notify(priceStream);
+}
 
 template <typename T>
 PriceStream<T>& StreamingService<T>::GetData(string key)
@@ -194,10 +319,98 @@ void StreamingService<T>::OnMessage(PriceStream<T>& data)
     pricestreams[data.GetProduct().GetProductId()] = data;
 }
 
+/**
+ * @brief Publish a two-way price subject to the product's quote rate limit.
+ *
+ * Each published quote advances the clock of the buckets by one. If the product has a token
+ * and nothing pending, the quote is sent straight away; otherwise it becomes the pending quote
+ * of the product, conflating any older pending one. Once every quote interval, pending quotes
+ * of every product are given a chance to go out.
+ *
+ * @tparam T The type of the product.
+ * @param priceStream The price stream to publish.
+ */
 template <typename T>
 void StreamingService<T>::PublishPrice(PriceStream<T>& priceStream)
 {
-    Service<string, PriceStream<T> >::Notify(priceStream);
+    uint64_t now = ++event_count;
+    int index = priceStream.GetProductIndex();
+    Reserve(index);
+
+    if (has_pending[index])
+    {
+        pending[index] = priceStream;
+        ++conflated_count;
+    }
+    else if (buckets[index].TryConsume(now))
+    {
+        Send(priceStream);
+    }
+    else
+    {
+        pending[index] = priceStream;
+        has_pending[index] = 1;
+        pending_products.push_back(index);
+    }
+
+    if (now % events_per_quote == 0)
+        ReleasePending();
+}
+
+/**
+ * @brief Send the pending quotes whose bucket has refilled.
+ *
+ * @tparam T The type of the product.
+ */
+template <typename T>
+void StreamingService<T>::ReleasePending()
+{
+    uint64_t now = event_count;
+    for (size_t i = 0; i < pending_products.size();)
+    {
+        int index = pending_products[i];
+        if (buckets[index].TryConsume(now))
+        {
+            has_pending[index] = 0;
+            pending_products[i] = pending_products.back();
+            pending_products.pop_back();
+            Send(pending[index]);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+/**
+ * @brief Send every pending quote regardless of the rate limit.
+ *
+ * Meant for the end of a run, so the last quote of every product is always published.
+ *
+ * @tparam T The type of the product.
+ */
+template <typename T>
+void StreamingService<T>::Flush()
+{
+    for (int index : pending_products)
+    {
+        has_pending[index] = 0;
+        Send(pending[index]);
+    }
+    pending_products.clear();
+}
+
+template <typename T>
+long StreamingService<T>::GetSentCount() const
+{
+    return sent_count;
+}
+
+template <typename T>
+long StreamingService<T>::GetConflatedCount() const
+{
+    return conflated_count;
 }
 
 #endif
@@ -0,0 +1,261 @@
+/**
+ * @file TradeAllocator.hpp
+ * @brief Header file for the TradeAllocator class template.
+ *
+ * This file contains the definition and implementation of the engine that allocates every
+ * execution to the trading books, by rules configured per product and per strategy.
+ */
+
+#ifndef TRADE_ALLOCATOR_HPP
+#define TRADE_ALLOCATOR_HPP
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include "CompactId.hpp"
+#include "FlatHashMap.hpp"
+#include "ProductIndex.hpp"
+#include "ExecutionService.hpp"
+#include "TradeBookingService.hpp"
+
+using namespace std;
+
+// Allocation methods of a rule
+enum AllocationMethod { ROTATE_BOOKS, WEIGHTED_SPLIT };
+
+/**
+ * Rule allocating executions to books.
+ * Rotating books sends each whole execution to the next book of the rule in turn. A weighted
+ * split divides each execution across the books in proportion to their weights, in whole
+ * lots; the lots left over by rounding go to the books with the largest remainders, ties to
+ * the earlier book, and any quantity short of a lot goes to the book with the largest weight.
+ * Books are held as interned indices.
+ */
+struct AllocationRule
+{
+    AllocationMethod method = ROTATE_BOOKS;
+    vector<int> books;
+    vector<double> weights;
+    double lotSize = 1;
+};
+
+// Build a rule rotating executions across books
+AllocationRule MakeRotationRule(const vector<string>& bookNames)
+{
+    AllocationRule rule;
+    rule.method = ROTATE_BOOKS;
+    for (const auto& book : bookNames)
+        rule.books.push_back(GetBookIndex(book));
+    return rule;
+}
+
+// Build a rule splitting executions across books by weight, in whole lots
+AllocationRule MakeSplitRule(const vector<pair<string, double>>& bookWeights, double lotSize = 1)
+{
+    AllocationRule rule;
+    rule.method = WEIGHTED_SPLIT;
+    rule.lotSize = lotSize;
+    for (const auto& book : bookWeights)
+    {
+        rule.books.push_back(GetBookIndex(book.first));
+        rule.weights.push_back(book.second);
+    }
+    return rule;
+}
+
+
+/**
+ * Allocation engine from executions to booked trades.
+ * The rule of an execution is the first one set for, in order, its strategy and product, its
+ * product, its strategy, or the default rule, which rotates across the trading books. The
+ * strategy of an execution is the source of its order id, so spread-capture orders and the
+ * slices of parent orders can be allocated differently. Allocation is deterministic: it only
+ * depends on the rules and on the executions seen before.
+ * Type T is the product type.
+ */
+template<typename T>
+class TradeAllocator
+{
+private:
+    struct RuleState
+    {
+        AllocationRule rule;
+        double weightSum;
+        long rotation;
+    };
+
+    vector<RuleState> rules;                // rule 0 is the default
+    vector<int> product_rules;              // product index -> rule, -1 if none
+    vector<int> strategy_rules;             // id source -> rule, -1 if none
+    FlatHashMap<int> strategy_product_rules;    // id source << 32 | product index -> rule
+    vector<pair<double, int>> remainders;   // scratch for the largest remainders
+
+    // Store a rule and get its position
+    int AddRule(const AllocationRule& rule);
+
+    // Find the rule of an execution
+    RuleState& FindRule(IdSource strategy, int productIndex);
+
+public:
+    // ctor
+    TradeAllocator();
+
+    // Set the rule of executions with no more specific rule
+    void SetDefaultRule(const AllocationRule& rule);
+
+    // Set the rule of a product
+    void SetProductRule(const string& productId, const AllocationRule& rule);
+
+    // Set the rule of a strategy
+    void SetStrategyRule(IdSource strategy, const AllocationRule& rule);
+
+    // Set the rule of a strategy on a product
+    void SetRule(IdSource strategy, const string& productId, const AllocationRule& rule);
+
+    // Allocate the last fill of an execution to trades
+    void Allocate(const ExecutionOrder<T>& execution, uint64_t fillNumber, vector<Trade<T>>& trades);
+};
+
+
+template <typename T>
+TradeAllocator<T>::TradeAllocator() : product_rules(MAX_PRODUCTS, -1), strategy_rules(FILL_ID + 1, -1)
+{
+    AddRule(MakeRotationRule(books));
+}
+
+/**
+ * @brief Store a rule and get its position.
+ *
+ * @tparam T The type of the product.
+ * @param rule The rule.
+ * @return The position of the rule.
+ * @throws invalid_argument if the rule has no book, or a split has no positive weight.
+ */
+template <typename T>
+int TradeAllocator<T>::AddRule(const AllocationRule& rule)
+{
+    if (rule.books.empty())
+        throw invalid_argument("An allocation rule needs at least one book");
+    double weight_sum = 0;
+    if (rule.method == WEIGHTED_SPLIT)
+    {
+        if (rule.weights.size() != rule.books.size() || rule.lotSize <= 0)
+            throw invalid_argument("A split needs one weight per book and a positive lot size");
+        for (double weight : rule.weights)
+            weight_sum += max(0.0, weight);
+        if (weight_sum <= 0)
+            throw invalid_argument("A split needs a positive weight");
+    }
+    rules.push_back(RuleState{ rule, weight_sum, 0 });
+    return rules.size() - 1;
+}
+
+template <typename T>
+void TradeAllocator<T>::SetDefaultRule(const AllocationRule& rule)
+{
+    int position = AddRule(rule);
+    rules[0] = rules[position];
+    rules.pop_back();
+}
+
+template <typename T>
+void TradeAllocator<T>::SetProductRule(const string& productId, const AllocationRule& rule)
+{
+    product_rules[GetProductIndex(productId)] = AddRule(rule);
+}
+
+template <typename T>
+void TradeAllocator<T>::SetStrategyRule(IdSource strategy, const AllocationRule& rule)
+{
+    strategy_rules[strategy] = AddRule(rule);
+}
+
+template <typename T>
+void TradeAllocator<T>::SetRule(IdSource strategy, const string& productId, const AllocationRule& rule)
+{
+    strategy_product_rules[(uint64_t(strategy) << 32) | GetProductIndex(productId)] = AddRule(rule);
+}
+
+template <typename T>
+typename TradeAllocator<T>::RuleState& TradeAllocator<T>::FindRule(IdSource strategy, int productIndex)
+{
+    if (strategy_product_rules.GetSize() > 0)
+    {
+        const int* found = strategy_product_rules.Find((uint64_t(strategy) << 32) | productIndex);
+        if (found != nullptr)
+            return rules[*found];
+    }
+    if (product_rules[productIndex] != -1)
+        return rules[product_rules[productIndex]];
+    if (strategy < (int)strategy_rules.size() && strategy_rules[strategy] != -1)
+        return rules[strategy_rules[strategy]];
+    return rules[0];
+}
+
+/**
+ * @brief Allocate the last fill of an execution to trades.
+ *
+ * The trades are appended to the given vector, to be booked together. Their ids are fill ids
+ * numbered by the caller, tagged with the position of the trade in the allocation when a
+ * fill is split across several books.
+ *
+ * @tparam T The type of the product.
+ * @param execution The execution order whose last fill is allocated.
+ * @param fillNumber The sequence number of the fill.
+ * @param trades The vector the trades are appended to.
+ */
+template <typename T>
+void TradeAllocator<T>::Allocate(const ExecutionOrder<T>& execution, uint64_t fillNumber, vector<Trade<T>>& trades)
+{
+    const T& product = execution.GetProduct();
+    int index = GetProductIndex(product.GetProductId());
+    RuleState& state = FindRule(GetIdSource(execution.GetOrderId()), index);
+    const AllocationRule& rule = state.rule;
+    double quantity = execution.GetLastFillQuantity();
+    double price = execution.GetLastFillPrice();
+    Side side = execution.GetPricingSide() == BID ? BUY : SELL;
+
+    if (rule.method == ROTATE_BOOKS || rule.books.size() == 1)
+    {
+        int book = rule.books[state.rotation++ % rule.books.size()];
+        trades.push_back(Trade<T>(product, MakeId(FILL_ID, fillNumber), price, book, quantity, side));
+        return;
+    }
+
+    // Largest remainder in whole lots
+    int n = rule.books.size();
+    double lots = floor(quantity / rule.lotSize + 1e-9);
+    double odd = max(0.0, quantity - lots * rule.lotSize);
+    vector<double> shares(n);
+    double given = 0;
+    remainders.clear();
+    int largest = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        double weight = max(0.0, rule.weights[i]);
+        double exact = lots * weight / state.weightSum;
+        shares[i] = floor(exact + 1e-9);
+        given += shares[i];
+        remainders.push_back(make_pair(exact - shares[i], i));
+        if (weight > rule.weights[largest])
+            largest = i;
+    }
+    stable_sort(remainders.begin(), remainders.end(),
+        [](const pair<double, int>& a, const pair<double, int>& b) { return a.first > b.first; });
+    for (int i = 0; i < (int)(lots - given + 0.5) && i < n; ++i)
+        shares[remainders[i].second] += 1;
+
+    int tag = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        double booked = shares[i] * rule.lotSize + (i == largest ? odd : 0.0);
+        if (booked <= 0)
+            continue;
+        trades.push_back(Trade<T>(product, MakeId(FILL_ID, fillNumber, ++tag), price, rule.books[i], booked, side));
+    }
+}
+
+#endif
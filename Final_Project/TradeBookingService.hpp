@@ -2,16 +2,22 @@
 #define TRADE_BOOKING_SERVICE_HPP
 
 #include <string>
-#include <map>
+#include <vector>
+#include <stdexcept>
 #include "SOA.hpp"
+#include "CompactId.hpp"
+#include "Throttle.hpp"
+#include "ProductIndex.hpp"
+#include "TradeStore.hpp"
 
 using namespace std;
 
 // Trade sides
-enum Side { BUY, SELL };
+enum Side : int { BUY, SELL };
 
 /**
  * Trade object with a price, side, and quantity on a particular book.
+ * The book is held as its interned index.
  * Type T is the product type.
  */
 template<typename T>
@@ -20,13 +26,14 @@ class Trade
 public:
     // ctor for a trade
     Trade() = default;
-    Trade(const T& _product, string _tradeId, double _price, string _book, double _quantity, Side _side);
+    Trade(const T& _product, CompactId _tradeId, double _price, string _book, double _quantity, Side _side);
+    Trade(const T& _product, CompactId _tradeId, double _price, int _bookIndex, double _quantity, Side _side);
 
     // Get the product
     const T& GetProduct() const;
 
     // Get the trade ID
-    const string& GetTradeId() const;
+    CompactId GetTradeId() const;
 
     // Get the mid price
     double GetPrice() const;
@@ -34,6 +41,9 @@ public:
     // Get the book
     const string& GetBook() const;
 
+    // Get the index of the book
+    int GetBookIndex() const;
+
     // Get the quantity
     double GetQuantity() const;
 
@@ -42,24 +52,25 @@ public:
 
 private:
     T product;
-    string tradeId;
+    CompactId tradeId;
     double price;
-    string book;
+    int bookIndex;
     double quantity;
     Side side;
 };
 
-
 /**
  * Trade Booking Service to book Trades to a particular book.
- * Keyed on trade id.
+ * Keyed on trade id. Trades are kept in a columnar store, stamped with the replay time
+ * they were booked at.
  * Type T is the product type.
  */
 template<typename T>
-class TradeBookingService : public Service<string, Trade <T> >
+class TradeBookingService : public Service<CompactId, Trade <T> >
 {
 private:
-    map<string, Trade<T>> trades;
+    TradeStore<T> trades;
+    Trade<T> found;     // the last trade rebuilt by GetData
 
 public:
     // default constructor
@@ -68,24 +79,36 @@ public:
     // Book the trade
     void BookTrade(Trade<T>& trade);
 
+    // Book the trades allocated from one execution together
+    void BookTrades(vector<Trade<T>>& batch);
+
     // Get data on our service given a key
-    Trade<T>& GetData(string key);
+    Trade<T>& GetData(CompactId key);
+
+    // Get the store of the booked trades
+    const TradeStore<T>& GetStore() const;
     
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Trade <T>& data);
 };
 
 template<typename T>
-Trade<T>::Trade(const T& _product, string _tradeId, double _price, string _book, double _quantity, Side _side) :
+Trade<T>::Trade(const T& _product, CompactId _tradeId, double _price, string _book, double _quantity, Side _side) :
     product(_product)
 {
     tradeId = _tradeId;
     price = _price;
-    book = _book;
+    bookIndex = ::GetBookIndex(_book);
     quantity = _quantity;
     side = _side;
 }
 
+template<typename T>
+Trade<T>::Trade(const T& _product, CompactId _tradeId, double _price, int _bookIndex, double _quantity, Side _side) :
+    product(_product), tradeId(_tradeId), price(_price), bookIndex(_bookIndex), quantity(_quantity), side(_side)
+{
+}
+
 template<typename T>
 const T& Trade<T>::GetProduct() const
 {
@@ -93,7 +116,7 @@ const T& Trade<T>::GetProduct() const
 }
 
 template<typename T>
-const string& Trade<T>::GetTradeId() const
+CompactId Trade<T>::GetTradeId() const
 {
     return tradeId;
 }
@@ -107,7 +130,13 @@ double Trade<T>::GetPrice() const
 template<typename T>
 const string& Trade<T>::GetBook() const
 {
-    return book;
+    return GetBookName(bookIndex);
+}
+
+template<typename T>
+int Trade<T>::GetBookIndex() const
+{
+    return bookIndex;
 }
 
 template<typename T>
@@ -125,20 +154,58 @@ Side Trade<T>::GetSide() const
 template<typename T>
 void TradeBookingService<T>::BookTrade(Trade<T>& trade)
 {
-    Service<string, Trade<T> >::Notify(trade);
+    Service<CompactId, Trade<T> >::Notify(trade);
+}
+
+/**
+ * @brief Book the trades allocated from one execution together.
+ *
+ * Every trade of the batch is stored before any listener hears of one, so the batch is
+ * booked as a whole.
+ *
+ * @tparam T The type of the product.
+ * @param batch The trades to book.
+ */
+template<typename T>
+void TradeBookingService<T>::BookTrades(vector<Trade<T>>& batch)
+{
+    for (auto& trade : batch)
+        trades.Append(trade, g_replay_time);
+    for (auto& trade : batch)
+        Service<CompactId, Trade<T> >::Notify(trade);
+}
+
+/**
+ * @brief Get data on our service given a key.
+ *
+ * The trade is rebuilt from the store, so the reference stays valid until the next call.
+ *
+ * @tparam T The type of the product.
+ * @param key The trade id.
+ * @return The trade.
+ * @throws out_of_range if no trade has the id.
+ */
+template <typename T>
+Trade<T>& TradeBookingService<T>::GetData(CompactId key)
+{
+    int64_t row = trades.FindRow(key);
+    if (row == -1)
+        throw out_of_range("Unknown trade " + IdToString(key));
+    found = trades.GetTrade(row);
+    return found;
 }
 
 template <typename T>
-Trade<T>& TradeBookingService<T>::GetData(string key)
+const TradeStore<T>& TradeBookingService<T>::GetStore() const
 {
-    return trades[key];
+    return trades;
 }
 
 template <typename T>
 void TradeBookingService<T>::OnMessage(Trade <T>& data)
 {
-    trades[data.GetTradeId()] = data;
-    Service<string, Trade<T> >::Notify(data);
+    trades.Append(data, g_replay_time);
+    Service<CompactId, Trade<T> >::Notify(data);
 }
 
 #endif
@@ -0,0 +1,300 @@
+/**
+ * @file TradeStore.hpp
+ * @brief Header file for the TradeStore class template.
+ *
+ * This file contains the definition and implementation of the append-only columnar store
+ * the trade booking service keeps its trades in.
+ */
+
+#ifndef TRADE_STORE_HPP
+#define TRADE_STORE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "CompactId.hpp"
+#include "ChunkedArray.hpp"
+#include "FlatHashMap.hpp"
+#include "ProductIndex.hpp"
+
+using namespace std;
+
+// Declared in TradeBookingService.hpp
+enum Side : int;
+template<typename T>
+class Trade;
+
+/**
+ * Append-only columnar store of trades.
+ * Each field is its own chunked array, indexed by row, so a trade costs the size of its
+ * fields and a scan only touches the columns it reads. The row of a trade is its booking
+ * sequence number, and the booking time column never decreases, so sequence and time
+ * ranges are both contiguous runs of rows. Trade ids are found through an open-addressing
+ * table of rows that compares against the id column, and each product keeps the list of
+ * its rows. Products are stored once per product, not once per trade.
+ * Type T is the product type.
+ */
+template<typename T>
+class TradeStore
+{
+public:
+    // ctor
+    TradeStore();
+
+    // Append a trade booked at a replay time, returns its row
+    uint32_t Append(const Trade<T>& trade, uint64_t time);
+
+    // Get the row of a trade id, or -1
+    int64_t FindRow(CompactId tradeId) const;
+
+    // Rebuild the trade of a row
+    Trade<T> GetTrade(uint32_t row) const;
+
+    // Get the fields of a row
+    CompactId GetTradeId(uint32_t row) const;
+    int GetProductIndex(uint32_t row) const;
+    int GetBookIndex(uint32_t row) const;
+    Side GetSide(uint32_t row) const;
+    double GetPrice(uint32_t row) const;
+    double GetQuantity(uint32_t row) const;
+    uint64_t GetTime(uint32_t row) const;
+
+    // Get the number of trades
+    size_t GetSize() const;
+
+    // Call f(row) for every row with a sequence number in [first, last)
+    template<typename F>
+    void ScanSequence(uint64_t first, uint64_t last, F f) const;
+
+    // Call f(row) for every row booked in the replay times [from, to)
+    template<typename F>
+    void ScanTime(uint64_t from, uint64_t to, F f) const;
+
+    // Call f(row) for every row of a product, in booking order
+    template<typename F>
+    void ScanProduct(const string& productId, F f) const;
+
+    // Get the number of bytes allocated
+    size_t GetMemoryUsage() const;
+
+private:
+    ChunkedArray<CompactId> trade_ids;
+    ChunkedArray<uint16_t> product_indices;
+    ChunkedArray<uint8_t> book_indices;
+    ChunkedArray<uint8_t> sides;
+    ChunkedArray<double> prices;
+    ChunkedArray<double> quantities;
+    ChunkedArray<uint64_t> times;
+
+    vector<T> products;                             // indexed by product index
+    vector<ChunkedArray<uint32_t, 10>> product_rows;   // indexed by product index
+
+    vector<uint32_t> id_slots;      // row + 1 of the trade id homed there, 0 if empty
+    uint64_t id_mask;
+
+    // Get the home slot of a trade id
+    uint64_t Home(CompactId tradeId) const;
+
+    // Double the id table and reinsert every row
+    void Grow();
+
+    // Get the first row booked at or after a replay time
+    uint64_t LowerBoundTime(uint64_t time) const;
+};
+
+
+template <typename T>
+TradeStore<T>::TradeStore() : id_slots(1024, 0), id_mask(1023)
+{
+}
+
+template <typename T>
+uint64_t TradeStore<T>::Home(CompactId tradeId) const
+{
+    return MixKey(tradeId) & id_mask;
+}
+
+/**
+ * @brief Append a trade booked at a replay time.
+ *
+ * A trade id booked again keeps its first row in the id table; later rows are still
+ * scanned by sequence, time and product.
+ *
+ * @tparam T The type of the product.
+ * @param trade The trade.
+ * @param time The replay time of the booking, not before the previous one.
+ * @return The row of the trade.
+ */
+template <typename T>
+uint32_t TradeStore<T>::Append(const Trade<T>& trade, uint64_t time)
+{
+    uint32_t row = trade_ids.GetSize();
+    int index = ::GetProductIndex(trade.GetProduct().GetProductId());
+    if (index >= (int)products.size())
+    {
+        products.resize(index + 1);
+        product_rows.resize(index + 1);
+    }
+    if (product_rows[index].GetSize() == 0)
+        products[index] = trade.GetProduct();
+
+    trade_ids.PushBack(trade.GetTradeId());
+    product_indices.PushBack(index);
+    book_indices.PushBack(trade.GetBookIndex());
+    sides.PushBack(trade.GetSide());
+    prices.PushBack(trade.GetPrice());
+    quantities.PushBack(trade.GetQuantity());
+    times.PushBack(times.GetSize() > 0 ? max(time, times[row - 1]) : time);
+    product_rows[index].PushBack(row);
+
+    if (FindRow(trade.GetTradeId()) == -1)
+    {
+        if (2 * (row + 1) > id_slots.size())
+            Grow();
+        uint64_t i = Home(trade.GetTradeId());
+        while (id_slots[i] != 0)
+            i = (i + 1) & id_mask;
+        id_slots[i] = row + 1;
+    }
+    return row;
+}
+
+template <typename T>
+int64_t TradeStore<T>::FindRow(CompactId tradeId) const
+{
+    for (uint64_t i = Home(tradeId);; i = (i + 1) & id_mask)
+    {
+        if (id_slots[i] == 0)
+            return -1;
+        if (trade_ids[id_slots[i] - 1] == tradeId)
+            return id_slots[i] - 1;
+    }
+}
+
+template <typename T>
+void TradeStore<T>::Grow()
+{
+    vector<uint32_t> old_slots(id_slots.size() * 2, 0);
+    old_slots.swap(id_slots);
+    id_mask = id_slots.size() - 1;
+    for (uint32_t slot : old_slots)
+    {
+        if (slot == 0)
+            continue;
+        uint64_t i = Home(trade_ids[slot - 1]);
+        while (id_slots[i] != 0)
+            i = (i + 1) & id_mask;
+        id_slots[i] = slot;
+    }
+}
+
+template <typename T>
+Trade<T> TradeStore<T>::GetTrade(uint32_t row) const
+{
+    return Trade<T>(products[product_indices[row]], trade_ids[row], prices[row], (int)book_indices[row],
+        quantities[row], Side(sides[row]));
+}
+
+template <typename T>
+CompactId TradeStore<T>::GetTradeId(uint32_t row) const
+{
+    return trade_ids[row];
+}
+
+template <typename T>
+int TradeStore<T>::GetProductIndex(uint32_t row) const
+{
+    return product_indices[row];
+}
+
+template <typename T>
+int TradeStore<T>::GetBookIndex(uint32_t row) const
+{
+    return book_indices[row];
+}
+
+template <typename T>
+Side TradeStore<T>::GetSide(uint32_t row) const
+{
+    return Side(sides[row]);
+}
+
+template <typename T>
+double TradeStore<T>::GetPrice(uint32_t row) const
+{
+    return prices[row];
+}
+
+template <typename T>
+double TradeStore<T>::GetQuantity(uint32_t row) const
+{
+    return quantities[row];
+}
+
+template <typename T>
+uint64_t TradeStore<T>::GetTime(uint32_t row) const
+{
+    return times[row];
+}
+
+template <typename T>
+size_t TradeStore<T>::GetSize() const
+{
+    return trade_ids.GetSize();
+}
+
+template <typename T>
+template <typename F>
+void TradeStore<T>::ScanSequence(uint64_t first, uint64_t last, F f) const
+{
+    last = min<uint64_t>(last, GetSize());
+    for (uint64_t row = first; row < last; ++row)
+        f(uint32_t(row));
+}
+
+template <typename T>
+uint64_t TradeStore<T>::LowerBoundTime(uint64_t time) const
+{
+    uint64_t low = 0, high = GetSize();
+    while (low < high)
+    {
+        uint64_t middle = (low + high) / 2;
+        if (times[middle] < time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+template <typename T>
+template <typename F>
+void TradeStore<T>::ScanTime(uint64_t from, uint64_t to, F f) const
+{
+    ScanSequence(LowerBoundTime(from), LowerBoundTime(to), f);
+}
+
+template <typename T>
+template <typename F>
+void TradeStore<T>::ScanProduct(const string& productId, F f) const
+{
+    auto found = g_product_index.find(productId);
+    if (found == g_product_index.end() || found->second >= (int)product_rows.size())
+        return;
+    const ChunkedArray<uint32_t, 10>& rows = product_rows[found->second];
+    for (size_t i = 0; i < rows.GetSize(); ++i)
+        f(rows[i]);
+}
+
+template <typename T>
+size_t TradeStore<T>::GetMemoryUsage() const
+{
+    size_t bytes = trade_ids.GetMemoryUsage() + product_indices.GetMemoryUsage() + book_indices.GetMemoryUsage()
+        + sides.GetMemoryUsage() + prices.GetMemoryUsage() + quantities.GetMemoryUsage() + times.GetMemoryUsage()
+        + id_slots.capacity() * sizeof(uint32_t) + products.capacity() * sizeof(T);
+    for (const auto& rows : product_rows)
+        bytes += rows.GetMemoryUsage();
+    return bytes;
+}
+
+#endif
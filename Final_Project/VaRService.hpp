@@ -0,0 +1,337 @@
+/**
+ * @file VaRService.hpp
+ * @brief Header file for the VaRService class template.
+ *
+ * This file contains the definition and implementation of the service that keeps the
+ * historical-simulation value at risk and expected shortfall of the portfolio.
+ */
+
+#ifndef VAR_SERVICE_HPP
+#define VAR_SERVICE_HPP
+
+#include <cmath>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include "ProductIndex.hpp"
+#include "PricingService.hpp"
+#include "PositionService.hpp"
+
+using namespace std;
+
+/**
+ * Historical-simulation VaR and expected shortfall of the portfolio.
+ * Each day closes every product's mid and records its move since the previous close, as P&L
+ * per unit of face, into a ring buffer of the longest window. Days are laid out day-major, so
+ * the portfolio P&L of a closing day is one contiguous dot product of the quantities with its
+ * returns. The P&L of every day in the ring is kept at the current quantities: a position
+ * change only adds the change in quantity times the product's return on each day, and any
+ * window up to the longest reads the latest days straight from the ring.
+ * Days are counted in price ticks of each product, since a replay may tick one product
+ * through many days before the next one starts: every given number of its ticks, a product
+ * queues its mid as its close for its next day, and a day closes once every product has
+ * queued a close for it. Products given up front take part from the first day. A day also
+ * closes on CloseDay, at the current mids.
+ * Type T is the product type.
+ */
+template<typename T>
+class VaRService
+{
+private:
+    vector<int> product_slots;      // product index -> slot, -1 if none
+    int product_count;
+    int stride;                     // slots per day, a power of two at least the product count
+    vector<double> mids;            // indexed by slot
+    vector<double> closes;          // mid at the last close, indexed by slot
+    vector<char> priced;            // whether a mid has been seen, indexed by slot
+    vector<double> quantities;      // indexed by slot
+    vector<long> product_ticks;     // indexed by slot
+    vector<deque<double>> queued_closes;    // closes of the days a slot reached before the portfolio, indexed by slot
+    vector<double> day_ends;        // mids closing the next day, indexed by slot
+    int products_behind;            // slots with no queued close
+    vector<double> returns;         // ring day * stride + slot, P&L per unit of face over the day
+    vector<double> day_pnls;        // portfolio P&L of each ring day at the current quantities
+
+    size_t max_window;
+    size_t day_count;
+    long ticks_per_day;
+
+    // Get the slot of a product, adding it if new
+    int GetSlot(const string& productId);
+
+    // Record the moves of a day from the previous closes to the given mids
+    void RecordDay(const vector<double>& ends);
+
+    // Close every day all products have queued a close for
+    void CloseQueuedDays();
+
+    // Copy the P&L of the latest days into a buffer, oldest first
+    vector<double> GetWindow(size_t window) const;
+
+public:
+    // ctor
+    VaRService(size_t _maxWindow = 2500, long _ticksPerDay = 0, const vector<string>& productIds = {});
+
+    // Take a new mid, closing a day once every product has ticked through it
+    void OnPrice(const Price<T>& price);
+
+    // Update the position of a product
+    void OnPosition(const Position<T>& position);
+
+    // Record the day's moves since the previous close to the current mids and start a new day
+    void CloseDay();
+
+    // Get the loss not exceeded at a confidence level over the latest days of a window
+    double GetVaR(size_t window, double confidence = 0.99) const;
+
+    // Get the average loss beyond the VaR at a confidence level over the latest days of a window
+    double GetExpectedShortfall(size_t window, double confidence = 0.99) const;
+
+    // Get the portfolio P&L of a past day at the current quantities, 0 being the latest
+    double GetDayPnL(size_t daysAgo) const;
+
+    // Get the number of days closed
+    size_t GetDayCount() const;
+
+    // Get the longest window kept
+    size_t GetMaxWindow() const;
+};
+
+
+/**
+ * @brief Construct the service with no day closed.
+ *
+ * @tparam T The type of the product.
+ * @param _maxWindow The longest window in days, the number of days kept.
+ * @param _ticksPerDay The number of price ticks of each product in a day, 0 to only close on CloseDay.
+ * @param productIds The products whose ticks every day waits for from the start.
+ * @throws invalid_argument if the window is empty.
+ */
+template <typename T>
+VaRService<T>::VaRService(size_t _maxWindow, long _ticksPerDay, const vector<string>& productIds) :
+    product_count(0), stride(8), products_behind(0), max_window(_maxWindow), day_count(0), ticks_per_day(_ticksPerDay)
+{
+    if (max_window == 0)
+        throw invalid_argument("A VaR service needs a window of at least one day");
+    mids.assign(stride, 0.0);
+    closes.assign(stride, 0.0);
+    priced.assign(stride, 0);
+    quantities.assign(stride, 0.0);
+    product_ticks.assign(stride, 0);
+    queued_closes.resize(stride);
+    day_ends.assign(stride, 0.0);
+    returns.assign(max_window * stride, 0.0);
+    day_pnls.assign(max_window, 0.0);
+    for (const auto& id : productIds)
+        GetSlot(id);
+}
+
+/**
+ * @brief Get the slot of a product, adding it if new.
+ *
+ * When the slots run out the stride doubles and the returns are laid out again.
+ *
+ * @tparam T The type of the product.
+ * @param productId The product identifier.
+ * @return The slot.
+ */
+template <typename T>
+int VaRService<T>::GetSlot(const string& productId)
+{
+    int index = GetProductIndex(productId);
+    if (index >= (int)product_slots.size())
+        product_slots.resize(index + 1, -1);
+    if (product_slots[index] != -1)
+        return product_slots[index];
+
+    if (product_count == stride)
+    {
+        int new_stride = stride * 2;
+        vector<double> new_returns(max_window * new_stride, 0.0);
+        for (size_t d = 0; d < max_window; ++d)
+            copy(returns.begin() + d * stride, returns.begin() + (d + 1) * stride, new_returns.begin() + d * new_stride);
+        returns.swap(new_returns);
+        stride = new_stride;
+        mids.resize(stride, 0.0);
+        closes.resize(stride, 0.0);
+        priced.resize(stride, 0);
+        quantities.resize(stride, 0.0);
+        product_ticks.resize(stride, 0);
+        queued_closes.resize(stride);
+        day_ends.resize(stride, 0.0);
+    }
+    product_slots[index] = product_count;
+    ++products_behind;
+    return product_count++;
+}
+
+template <typename T>
+void VaRService<T>::OnPrice(const Price<T>& price)
+{
+    int slot = GetSlot(price.GetProduct().GetProductId());
+    mids[slot] = price.GetMid();
+    if (!priced[slot])
+    {
+        closes[slot] = mids[slot];
+        priced[slot] = 1;
+    }
+    if (ticks_per_day > 0 && ++product_ticks[slot] % ticks_per_day == 0)
+    {
+        queued_closes[slot].push_back(mids[slot]);
+        if (queued_closes[slot].size() == 1 && --products_behind == 0)
+            CloseQueuedDays();
+    }
+}
+
+template <typename T>
+void VaRService<T>::CloseQueuedDays()
+{
+    while (products_behind == 0)
+    {
+        for (int s = 0; s < product_count; ++s)
+        {
+            day_ends[s] = queued_closes[s].front();
+            queued_closes[s].pop_front();
+            if (queued_closes[s].empty())
+                ++products_behind;
+        }
+        RecordDay(day_ends);
+    }
+}
+
+/**
+ * @brief Update the position of a product.
+ *
+ * The P&L of every kept day moves by the change in quantity times the product's return on it.
+ *
+ * @tparam T The type of the product.
+ * @param position The new position of the product.
+ */
+template <typename T>
+void VaRService<T>::OnPosition(const Position<T>& position)
+{
+    int slot = GetSlot(position.GetProduct().GetProductId());
+    double delta = position.GetAggregatePosition() - quantities[slot];
+    if (delta == 0)
+        return;
+    quantities[slot] += delta;
+    size_t days = min(day_count, max_window);
+    const double* column = returns.data() + slot;
+    for (size_t d = 0; d < days; ++d)
+        day_pnls[d] += delta * column[d * stride];
+}
+
+template <typename T>
+void VaRService<T>::CloseDay()
+{
+    RecordDay(mids);
+}
+
+/**
+ * @brief Record the moves of a day from the previous closes to the given mids.
+ *
+ * The day overwrites the oldest one once the ring is full.
+ *
+ * @tparam T The type of the product.
+ * @param ends The mids closing the day, indexed by slot.
+ */
+template <typename T>
+void VaRService<T>::RecordDay(const vector<double>& ends)
+{
+    size_t ring = day_count % max_window;
+    double* row = returns.data() + ring * stride;
+    for (int s = 0; s < stride; ++s)
+    {
+        row[s] = (ends[s] - closes[s]) / 100;
+        closes[s] = ends[s];
+    }
+    const double* q = quantities.data();
+    double pnl = 0;
+    for (int s = 0; s < stride; ++s)
+        pnl += q[s] * row[s];
+    day_pnls[ring] = pnl;
+    ++day_count;
+}
+
+template <typename T>
+vector<double> VaRService<T>::GetWindow(size_t window) const
+{
+    if (window == 0 || window > max_window)
+        throw invalid_argument("A VaR window must be between 1 and " + to_string(max_window) + " days");
+    size_t days = min(window, day_count);
+    vector<double> pnls(days);
+    for (size_t i = 0; i < days; ++i)
+        pnls[i] = day_pnls[(day_count - days + i) % max_window];
+    return pnls;
+}
+
+/**
+ * @brief Get the loss not exceeded at a confidence level over the latest days of a window.
+ *
+ * The VaR is the loss of the k-th worst day, with k the number of days in the tail rounded up.
+ * Fewer days than the window are used while the history is shorter.
+ *
+ * @tparam T The type of the product.
+ * @param window The number of days, at most the longest window.
+ * @param confidence The confidence level, such as 0.99.
+ * @return The VaR as a positive loss, 0 before the first day.
+ * @throws invalid_argument if the window is empty or longer than the longest window.
+ */
+template <typename T>
+double VaRService<T>::GetVaR(size_t window, double confidence) const
+{
+    vector<double> pnls = GetWindow(window);
+    if (pnls.empty())
+        return 0.0;
+    size_t tail = max<size_t>(1, size_t(ceil((1 - confidence) * pnls.size() - 1e-9)));
+    nth_element(pnls.begin(), pnls.begin() + tail - 1, pnls.end());
+    return -pnls[tail - 1];
+}
+
+/**
+ * @brief Get the average loss beyond the VaR at a confidence level over the latest days of a window.
+ *
+ * @tparam T The type of the product.
+ * @param window The number of days, at most the longest window.
+ * @param confidence The confidence level, such as 0.99.
+ * @return The expected shortfall as a positive loss, 0 before the first day.
+ * @throws invalid_argument if the window is empty or longer than the longest window.
+ */
+template <typename T>
+double VaRService<T>::GetExpectedShortfall(size_t window, double confidence) const
+{
+    vector<double> pnls = GetWindow(window);
+    if (pnls.empty())
+        return 0.0;
+    size_t tail = max<size_t>(1, size_t(ceil((1 - confidence) * pnls.size() - 1e-9)));
+    nth_element(pnls.begin(), pnls.begin() + tail - 1, pnls.end());
+    double sum = 0;
+    for (size_t i = 0; i < tail; ++i)
+        sum += pnls[i];
+    return -sum / tail;
+}
+
+template <typename T>
+double VaRService<T>::GetDayPnL(size_t daysAgo) const
+{
+    if (daysAgo >= min(day_count, max_window))
+        throw out_of_range("Day " + to_string(daysAgo) + " is not kept");
+    return day_pnls[(day_count - 1 - daysAgo) % max_window];
+}
+
+template <typename T>
+size_t VaRService<T>::GetDayCount() const
+{
+    return day_count;
+}
+
+template <typename T>
+size_t VaRService<T>::GetMaxWindow() const
+{
+    return max_window;
+}
+
+#endif
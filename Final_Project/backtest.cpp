@@ -0,0 +1,45 @@
+/**
+ * @file backtest.cpp
+ * @brief Entry point for backtesting the algo execution strategy.
+ *
+ * This program replays recorded market data through the AlgoExecutionService for a grid of
+ * registered strategies and parameters, running the grid points across all cores, and writes one line of
+ * P&L and fill statistics per grid point to output/backtest.txt.
+ *
+ * Usage: ./backtest [market data file] [max books per run] [threads]
+ * The market data file defaults to data_generated/marketdata.txt, as written by the main
+ * program; a max of 0 replays the whole file, and 0 threads uses one per core.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <boost/date_time.hpp>
+#include "Products.hpp"
+#include "Listeners.hpp"
+#include "Backtester.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+
+int main(int argc, char* argv[])
+{
+    string file_name = argc > 1 ? argv[1] : "data_generated/marketdata.txt";
+    long max_books = argc > 2 ? atol(argv[2]) : 0;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    cout << microsec_clock::local_time() << "  Mapping market data from " << file_name << "..." << endl;
+    Backtester<Bond> backtester(file_name, max_books);
+
+    vector<pair<string, AlgoExecutionParams>> grid = Backtester<Bond>::MakeGrid(
+        { "wide-touch-alternate", "wide-touch-follow", "wide-touch-fade" },
+        { 1.0 / 256, 1.0 / 128, 1.0 / 64, 1.0 / 32 },
+        { 0.25, 0.5, 1.0 });
+    cout << microsec_clock::local_time() << "  Running " << grid.size() << " backtests..." << endl;
+    vector<BacktestResult> results = backtester.Sweep(grid, threads);
+
+    Backtester<Bond>::WriteReport("output/backtest.txt", results);
+    cout << microsec_clock::local_time() << "  Backtests finished, report written to output/backtest.txt.\n";
+    return 0;
+}
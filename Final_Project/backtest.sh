@@ -0,0 +1,8 @@
+#!/bin/bash
+# Compile the backtester
+g++ -std=c++17 -O2 -Wall -pthread -I. -I./utils -o backtest backtest.cpp
+# Notify user
+echo "Compilation finished. Executable file: backtest"
+
+# Needs data_generated/marketdata.txt from a run of final_project
+./backtest "$@"
@@ -0,0 +1,361 @@
+/**
+ * @file benchmark.cpp
+ * @brief Entry point for the per-trade cost benchmarks.
+ *
+ * This program books generated trades straight into the position service, first on its own
+ * and then with the risk and inventory listeners of the main program attached, and prints
+ * the average cost of one trade for each. It then marks a book of positions across many
+ * products to a stream of price ticks through the P&L service and prints the cost of a tick.
+ * It feeds the trades from one and two producer threads into the sharded position keeper at
+ * several shard counts and prints the throughput of each. It re-bootstraps the zero curve
+ * from benchmark ticks and prints the cost of a curve update. Last, it checks the scenario
+ * engine, the VaR service, the key-rate risk service and the hedge service against reference
+ * calculations done the slow way, and prints the largest relative difference of each.
+ *
+ * Usage: ./benchmark [trades] [repeats] [ticks] [products]
+ * The trades default to 1000000 and each measurement is the best of the repeats, 5 by default;
+ * the P&L run defaults to 7000000 ticks over 10000 products.
+ */
+
+#include <iostream>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <boost/date_time.hpp>
+#include "Products.hpp"
+#include "Listeners.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+
+// Build trades cycling across the products, books and sides
+vector<Trade<Bond>> MakeTrades(long count)
+{
+    vector<Bond> bonds;
+    for (const auto& id : g_product_Ids)
+        bonds.push_back(Bond(id, CUSIP, g_tickers[id], g_coupons[id], g_dates[id]));
+    vector<Trade<Bond>> trades;
+    trades.reserve(count);
+    for (long i = 0; i < count; ++i)
+        trades.push_back(Trade<Bond>(bonds[i % bonds.size()], MakeId(TRADE_ID, i), 100.0, books[(i / 7) % books.size()],
+            1000000.0 * (1 + i % 5), (i / 3) % 2 ? BUY : SELL));
+    return trades;
+}
+
+// Build products with generated identifiers
+vector<Bond> MakeBonds(int count)
+{
+    vector<Bond> bonds;
+    for (int i = 0; i < count; ++i)
+        bonds.push_back(Bond("BENCH" + to_string(i), CUSIP, "BENCH", 0.02, date(2032, 12, 31)));
+    return bonds;
+}
+
+// Get the best nanoseconds per tick of marking positions in every product to the ticks, replayed in a cycle
+double TimePerTick(const vector<Bond>& bonds, const vector<Price<Bond>>& ticks, long tickCount, int repeats)
+{
+    double best = 1e300;
+    for (int r = 0; r < repeats; ++r)
+    {
+        PnLService<Bond> pnl_service;
+        for (size_t i = 0; i < bonds.size(); ++i)
+            pnl_service.AddTrade(Trade<Bond>(bonds[i], MakeId(TRADE_ID, i), 99.5, books[i % books.size()], 1000000.0, BUY));
+
+        auto start = chrono::steady_clock::now();
+        for (long i = 0; i < tickCount; ++i)
+        {
+            ++g_replay_time;    // one input record per tick, as the pricing connector counts them
+            pnl_service.OnPrice(ticks[i & (ticks.size() - 1)]);
+        }
+        pnl_service.Flush();
+        auto end = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double, nano>(end - start).count() / tickCount);
+    }
+    return best;
+}
+
+// Get the best nanoseconds per benchmark tick of re-bootstrapping the curve, replayed in a cycle
+double TimePerCurveTick(const vector<Price<Bond>>& ticks, long tickCount, int repeats)
+{
+    double best = 1e300;
+    for (int r = 0; r < repeats; ++r)
+    {
+        CurveService<Bond> curve_service;
+        auto start = chrono::steady_clock::now();
+        for (long i = 0; i < tickCount; ++i)
+            curve_service.UpdateBenchmark(ticks[i % ticks.size()]);
+        auto end = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double, nano>(end - start).count() / tickCount);
+    }
+    return best;
+}
+
+// Get the best trades per second through a sharded keeper, each producer thread submitting its share of the trades
+double ShardedThroughput(const vector<Trade<Bond>>& trades, int shardCount, int producerCount, int repeats)
+{
+    double best = 0;
+    for (int r = 0; r < repeats; ++r)
+    {
+        ShardedPositionService<Bond> service(shardCount, producerCount);
+        auto start = chrono::steady_clock::now();
+        vector<thread> producers;
+        for (int p = 0; p < producerCount; ++p)
+            producers.emplace_back([&service, &trades, p, producerCount]()
+            {
+                for (size_t i = p; i < trades.size(); i += producerCount)
+                    service.Submit(p, trades[i]);
+            });
+        for (auto& producer : producers)
+            producer.join();
+        service.Sync();
+        auto end = chrono::steady_clock::now();
+        best = max(best, trades.size() / chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+// Get the price of a bond on a curve, discounting each cash flow at its interpolated zero rate
+double PriceOnCurve(const Bond& bond, const ZeroCurve& curve)
+{
+    double price = 0;
+    for (const CurveCashFlow& f : MakeCurveCashFlows(bond.GetCoupon(), bond.GetMaturityDate(), curve.GetPillarTimes()))
+        price += f.amount * curve.GetDiscountFactor(f.time);
+    return price;
+}
+
+// Get a copy of a curve with its pillar zero rates shifted
+ZeroCurve ShiftCurve(const ZeroCurve& curve, const array<double, CURVE_PILLARS>& shifts)
+{
+    ZeroCurve shifted = curve;
+    for (int i = 0; i < CURVE_PILLARS; ++i)
+        shifted.SetZeroRate(i, curve.GetZeroRates()[i] + shifts[i]);
+    return shifted;
+}
+
+// Get the largest difference of the scenario engine's incremental totals from repricing every position
+// on every shifted curve, relative to the largest total
+double CheckScenarioEngine(const vector<Bond>& bonds, const ZeroCurve& curve, long changes)
+{
+    ThreadPool pool;
+    ScenarioEngine<Bond> engine(&pool, curve);
+    engine.AddStandardScenarios();
+    vector<Position<Bond>> positions;
+    for (const auto& bond : bonds)
+        positions.push_back(Position<Bond>(bond));
+    mt19937 generator(7);
+    uniform_int_distribution<int> pick(0, bonds.size() - 1), size(1, 5), side(0, 1);
+    for (long i = 0; i < changes; ++i)
+    {
+        Position<Bond>& position = positions[pick(generator)];
+        position.UpdatePosition(0, 1000000.0 * size(generator), side(generator) ? BUY : SELL);
+        engine.OnPosition(position);
+    }
+
+    double largest = 0, difference = 0;
+    for (int s = 0; s < engine.GetScenarioCount(); ++s)
+    {
+        ZeroCurve shifted = ShiftCurve(curve, engine.GetScenario(s).shifts);
+        double pnl = 0;
+        for (size_t b = 0; b < bonds.size(); ++b)
+            pnl += positions[b].GetAggregatePosition() * (PriceOnCurve(bonds[b], shifted) - PriceOnCurve(bonds[b], curve)) / 100;
+        largest = max(largest, fabs(pnl));
+        difference = max(difference, fabs(engine.GetScenarioPnL(s) - pnl));
+    }
+    return difference / largest;
+}
+
+// Get the largest difference of the VaR and expected shortfall of a window from every day's P&L recomputed
+// at the final quantities, the products ticking through all their days one after the other
+double CheckVaR(const vector<Bond>& bonds, size_t window, long ticksPerDay, int days)
+{
+    vector<string> ids;
+    for (const auto& bond : bonds)
+        ids.push_back(bond.GetProductId());
+    VaRService<Bond> var_service(window, ticksPerDay, ids);
+    vector<Position<Bond>> positions;
+    for (const auto& bond : bonds)
+        positions.push_back(Position<Bond>(bond));
+    vector<vector<double>> closes(bonds.size());    // first mid, then the close of each day
+    mt19937 generator(11);
+    normal_distribution<double> move(0, 1.0 / 256);
+    uniform_int_distribution<int> pick(0, bonds.size() - 1), size(1, 5), side(0, 1);
+    for (size_t b = 0; b < bonds.size(); ++b)
+    {
+        double mid = 100;
+        for (long t = 0; t < ticksPerDay * days; ++t)
+        {
+            mid += move(generator);
+            var_service.OnPrice(Price<Bond>(bonds[b], mid, 1.0 / 128));
+            if (t == 0)
+                closes[b].push_back(mid);
+            if ((t + 1) % ticksPerDay == 0)
+                closes[b].push_back(mid);
+            if (t % 97 == 0)
+            {
+                Position<Bond>& position = positions[pick(generator)];
+                position.UpdatePosition(0, 1000000.0 * size(generator), side(generator) ? BUY : SELL);
+                var_service.OnPosition(position);
+            }
+        }
+    }
+
+    vector<double> pnls;
+    for (int d = max(0, days - int(window)); d < days; ++d)
+    {
+        double pnl = 0;
+        for (size_t b = 0; b < bonds.size(); ++b)
+            pnl += positions[b].GetAggregatePosition() * (closes[b][d + 1] - closes[b][d]) / 100;
+        pnls.push_back(pnl);
+    }
+    sort(pnls.begin(), pnls.end());
+    size_t tail = max<size_t>(1, size_t(ceil(0.01 * pnls.size() - 1e-9)));
+    double var = -pnls[tail - 1], shortfall = 0;
+    for (size_t i = 0; i < tail; ++i)
+        shortfall -= pnls[i] / tail;
+    return max(fabs(var_service.GetVaR(window) - var), fabs(var_service.GetExpectedShortfall(window) - shortfall)) / var;
+}
+
+// Get the largest difference of the cached key-rate PV01s of the bonds from repricing them with each pillar
+// bumped 1bp both ways, relative to the largest key rate
+double CheckKeyRates(const vector<Bond>& bonds, const ZeroCurve& curve)
+{
+    KeyRateRiskService<Bond> service(curve);
+    double largest = 0, difference = 0;
+    for (const auto& bond : bonds)
+    {
+        const array<double, CURVE_PILLARS>& rates = service.GetProductKeyRates(bond);
+        for (int i = 0; i < CURVE_PILLARS; ++i)
+        {
+            array<double, CURVE_PILLARS> shifts{};
+            shifts[i] = 1e-4;
+            double up = PriceOnCurve(bond, ShiftCurve(curve, shifts));
+            shifts[i] = -1e-4;
+            double down = PriceOnCurve(bond, ShiftCurve(curve, shifts));
+            largest = max(largest, fabs(down - up) / 2);
+            difference = max(difference, fabs(rates[i] - (down - up) / 2));
+        }
+    }
+    return difference / largest;
+}
+
+// Get the largest tenor risk left after hedging random tenor risks in the benchmarks, relative to the largest
+// tenor risk, the benchmarks spanning the tenors so a hedge can neutralize them all
+double CheckHedge(const vector<Bond>& benchmarks, const ZeroCurve& curve)
+{
+    KeyRateRiskService<Bond> key_rate_risk_service(curve);
+    vector<vector<double>> exposures(CURVE_PILLARS, vector<double>(benchmarks.size()));
+    for (size_t i = 0; i < benchmarks.size(); ++i)
+        for (int tenor = 0; tenor < CURVE_PILLARS; ++tenor)
+            exposures[tenor][i] = key_rate_risk_service.GetProductKeyRates(benchmarks[i])[tenor];
+    HedgeService<Bond> hedge_service(benchmarks, vector<string>(KEY_RATE_TENORS.begin(), KEY_RATE_TENORS.end()), exposures);
+
+    mt19937 generator(13);
+    uniform_real_distribution<double> risk(-1e6, 1e6);
+    double largest = 0;
+    for (int tenor = 0; tenor < CURVE_PILLARS; ++tenor)
+    {
+        double tenor_risk = risk(generator);
+        largest = max(largest, fabs(tenor_risk));
+        hedge_service.OnRisk(PV01<BucketedSector<Bond>>(BucketedSector<Bond>({}, KEY_RATE_TENORS[tenor]), tenor_risk, 1));
+    }
+    hedge_service.Flush();
+    double residual = 0;
+    for (int tenor = 0; tenor < CURVE_PILLARS; ++tenor)
+        residual = max(residual, fabs(hedge_service.GetResidualRisk(tenor)));
+    return residual / largest;
+}
+
+// Get the best nanoseconds per trade of booking the trades into fresh services
+template<typename Setup>
+double TimePerTrade(const vector<Trade<Bond>>& trades, int repeats, Setup setup)
+{
+    double best = 1e300;
+    for (int r = 0; r < repeats; ++r)
+    {
+        PositionService<Bond> position_service;
+        RiskService<Bond> risk_service;
+        InventorySnapshot inventory_snapshot;
+        RiskServiceListener<Bond> risk_listener(&risk_service);
+        InventorySnapshotListener<Bond> inventory_listener(&inventory_snapshot);
+        setup(position_service, risk_listener, inventory_listener);
+
+        auto start = chrono::steady_clock::now();
+        for (const auto& trade : trades)
+        {
+            ++g_replay_time;    // one input record per trade, as the trade booking connector counts them
+            position_service.AddTrade(trade);
+        }
+        auto end = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double, nano>(end - start).count() / trades.size());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    long count = argc > 1 ? atol(argv[1]) : 1000000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    long tick_count = argc > 3 ? atol(argv[3]) : 7000000;
+    int product_count = argc > 4 ? atoi(argv[4]) : 10000;
+
+    cout << microsec_clock::local_time() << "  Generating " << count << " trades..." << endl;
+    vector<Trade<Bond>> trades = MakeTrades(count);
+
+    double alone = TimePerTrade(trades, repeats,
+        [](PositionService<Bond>&, RiskServiceListener<Bond>&, InventorySnapshotListener<Bond>&) {});
+    cout << microsec_clock::local_time() << "  Position service: " << alone << " ns per trade.\n";
+
+    double listened = TimePerTrade(trades, repeats,
+        [](PositionService<Bond>& service, RiskServiceListener<Bond>& risk, InventorySnapshotListener<Bond>& inventory)
+        {
+            service.AddListener(&risk);
+            service.AddListener(&inventory);
+        });
+    cout << microsec_clock::local_time() << "  Position service with risk and inventory listeners: " << listened
+        << " ns per trade.\n";
+
+    cout << microsec_clock::local_time() << "  Generating " << tick_count << " ticks over " << product_count << " products..." << endl;
+    vector<Bond> bonds = MakeBonds(product_count);
+    vector<Price<Bond>> ticks;
+    mt19937 generator(42);
+    uniform_int_distribution<int> product(0, product_count - 1);
+    for (long i = 0; i < 65536; ++i)
+        ticks.push_back(Price<Bond>(bonds[product(generator)], 99.0 + (i % 256) / 128.0, 1.0 / 128));
+    double marked = TimePerTick(bonds, ticks, tick_count, repeats);
+    cout << microsec_clock::local_time() << "  P&L service: " << marked << " ns per tick.\n";
+
+    vector<Trade<Bond>> spread_trades;
+    spread_trades.reserve(count);
+    for (long i = 0; i < count; ++i)
+        spread_trades.push_back(Trade<Bond>(bonds[i % min<long>(bonds.size(), 64)], MakeId(TRADE_ID, i), 100.0,
+            books[i % books.size()], 1000000.0, i % 2 ? BUY : SELL));
+    for (int producers = 1; producers <= 2; ++producers)
+        for (int shards = 1; shards <= 4; shards *= 2)
+            cout << microsec_clock::local_time() << "  Sharded positions, " << producers << " producers, " << shards << " shards: "
+                << ShardedThroughput(spread_trades, shards, producers, repeats) / 1e6 << " million trades per second.\n";
+
+    vector<Bond> benchmarks;
+    for (const auto& id : g_product_Ids)
+        benchmarks.push_back(Bond(id, CUSIP, g_tickers[id], g_coupons[id], g_dates[id]));
+    vector<Price<Bond>> curve_ticks;
+    for (int i = 0; i < 4096; ++i)
+        curve_ticks.push_back(Price<Bond>(benchmarks[product(generator) % benchmarks.size()], 99.0 + (i % 256) / 128.0, 1.0 / 128));
+    cout << microsec_clock::local_time() << "  Curve service: " << TimePerCurveTick(curve_ticks, tick_count / 10, repeats)
+        << " ns per benchmark tick.\n";
+
+    ZeroCurve curve = CurveService<Bond>().GetData(UST_CURVE);
+    cout << microsec_clock::local_time() << "  Scenario engine check: " << CheckScenarioEngine(benchmarks, curve, 10000)
+        << " largest difference from repricing on the shifted curves.\n";
+    cout << microsec_clock::local_time() << "  VaR check: " << CheckVaR(benchmarks, 250, 400, 300)
+        << " largest difference from the daily P&L recomputed at the final positions.\n";
+    cout << microsec_clock::local_time() << "  Key-rate risk check: " << CheckKeyRates(benchmarks, curve)
+        << " largest difference from repricing with bumped pillars.\n";
+    cout << microsec_clock::local_time() << "  Hedge check: " << CheckHedge(benchmarks, curve) << " largest tenor risk left.\n";
+    return 0;
+}
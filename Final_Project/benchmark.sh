@@ -0,0 +1,7 @@
+#!/bin/bash
+# Compile the benchmarks
+g++ -std=c++17 -O2 -Wall -pthread -I. -I./utils -o benchmark benchmark.cpp
+# Notify user
+echo "Compilation finished. Executable file: benchmark"
+
+./benchmark "$@"
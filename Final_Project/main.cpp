@@ -2,19 +2,31 @@
 #include "AlgoExecutionService.hpp"
 #include "AlgoStreamingService.hpp"
 #include "Connectors.hpp"
+#include "CurveService.hpp"
 #include "ExecutionService.hpp"
+#include "HedgeService.hpp"
 #include "GUIService.hpp"
 #include "HistoricalDataService.hpp"
 #include "InquiryService.hpp"
+#include "KeyRateRiskService.hpp"
 #include "Listeners.hpp"
 #include "MarketDataService.hpp"
 #include "PositionService.hpp"
+#include "ShardedPositionService.hpp"
+#include "PnLService.hpp"
 #include "PricingService.hpp"
 #include "Products.hpp"
 #include "RiskService.hpp"
+#include "RiskHierarchy.hpp"
+#include "ScenarioEngine.hpp"
+#include "SmartOrderRouter.hpp"
+#include "TradeAllocator.hpp"
+#include "StrategyRegistry.hpp"
+#include "IcebergManager.hpp"
 #include "SOA.hpp"
 #include "StreamingService.hpp"
 #include "TradeBookingService.hpp"
+#include "VaRService.hpp"
 
 using namespace std;
 
@@ -73,6 +85,8 @@ void Generate_Data()
  * - output/executions.txt
  * - output/positions.txt
  * - output/risk.txt
+ * - output/bucketed_risk.txt
+ * - output/pnl.txt
  * - output/all_inquiries.txt
  */
 void InitializeData()
@@ -80,9 +94,80 @@ void InitializeData()
     Generate_Data();
 }
 
+// Bucketed sectors whose risk is kept and published, the standard buckets then user-defined ones
+const vector<pair<string, vector<string>>> BUCKETED_SECTORS = {
+    { "FrontEnd", { "OTRUSTR_02Y", "OTRUSTR_03Y" } },
+    { "Belly", { "OTRUSTR_05Y", "OTRUSTR_07Y", "OTRUSTR_10Y" } },
+    { "LongEnd", { "OTRUSTR_20Y", "OTRUSTR_30Y" } },
+    { "2s10s30s", { "OTRUSTR_02Y", "OTRUSTR_10Y", "OTRUSTR_30Y" } }
+};
+
+/**
+ * @brief Build a bucketed sector of treasuries.
+ *
+ * @param name The name of the sector.
+ * @param productIds The identifiers of the treasuries in the sector.
+ * @return The sector.
+ */
+BucketedSector<Bond> MakeSector(const string& name, const vector<string>& productIds)
+{
+    vector<Bond> bonds;
+    for (const auto& id : productIds)
+        bonds.push_back(Bond(id, CUSIP, g_tickers[id], g_coupons[id], g_dates[id]));
+    return BucketedSector<Bond>(bonds, name);
+}
+
+// Desks of the risk hierarchy and their books, the hedges landing in TRSY3
+const vector<pair<string, vector<string>>> RISK_DESKS = {
+    { "MarketMaking", { "TRSY1", "TRSY2" } },
+    { "Hedging", { "TRSY3" } }
+};
+
+// Product families of the risk hierarchy
+const vector<pair<string, vector<string>>> PRODUCT_FAMILIES = {
+    { "Notes", { "OTRUSTR_02Y", "OTRUSTR_03Y", "OTRUSTR_05Y", "OTRUSTR_07Y", "OTRUSTR_10Y" } },
+    { "Bonds", { "OTRUSTR_20Y", "OTRUSTR_30Y" } }
+};
+
+// Smallest move of the PV01 risk of a product since its last publish worth publishing
+const double RISK_PUBLISH_THRESHOLD = 1000000;
+
+// Strategies of the algo services, by their names in the strategy registry
+const string ALGO_STREAMING_STRATEGY = "skewed";
+const string ALGO_EXECUTION_STRATEGY = "wide-touch-alternate";
+
+// Orders the pre-trade risk gate passes per book update in the long run, and back to back
+const double RISK_GATE_MESSAGES_PER_UPDATE = 0.5;
+const double RISK_GATE_BURST = 10;
+
+// Latest trades whose net quantity the trade store report sums
+const size_t TRADE_REPORT_RECENT = 100000;
+
+// Worker threads and producer slots of the sharded position keeper, the trade file and the fills each submitting from their own slot
+const int SHARDED_POSITION_SHARDS = 2;
+const int SHARDED_POSITION_PRODUCERS = 2;
+const int FILE_TRADE_PRODUCER = 0;
+const int FILL_TRADE_PRODUCER = 1;
+
+// Historical shock scenarios built from the sampled curves once the prices are processed
+const int HISTORICAL_SCENARIOS = 100;
+
+// Price ticks of each product making up one day of the VaR history, and the windows reported in days
+const long VAR_TICKS_PER_DAY = 400;
+const vector<size_t> VAR_WINDOWS = { 250, 500, 1000, 2500 };
+
+// Shortest replay time, in input records, between two publishes of the key-rate risk
+const uint64_t KEY_RATE_PUBLISH_INTERVAL = 1000;
+
+// Smallest hedge worth a parent order, its largest child order, and the shortest replay time between two hedges
+const double HEDGE_MIN_ORDER_SIZE = 10000000;
+const double HEDGE_SLICE_SIZE = 10000000;
+const uint64_t HEDGE_INTERVAL = 100000;
+
 int main()
 {
     InitializeData();
+    StrategyRegistry<Bond> strategy_registry;
 
     TradeBookingService<Bond> trade_booking_service;
     PositionService<Bond> position_service;
@@ -90,27 +175,88 @@ int main()
     // The trade booking service should be linked to a position service via listener
     trade_booking_service.AddListener(&position_listener);
 
+    ShardedPositionService<Bond> sharded_position_service(SHARDED_POSITION_SHARDS, SHARDED_POSITION_PRODUCERS);
+    ShardedPositionListener<Bond> sharded_position_listener(&sharded_position_service, FILE_TRADE_PRODUCER, FILL_TRADE_PRODUCER);
+    // Mirror the booked trades into the sharded position keeper, checked against the position service at the end
+    trade_booking_service.AddListener(&sharded_position_listener);
+
     RiskService<Bond> risk_service;
     RiskServiceListener<Bond> risk_service_listener(&risk_service);
+    RiskPublishPolicy risk_publish_policy;
+    risk_publish_policy.mode = PUBLISH_ON_CHANGE;
+    risk_publish_policy.changeThreshold = RISK_PUBLISH_THRESHOLD;
+    // Publish the risk of each product once it moves past the threshold, the latest risk going out at the end of each file
+    risk_service.SetPublishPolicy(risk_publish_policy);
     // The position service should be linked to a risk service via listener
     position_service.AddListener(&risk_service_listener);
 
-    HistoricalPositionService<Bond> historical_position_service;
+    InventorySnapshot inventory_snapshot;
+    InventorySnapshotListener<Bond> inventory_snapshot_listener(&inventory_snapshot);
+    RiskSnapshotListener<Bond> risk_snapshot_listener(&inventory_snapshot);
+    // Publish positions and the current risk, ahead of its publish policy, to the snapshot the algo streaming service quotes from
+    position_service.AddListener(&inventory_snapshot_listener);
+    risk_service.AddCurrentRiskListener(&risk_snapshot_listener);
+
+    HistoricalPositionConnector<Bond> historical_position_connector;
+    HistoricalPositionService<Bond> historical_position_service(&historical_position_connector);
     HistoricalPositionListener<Bond> historical_position_listener(&historical_position_service);
     // Link the position service to the historical position listener
     position_service.AddListener(&historical_position_listener);
 
-    HistoricalRiskService<Bond> historical_risk_service;
+    for (const auto& sector : BUCKETED_SECTORS)
+        risk_service.AddBucketedSector(MakeSector(sector.first, sector.second));
+    HistoricalBucketedRiskConnector<Bond> historical_bucketed_risk_connector;
+    HistoricalBucketedRiskService<Bond> historical_bucketed_risk_service(&historical_bucketed_risk_connector);
+    HistoricalBucketedRiskListener<Bond> historical_bucketed_risk_listener(&historical_bucketed_risk_service);
+    // Link the bucketed risk stream of the risk service to the historical bucketed risk listener
+    risk_service.AddBucketListener(&historical_bucketed_risk_listener);
+
+    HistoricalRiskConnector<Bond> historical_risk_connector;
+    HistoricalRiskService<Bond> historical_risk_service(&historical_risk_connector);
     HistoricalRiskListener<Bond> historical_risk_listener(&historical_risk_service);
     // Link the risk service to the historical risk listener
     risk_service.AddListener(&historical_risk_listener);
 
+    PnLService<Bond> pnl_service;
+    PnLTradeListener<Bond> pnl_trade_listener(&pnl_service);
+    // Link the trade booking service to the P&L service to keep the average costs
+    trade_booking_service.AddListener(&pnl_trade_listener);
+
+    HistoricalPnLConnector<Bond> historical_pnl_connector;
+    HistoricalPnLService<Bond> historical_pnl_service(&historical_pnl_connector);
+    HistoricalPnLListener<Bond> historical_pnl_listener(&historical_pnl_service);
+    // Link the P&L service to the historical P&L listener
+    pnl_service.AddListener(&historical_pnl_listener);
+
+    RiskHierarchy<Bond> risk_hierarchy;
+    for (const auto& desk : RISK_DESKS)
+    {
+        risk_hierarchy.AddDesk(desk.first);
+        for (const auto& book : desk.second)
+            risk_hierarchy.AddBook(book, desk.first);
+    }
+    for (const auto& family : PRODUCT_FAMILIES)
+        risk_hierarchy.AddFamily(family.first, family.second);
+    HierarchyPositionListener<Bond> hierarchy_position_listener(&risk_hierarchy);
+    HierarchyPnLListener<Bond> hierarchy_pnl_listener(&risk_hierarchy);
+    // Link the position and P&L services to the risk hierarchy
+    position_service.AddListener(&hierarchy_position_listener);
+    pnl_service.AddListener(&hierarchy_pnl_listener);
+
+    HistoricalAggregateRiskConnector<Bond> historical_aggregate_risk_connector;
+    HistoricalAggregateRiskService<Bond> historical_aggregate_risk_service(&historical_aggregate_risk_connector);
+    HistoricalAggregateRiskListener<Bond> historical_aggregate_risk_listener(&historical_aggregate_risk_service);
+    // Link every level of the risk hierarchy to the historical aggregate risk listener
+    for (int level = 0; level < AGGREGATION_LEVELS; ++level)
+        risk_hierarchy.AddListener(AggregationLevel(level), &historical_aggregate_risk_listener);
+
     /**
      * Process price data from data_generated/prices.txt
      * 
      * data_generated/prices.txt -> pricing service -> GUI service -> output/gui.txt
      * data_generated/prices.txt -> pricing service -> algo streaming service -> streaming service -> historical streaming service 
         -> output/streaming.txt
+     * data_generated/prices.txt -> pricing service -> curve service
      */
 
     GUIService<Bond> gui_service;
@@ -119,48 +265,151 @@ int main()
     // Link the pricing service to the gui listener
     pricing_service.AddListener(&gui_listener);
 
-    AlgoStreamingService<Bond> algo_streaming_service;
-    AlgoStreamingServiceListener<Bond> algo_streaming_listener(&algo_streaming_service);
+    unique_ptr<AlgoStreamingServiceBase<Bond>> algo_streaming_service =
+        strategy_registry.MakeStreaming(ALGO_STREAMING_STRATEGY, &inventory_snapshot);
+    AlgoStreamingServiceListener<Bond> algo_streaming_listener(algo_streaming_service.get());
     // Link the pricing service to the algo streaming listener
     pricing_service.AddListener(&algo_streaming_listener);
 
     StreamingService<Bond> streaming_service;
     StreamingServiceListener<Bond> streaming_listener(&streaming_service);
     // Link the algo streaming service to the streaming listener
-    algo_streaming_service.AddListener(&streaming_listener);
+    algo_streaming_service->AddListener(&streaming_listener);
 
-    HistoricalStreamingService<Bond> historical_streaming_service;
+    HistoricalStreamingConnector<Bond> historical_streaming_connector;
+    HistoricalStreamingService<Bond> historical_streaming_service(&historical_streaming_connector);
     HistoricalStreamingListener<Bond> historical_streaming_listener(&historical_streaming_service);
     // Link the streaming service to the historical streaming listener
     streaming_service.AddListener(&historical_streaming_listener);
 
+    CurveService<Bond> curve_service;
+    CurveServiceListener<Bond> curve_listener(&curve_service);
+    // Link the pricing service to the curve listener to bootstrap the treasury curve
+    pricing_service.AddListener(&curve_listener);
+
+    ThreadPool thread_pool;
+    ScenarioEngine<Bond> scenario_engine(&thread_pool, curve_service.GetData(UST_CURVE));
+    scenario_engine.AddStandardScenarios();
+    ScenarioPositionListener<Bond> scenario_position_listener(&scenario_engine);
+    ScenarioCurveListener<Bond> scenario_curve_listener(&scenario_engine);
+    // Link the position and curve services to the scenario engine to stress the portfolio
+    position_service.AddListener(&scenario_position_listener);
+    curve_service.AddListener(&scenario_curve_listener);
+
+    KeyRateRiskService<Bond> key_rate_risk_service(curve_service.GetData(UST_CURVE), KEY_RATE_PUBLISH_INTERVAL);
+    KeyRatePositionListener<Bond> key_rate_position_listener(&key_rate_risk_service);
+    KeyRateCurveListener<Bond> key_rate_curve_listener(&key_rate_risk_service);
+    // Link the position and curve services to the key-rate risk service
+    position_service.AddListener(&key_rate_position_listener);
+    curve_service.AddListener(&key_rate_curve_listener);
+
+    HistoricalKeyRateRiskConnector<Bond> historical_key_rate_risk_connector;
+    HistoricalBucketedRiskService<Bond, HistoricalKeyRateRiskConnector<Bond>> historical_key_rate_risk_service(&historical_key_rate_risk_connector);
+    HistoricalBucketedRiskListener<Bond, HistoricalKeyRateRiskConnector<Bond>> historical_key_rate_risk_listener(&historical_key_rate_risk_service);
+    // Link the key-rate risk service to the historical key-rate risk listener
+    key_rate_risk_service.AddListener(&historical_key_rate_risk_listener);
+
+    PriceSnapshot price_snapshot;
+    PriceSnapshotListener<Bond> price_snapshot_listener(&price_snapshot);
+    // Publish mids to the snapshot the pre-trade risk gate collars prices against
+    pricing_service.AddListener(&price_snapshot_listener);
+
+    VaRService<Bond> var_service(VAR_WINDOWS.back(), VAR_TICKS_PER_DAY, g_product_Ids);
+    VaRPriceListener<Bond> var_price_listener(&var_service);
+    VaRPositionListener<Bond> var_position_listener(&var_service);
+    // Link the pricing and position services to the VaR service to build the daily P&L history
+    pricing_service.AddListener(&var_price_listener);
+    position_service.AddListener(&var_position_listener);
+
+    PnLPriceListener<Bond> pnl_price_listener(&pnl_service);
+    // Link the pricing service to the P&L service to mark open positions to the mid
+    pricing_service.AddListener(&pnl_price_listener);
+
     /**
      * Process order book data from data_generated/marketdata.txt
      * Generate one file: output/executions.txt
      * Update two files: output/positions.txt and output/risk.txt
      * 
-     * data_generated/marketdata.txt -> market data service -> algo execution service -> execution service -> historical execution
-         service -> output/executions.txt
-     * data_generated/marketdata.txt -> market data service -> algo execution service -> execution service -> trade booking service
-         -> same as part (a)
+     * data_generated/marketdata.txt -> market data service -> algo execution service -> iceberg manager -> pre-trade risk gate
+         -> smart order router -> execution service -> historical execution service -> output/executions.txt
+     * data_generated/marketdata.txt -> market data service -> algo execution service -> iceberg manager -> pre-trade risk gate
+         -> smart order router -> execution service -> trade booking service -> same as part (a)
      */
 
     MarketDataService<Bond> market_data_service;
-    AlgoExecutionService<Bond> algo_execution_service;
-    AlgoExecutionServiceListener<Bond> algo_execution_listener(&algo_execution_service);
+    unique_ptr<AlgoExecutionServiceBase<Bond>> algo_execution_service = strategy_registry.MakeExecution(ALGO_EXECUTION_STRATEGY);
+    AlgoExecutionServiceListener<Bond> algo_execution_listener(algo_execution_service.get());
+
+    vector<Bond> hedge_instruments;
+    for (const auto& id : g_product_Ids)
+        hedge_instruments.push_back(Bond(id, CUSIP, g_tickers[id], g_coupons[id], g_dates[id]));
+    vector<vector<double>> key_rate_exposures(CURVE_PILLARS, vector<double>(hedge_instruments.size()));
+    for (size_t i = 0; i < hedge_instruments.size(); ++i)
+        for (int tenor = 0; tenor < CURVE_PILLARS; ++tenor)
+            key_rate_exposures[tenor][i] = key_rate_risk_service.GetProductKeyRates(hedge_instruments[i])[tenor];
+    HedgeService<Bond> hedge_service(hedge_instruments, vector<string>(KEY_RATE_TENORS.begin(), KEY_RATE_TENORS.end()),
+        key_rate_exposures, algo_execution_service.get(), HEDGE_MIN_ORDER_SIZE, HEDGE_SLICE_SIZE, 50, HEDGE_INTERVAL);
+    HedgeRiskListener<Bond> hedge_risk_listener(&hedge_service);
+    // Link the key-rate risk service to the hedge service, which works its hedges as parent orders of the algo
+    key_rate_risk_service.AddListener(&hedge_risk_listener);
     // Link the market data service to the algo execution listener
     market_data_service.AddListener(&algo_execution_listener);
 
     ExecutionService<Bond> execution_service;
     ExecutionServiceListener<Bond> execution_listener(&execution_service);
-    // Link the algo execution service to the execution listener
-    algo_execution_service.AddListener(&execution_listener);
+    ExecutionMarketDataListener<Bond> execution_market_data_listener(&execution_service);
+    // Link the market data service to the venues simulated by the execution service
+    market_data_service.AddListener(&execution_market_data_listener);
 
-    TradeBookingServiceListener<Bond> trade_booking_listener(&trade_booking_service);
-    // Link the execution service to the trade booking listener
+    SmartOrderRouter<Bond> order_router(&execution_service.GetExchange());
+    SmartOrderRouterListener<Bond> order_router_listener(&order_router);
+    RouterMarketDataListener<Bond> router_market_data_listener(&order_router);
+    // Link the router to the execution listener
+    order_router.AddListener(&execution_listener);
+    // Link the market data service to the router once the venues are refreshed
+    market_data_service.AddListener(&router_market_data_listener);
+
+    PreTradeRiskGate<Bond> risk_gate(&inventory_snapshot, &price_snapshot, RISK_GATE_MESSAGES_PER_UPDATE, RISK_GATE_BURST);
+    PreTradeLimits risk_limits;
+    risk_limits.maxOrderSize = 20000000;
+    risk_limits.maxPosition = 300000000;
+    risk_limits.maxBookPosition = 250000000;
+    risk_limits.priceCollar = 2.0;
+    risk_gate.SetDefaultLimits(risk_limits);
+    PreTradeRiskGateListener<Bond> risk_gate_listener(&risk_gate);
+    RiskGateExecutionListener<Bond> risk_gate_execution_listener(&risk_gate);
+    // Link the risk gate to the router, and the execution service back to the gate to release open exposure
+    risk_gate.AddListener(&order_router_listener);
+    execution_service.AddListener(&risk_gate_execution_listener);
+    RiskGateMarketDataListener<Bond> risk_gate_market_data_listener(&risk_gate);
+    // Link the market data service to the risk gate to clock its message-rate limit
+    market_data_service.AddListener(&risk_gate_market_data_listener);
+
+    TradeAllocator<Bond> trade_allocator;
+    // Fills rotate across the books, except the long bond split by weight and the slices of parent orders kept in one book
+    trade_allocator.SetProductRule("OTRUSTR_30Y", MakeSplitRule({ { "TRSY1", 0.5 }, { "TRSY2", 0.3 }, { "TRSY3", 0.2 } }, 1000));
+    trade_allocator.SetStrategyRule(CHILD_ORDER_ID, MakeRotationRule({ "TRSY3" }));
+    TradeBookingServiceListener<Bond> trade_booking_listener(&trade_booking_service, &trade_allocator);
+    // Link the execution service to the trade booking listener, ahead of the listeners that post new orders
     execution_service.AddListener(&trade_booking_listener);
 
-    HistoricalExecutionService<Bond> historical_execution_service;
+    IcebergManager<Bond> iceberg_manager;
+    IcebergManagerListener<Bond> iceberg_manager_listener(&iceberg_manager);
+    IcebergFillListener<Bond> iceberg_fill_listener(&iceberg_manager);
+    // Link the algo execution service to the iceberg manager, and the iceberg manager to the risk gate
+    algo_execution_service->AddListener(&iceberg_manager_listener);
+    iceberg_manager.AddListener(&risk_gate_listener);
+    // Link the execution service and the risk gate's rejects back to the iceberg manager to refresh the visible slices
+    execution_service.AddListener(&iceberg_fill_listener);
+    risk_gate.AddListener(&iceberg_fill_listener);
+
+    AlgoExecutionFillListener<Bond> algo_fill_listener(algo_execution_service.get());
+    // Link the execution service and the risk gate's rejects back to the algo execution service to fill its parent orders
+    execution_service.AddListener(&algo_fill_listener);
+    risk_gate.AddListener(&algo_fill_listener);
+
+    HistoricalExecutionConnector<Bond> historical_execution_connector;
+    HistoricalExecutionService<Bond> historical_execution_service(&historical_execution_connector);
     HistoricalExecutionListener<Bond> historical_execution_listener(&historical_execution_service);
     // Link the execution service to the historical execution listener
     execution_service.AddListener(&historical_execution_listener);
@@ -173,7 +422,8 @@ int main()
      */
 
     InquiryService<Bond> inquiry_service;
-    HistoricalInquiryService<Bond> historical_inquiry_service;
+    HistoricalInquiryConnector<Bond> historical_inquiry_connector;
+    HistoricalInquiryService<Bond> historical_inquiry_service(&historical_inquiry_connector);
     HistoricalInquiryListener<Bond> historical_inquiry_listener(&historical_inquiry_service);
     inquiry_service.AddListener(&historical_inquiry_listener);
 
@@ -185,8 +435,96 @@ int main()
     InquiryConnector<Bond> inquiry_connector(&inquiry_service);
 
     trade_connector.Subscribe("data_generated/trades.txt");
-    pricing_connector.Subscribe("data_generated/prices.txt");
-    market_data_connector.Subscribe("data_generated/marketdata.txt");
+    uint64_t trade_file_end = g_replay_time;
+    risk_service.FlushRisk();
+    // Replay prices and books together, so positions are marked to the mids of the books filling them
+    SubscribeInterleaved(pricing_connector, "data_generated/prices.txt", market_data_connector, "data_generated/marketdata.txt");
+    streaming_service.Flush();
+    cout << microsec_clock::local_time() << "  Quotes streamed: " << streaming_service.GetSentCount()
+        << " sent, " << streaming_service.GetConflatedCount() << " conflated.\n";
+    scenario_engine.AddHistoricalScenarios(HISTORICAL_SCENARIOS);
+    execution_service.Flush();
+    risk_service.FlushRisk();
+    cout << microsec_clock::local_time() << "  Orders executed: " << execution_service.GetFillCount() << " fills, "
+        << execution_service.GetCancelCount() << " cancels, " << execution_service.GetRejectCount() << " rejects, "
+        << iceberg_manager.GetRefreshCount() << " iceberg refreshes.\n";
+    cout << microsec_clock::local_time() << "  Pre-trade risk gate: " << risk_gate.GetAcceptedCount() << " accepted";
+    for (int reason = 0; reason < REJECT_REASON_COUNT; ++reason)
+        cout << ", " << risk_gate.GetRejectCount(RiskRejectReason(reason)) << " " << GetRejectReasonName(RiskRejectReason(reason));
+    cout << " rejects.\n";
+    const TradeStore<Bond>& trade_store = trade_booking_service.GetStore();
+    cout << microsec_clock::local_time() << "  Trades stored: " << trade_store.GetSize() << " trades in "
+        << trade_store.GetMemoryUsage() / 1048576 << " MB, "
+        << double(trade_store.GetMemoryUsage()) / max<size_t>(trade_store.GetSize(), 1) << " bytes per trade.\n";
+    size_t file_trades = 0, execution_trades = 0;
+    trade_store.ScanTime(0, trade_file_end + 1, [&](uint32_t) { ++file_trades; });
+    trade_store.ScanTime(trade_file_end + 1, g_replay_time + 1, [&](uint32_t) { ++execution_trades; });
+    double recent_quantity = 0;
+    size_t recent_first = trade_store.GetSize() - min(trade_store.GetSize(), TRADE_REPORT_RECENT);
+    trade_store.ScanSequence(recent_first, trade_store.GetSize(), [&](uint32_t row)
+        { recent_quantity += (trade_store.GetSide(row) == BUY ? 1 : -1) * trade_store.GetQuantity(row); });
+    cout << microsec_clock::local_time() << "  Trade store report: " << file_trades << " trades from the trade file, "
+        << execution_trades << " from executions, net " << recent_quantity << " over the last " << trade_store.GetSize() - recent_first
+        << " trades; VWAP";
+    for (size_t i = 0; i < g_product_Ids.size(); ++i)
+    {
+        double notional = 0, volume = 0;
+        trade_store.ScanProduct(g_product_Ids[i], [&](uint32_t row)
+            { notional += trade_store.GetPrice(row) * trade_store.GetQuantity(row); volume += trade_store.GetQuantity(row); });
+        cout << (i > 0 ? ", " : " ") << g_product_Ids[i] << " " << notional / max(volume, 1.0);
+    }
+    cout << ".\n";
+    sharded_position_service.Sync();
+    int mismatched_products = 0;
+    for (const auto& product_id : g_product_Ids)
+        if (sharded_position_service.GetAggregatePosition(product_id) != position_service.GetData(product_id).GetAggregatePosition())
+            ++mismatched_products;
+    cout << microsec_clock::local_time() << "  Sharded positions: " << sharded_position_service.GetAppliedCount() << " trades across "
+        << sharded_position_service.GetShardCount() << " shards, " << mismatched_products << " products differing from the position service.\n";
+    cout << microsec_clock::local_time() << "  Risk published: " << risk_service.GetRiskPublishedCount() << " updates, "
+        << risk_service.GetRiskHeldCount() << " held back.\n";
+    risk_service.FlushBuckets();
+    cout << microsec_clock::local_time() << "  Bucketed risk:";
+    for (size_t i = 0; i < BUCKETED_SECTORS.size(); ++i)
+        cout << (i > 0 ? ", " : " ") << BUCKETED_SECTORS[i].first << " "
+            << risk_service.GetBucketedRisk(MakeSector(BUCKETED_SECTORS[i].first, BUCKETED_SECTORS[i].second)).GetPV01();
+    cout << "; " << risk_service.GetBucketPublishedCount() << " updates published, " << risk_service.GetBucketConflatedCount()
+        << " conflated.\n";
+    key_rate_risk_service.Flush();
+    cout << microsec_clock::local_time() << "  Key-rate risk:";
+    for (size_t i = 0; i < KEY_RATE_TENORS.size(); ++i)
+        cout << (i > 0 ? ", " : " ") << KEY_RATE_TENORS[i] << " " << key_rate_risk_service.GetData(KEY_RATE_TENORS[i]).GetPV01();
+    cout << "; " << key_rate_risk_service.GetPublishedCount() << " updates published, " << key_rate_risk_service.GetConflatedCount()
+        << " conflated.\n";
+    hedge_service.Flush();
+    cout << microsec_clock::local_time() << "  Hedge:";
+    for (int i = 0; i < hedge_service.GetInstrumentCount(); ++i)
+        cout << (i > 0 ? ", " : " ") << g_product_Ids[i] << " " << hedge_service.GetHedge(i);
+    cout << "; " << hedge_service.GetSolveCount() << " solves, " << hedge_service.GetConflatedCount() << " conflated, "
+        << hedge_service.GetParentOrderCount() << " parent orders.\n";
+    pnl_service.Flush();
+    cout << microsec_clock::local_time() << "  P&L: " << pnl_service.GetTotalRealized() << " realized, "
+        << pnl_service.GetTotalUnrealized() << " unrealized, " << pnl_service.GetPublishedCount() << " updates published, "
+        << pnl_service.GetConflatedCount() << " conflated.\n";
+    risk_hierarchy.Flush();
+    const AggregateRisk& firm_risk = risk_hierarchy.GetNode("FIRM");
+    cout << microsec_clock::local_time() << "  Risk hierarchy: firm position " << firm_risk.GetPosition() << ", PV01 "
+        << firm_risk.GetPV01() << ", P&L " << firm_risk.GetPnL() << ";";
+    for (int level = 0; level < AGGREGATION_LEVELS; ++level)
+        cout << (level > 0 ? ", " : " ") << GetAggregationLevelName(AggregationLevel(level)) << " "
+            << risk_hierarchy.GetPublishedCount(AggregationLevel(level)) << " published / "
+            << risk_hierarchy.GetConflatedCount(AggregationLevel(level)) << " conflated";
+    cout << ".\n";
+    scenario_engine.Flush();
+    int worst_scenario = scenario_engine.GetWorstScenario();
+    cout << microsec_clock::local_time() << "  Scenarios: " << scenario_engine.GetScenarioCount() << " scenarios, worst "
+        << scenario_engine.GetScenario(worst_scenario).name << " at " << scenario_engine.GetScenarioPnL(worst_scenario) << ", "
+        << scenario_engine.GetRevaluationCount() << " revaluations.\n";
+    cout << microsec_clock::local_time() << "  99% VaR / ES over " << var_service.GetDayCount() << " days:";
+    for (size_t i = 0; i < VAR_WINDOWS.size(); ++i)
+        cout << (i > 0 ? ", " : " ") << VAR_WINDOWS[i] << "d " << var_service.GetVaR(VAR_WINDOWS[i]) << " / "
+            << var_service.GetExpectedShortfall(VAR_WINDOWS[i]);
+    cout << ".\n\n";
     inquiry_connector.Subscribe("data_generated/inquiries.txt");
 
     return 0;
@@ -6,7 +6,7 @@ rm -f output/*.txt
 # Compile the project
 #!/bin/bash
 
-g++ -std=c++17 -O2 -Wall -I. -I./utils -o final_project main.cpp
+g++ -std=c++17 -O2 -Wall -pthread -I. -I./utils -o final_project main.cpp
 # Notify user
 echo "Compilation finished. Executable file: final_project"
 
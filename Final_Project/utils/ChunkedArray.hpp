@@ -0,0 +1,80 @@
+#ifndef CHUNKED_ARRAY_HPP
+#define CHUNKED_ARRAY_HPP
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Append-only array stored in fixed-size chunks.
+ * Growing adds a chunk instead of moving the elements, so appends never copy what is
+ * already stored and references to elements stay valid. An access is a shift, a mask and
+ * two loads.
+ * Type V is the element type, stored in chunks of 2^CHUNK_BITS elements.
+ */
+template<typename V, int CHUNK_BITS = 12>
+class ChunkedArray
+{
+public:
+    // ctor
+    ChunkedArray();
+
+    // Append an element
+    void PushBack(const V& value);
+
+    // Access an element
+    V& operator[](size_t i);
+    const V& operator[](size_t i) const;
+
+    // Get the number of elements
+    size_t GetSize() const;
+
+    // Get the number of bytes allocated
+    size_t GetMemoryUsage() const;
+
+private:
+    vector<unique_ptr<V[]>> chunks;
+    size_t size;
+};
+
+
+template<typename V, int CHUNK_BITS>
+ChunkedArray<V, CHUNK_BITS>::ChunkedArray() : size(0)
+{
+}
+
+template<typename V, int CHUNK_BITS>
+void ChunkedArray<V, CHUNK_BITS>::PushBack(const V& value)
+{
+    if ((size >> CHUNK_BITS) == chunks.size())
+        chunks.emplace_back(new V[size_t(1) << CHUNK_BITS]);
+    (*this)[size++] = value;
+}
+
+template<typename V, int CHUNK_BITS>
+V& ChunkedArray<V, CHUNK_BITS>::operator[](size_t i)
+{
+    return chunks[i >> CHUNK_BITS][i & ((size_t(1) << CHUNK_BITS) - 1)];
+}
+
+template<typename V, int CHUNK_BITS>
+const V& ChunkedArray<V, CHUNK_BITS>::operator[](size_t i) const
+{
+    return chunks[i >> CHUNK_BITS][i & ((size_t(1) << CHUNK_BITS) - 1)];
+}
+
+template<typename V, int CHUNK_BITS>
+size_t ChunkedArray<V, CHUNK_BITS>::GetSize() const
+{
+    return size;
+}
+
+template<typename V, int CHUNK_BITS>
+size_t ChunkedArray<V, CHUNK_BITS>::GetMemoryUsage() const
+{
+    return chunks.size() * (sizeof(V) << CHUNK_BITS) + chunks.capacity() * sizeof(unique_ptr<V[]>);
+}
+
+#endif
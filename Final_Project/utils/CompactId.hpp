@@ -0,0 +1,120 @@
+#ifndef COMPACT_ID_HPP
+#define COMPACT_ID_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace std;
+
+/**
+ * Identifiers of orders, trades and inquiries, packed in 64 bits:
+ * the source in the top 8 bits, a sequence number in the next 40, a 2-bit venue leg and a
+ * 14-bit tag. The tag numbers the child orders of a parent and the trades a fill is split
+ * into, and on parent orders holds the pool slot of the parent. The venue leg is set on the
+ * orders the smart order router splits an order into, so each venue gets its own id.
+ * Ids are compared and hashed as integers and only rendered to text by the connectors
+ * that write the output files.
+ */
+typedef uint64_t CompactId;
+
+// Sources of identifiers
+enum IdSource { NO_ID, TRADE_ID, INQUIRY_ID, ALGO_ORDER_ID, PARENT_ORDER_ID, CHILD_ORDER_ID, FILL_ID };
+
+// Text prefix and minimum number of sequence digits of each source
+const char* const ID_PREFIXES[] = { "", "TRADEID_", "INQUIRYID_", "ALGOID_", "PARENTID_", "PARENTID_", "FILLID_" };
+const int ID_MIN_DIGITS[] = { 1, 2, 2, 1, 1, 1, 1 };
+
+const int ID_TAG_BITS = 14;
+const int ID_VENUE_BITS = 2;
+const int ID_SEQUENCE_BITS = 40;
+const int ID_SEQUENCE_SHIFT = ID_VENUE_BITS + ID_TAG_BITS;
+const uint64_t ID_TAG_MASK = (uint64_t(1) << ID_TAG_BITS) - 1;
+const uint64_t ID_VENUE_MASK = ((uint64_t(1) << ID_VENUE_BITS) - 1) << ID_TAG_BITS;
+const uint64_t ID_SEQUENCE_MASK = (uint64_t(1) << ID_SEQUENCE_BITS) - 1;
+
+// Build an id from its source, sequence number and tag
+CompactId MakeId(IdSource source, uint64_t sequence, uint64_t tag = 0)
+{
+    return (uint64_t(source) << (ID_SEQUENCE_BITS + ID_SEQUENCE_SHIFT)) | ((sequence & ID_SEQUENCE_MASK) << ID_SEQUENCE_SHIFT)
+        | (tag & ID_TAG_MASK);
+}
+
+// Get the source of an id
+IdSource GetIdSource(CompactId id)
+{
+    return IdSource(id >> (ID_SEQUENCE_BITS + ID_SEQUENCE_SHIFT));
+}
+
+// Get the sequence number of an id
+uint64_t GetIdSequence(CompactId id)
+{
+    return (id >> ID_SEQUENCE_SHIFT) & ID_SEQUENCE_MASK;
+}
+
+// Get the tag of an id
+uint64_t GetIdTag(CompactId id)
+{
+    return id & ID_TAG_MASK;
+}
+
+// Get the id of the leg of an order sent to a venue, venue being in [0, 3)
+CompactId MakeVenueLegId(CompactId id, int venue)
+{
+    return (id & ~ID_VENUE_MASK) | (uint64_t(venue + 1) << ID_TAG_BITS);
+}
+
+// Get the venue of a venue leg id, -1 if the id is not a venue leg
+int GetIdVenue(CompactId id)
+{
+    return int((id & ID_VENUE_MASK) >> ID_TAG_BITS) - 1;
+}
+
+// Get the id of the order a venue leg was split from, or the id itself if it is not a leg
+CompactId GetLegOrderId(CompactId id)
+{
+    return id & ~ID_VENUE_MASK;
+}
+
+/**
+ * @brief Render an id to text.
+ *
+ * The text is the prefix of the source followed by the sequence number, zero-padded to the
+ * minimum digits of the source; child orders add "_" and their number under the parent, and
+ * so do the trades of a split fill. Venue legs add "_V" and their venue number.
+ *
+ * @param id The id to render.
+ * @return The text of the id, empty for NO_ID.
+ */
+string IdToString(CompactId id)
+{
+    IdSource source = GetIdSource(id);
+    if (source == NO_ID || source > FILL_ID)
+        return "";
+    string sequence = to_string(GetIdSequence(id));
+    if ((int)sequence.size() < ID_MIN_DIGITS[source])
+        sequence.insert(0, ID_MIN_DIGITS[source] - sequence.size(), '0');
+    string text = ID_PREFIXES[source] + sequence;
+    if (source == CHILD_ORDER_ID || (source == FILL_ID && GetIdTag(id) != 0))
+        text += "_" + to_string(GetIdTag(id));
+    if (GetIdVenue(id) >= 0)
+        text += "_V" + to_string(GetIdVenue(id));
+    return text;
+}
+
+/**
+ * @brief Parse the text of an id read from an input file.
+ *
+ * @param text The text, the prefix of a source followed by a sequence number.
+ * @param source The source the text is expected to come from.
+ * @return The id, or NO_ID if the text does not have the prefix of the source.
+ */
+CompactId ParseId(const string& text, IdSource source)
+{
+    string prefix = ID_PREFIXES[source];
+    if (text.compare(0, prefix.size(), prefix) != 0)
+        return NO_ID;
+    return MakeId(source, strtoull(text.c_str() + prefix.size(), nullptr, 10));
+}
+
+#endif
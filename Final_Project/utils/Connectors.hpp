@@ -8,6 +8,7 @@
 #include <boost/date_time.hpp>
 
 #include "SOA.hpp"
+#include "CompactId.hpp"
 #include "DataGenerator.hpp"
 #include "HistoricalDataService.hpp"
 #include "StreamingService.hpp"
@@ -17,6 +18,8 @@
 #include "MarketDataService.hpp"
 #include "ExecutionService.hpp"
 #include "InquiryService.hpp"
+#include "PnLService.hpp"
+#include "RiskHierarchy.hpp"
 #include "TradeBookingservice.hpp"
 
 using namespace std;
@@ -25,10 +28,14 @@ using namespace boost::posix_time;
 // Define constants for file paths
 const string POSITION_FILE_PATH = "output/positions.txt";
 const string RISK_FILE_PATH = "output/risk.txt";
+const string BUCKETED_RISK_FILE_PATH = "output/bucketed_risk.txt";
+const string KEY_RATE_RISK_FILE_PATH = "output/key_rate_risk.txt";
 const string STREAMING_FILE_PATH = "output/streaming.txt";
 const string EXECUTIONS_FILE_PATH = "output/executions.txt";
 const string INQUIRIES_FILE_PATH = "output/all_inquiries.txt";
 const string GUI_FILE_PATH = "output/gui.txt";
+const string PNL_FILE_PATH = "output/pnl.txt";
+const string AGGREGATE_RISK_FILE_PATH = "output/aggregate_risk.txt";
 
 // Convert the fractional bond price to a numerical price
 /**
@@ -102,14 +109,14 @@ template <typename V>
 class HistoricalPositionConnector : public Connector<Position<V>>
 {
 public:
-    void Publish(Position<V> data)      // print the position into the file
+    void Publish(Position<V>& data)     // print the position into the file
     {
         ofstream out(POSITION_FILE_PATH, ios::app);
         V product = data.GetProduct();
         out << product.GetProductId() << ", ";
-        map<string, double> positions = data.GetAllPositions();
-        for (auto& ele : positions)
-            out << ele.first << ":" << ele.second << " ";
+        const auto& positions = data.GetBookPositions();
+        for (int book = 0; book < data.GetBookCount(); ++book)
+            out << GetBookName(book) << ":" << positions[book] << " ";
         out << endl;
         out.close();
     }
@@ -125,7 +132,7 @@ template <typename V>
 class HistoricalRiskConnector : public Connector<PV01<V>>
 {
 public:
-    void Publish(PV01<V> data)       // print the risk into the file
+    void Publish(PV01<V>& data)      // print the risk into the file
     {
         ofstream out(RISK_FILE_PATH, ios::app);
         V product = data.GetProduct();
@@ -140,19 +147,96 @@ public:
 };
 
 
+// Connector to the historical bucketed risk service
+template <typename V>
+class HistoricalBucketedRiskConnector : public Connector<PV01<BucketedSector<V>>>
+{
+public:
+    void Publish(PV01<BucketedSector<V>>& data)      // print the risk of the sector into the file
+    {
+        ofstream out(BUCKETED_RISK_FILE_PATH, ios::app);
+        out << data.GetProduct().GetName() << ", " << data.GetPV01() << endl;
+        out.close();
+    }
+
+    void Subscribe(string file_name) {
+        // This method is intentionally left empty as this connector only supports publishing.
+    }
+};
+
+
+// Connector to the historical key-rate risk service
+template <typename V>
+class HistoricalKeyRateRiskConnector : public Connector<PV01<BucketedSector<V>>>
+{
+public:
+    void Publish(PV01<BucketedSector<V>>& data)      // print the risk of the tenor into the file
+    {
+        ofstream out(KEY_RATE_RISK_FILE_PATH, ios::app);
+        out << data.GetProduct().GetName() << ", " << data.GetPV01() << endl;
+        out.close();
+    }
+
+    void Subscribe(string file_name) {
+        // This method is intentionally left empty as this connector only supports publishing.
+    }
+};
+
+
+// Connector to the historical aggregate risk service
+template <typename V>
+class HistoricalAggregateRiskConnector : public Connector<AggregateRisk>
+{
+public:
+    void Publish(AggregateRisk& data)      // print the sums of the node into the file
+    {
+        ofstream out(AGGREGATE_RISK_FILE_PATH, ios::app);
+        out << GetAggregationLevelName(data.GetLevel()) << ", " << data.GetName() << ", " << data.GetPosition() << ", "
+            << data.GetPV01() << ", " << data.GetPnL() << endl;
+        out.close();
+    }
+
+    void Subscribe(string file_name) {
+        // This method is intentionally left empty as this connector only supports publishing.
+    }
+};
+
+// Connector to the historical P&L service
+template <typename V>
+class HistoricalPnLConnector : public Connector<PnL<V>>
+{
+public:
+    void Publish(PnL<V>& data)      // print the P&L into the file
+    {
+        ofstream out(PNL_FILE_PATH, ios::app);
+        out << data.GetProduct().GetProductId() << ", " << data.GetPosition() << ", " << data.GetMid() << ", "
+            << data.GetRealized() << ", " << data.GetUnrealized() << ", " << data.GetTotal() << endl;
+        out.close();
+    }
+
+    void Subscribe(string file_name) {
+        // This method is intentionally left empty as this connector only supports publishing.
+    }
+};
+
+
 // Connector to the streaming service
 template<typename V>
 class HistoricalStreamingConnector : public Connector<PriceStream<V>>
 {
 public:
-    void Publish(PriceStream<V> data)      // print the price streams into the file
+    void Publish(PriceStream<V>& data)      // print the price stream ladder into the file as one row
     {
         ofstream out(STREAMING_FILE_PATH, ios::app);
-        V product = data.GetProduct();
-        PriceStreamOrder bid_order = data.GetBidOrder();
-        PriceStreamOrder offer_order = data.GetOfferOrder();
-        out << product.GetProductId() << ", " << bid_order.GetPrice() << ", " << 
-            offer_order.GetPrice() << endl;
+        out << data.GetProduct().GetProductId();
+        for (int i = 0; i < data.GetTierCount(); ++i)       // bid, bid size, offer, offer size per tier
+        {
+            const PriceStreamOrder& bid_order = data.GetBidTier(i);
+            const PriceStreamOrder& offer_order = data.GetOfferTier(i);
+            out << ", " << bid_order.GetPrice() << ", " << bid_order.GetVisibleQuantity() << ", "
+                << offer_order.GetPrice() << ", " << offer_order.GetVisibleQuantity();
+        }
+        out << endl;
         out.close();
     }
 
@@ -167,7 +251,7 @@ template<typename V>
 class HistoricalExecutionConnector : public Connector<ExecutionOrder<V>>
 {
 public:
-    void Publish(ExecutionOrder<V> data)        // print the execution records into the file
+    void Publish(ExecutionOrder<V>& data)        // print the execution reports into the file
     {
         ofstream out(EXECUTIONS_FILE_PATH, ios::app);
         V product = data.GetProduct();
@@ -177,8 +261,9 @@ public:
         else
             side = "SELL";
 
-        out << product.GetProductId() << "," << data.GetOrderId() << ","
-            << side << "," << data.GetPrice() << "," << 
+        out << product.GetProductId() << "," << IdToString(data.GetOrderId()) << "," << GetMarketName(data.GetMarket()) << ","
+            << side << "," << GetOrderStatusName(data.GetStatus()) << "," << data.GetLastFillPrice() << ","
+            << data.GetLastFillQuantity() << "," << data.GetFilledQuantity() << "," <<
             data.GetVisibleQuantity() << "," << data.GetHiddenQuantity() << endl;
         out.close();
     }
@@ -194,7 +279,7 @@ template<typename V>
 class HistoricalInquiryConnector : public Connector<Inquiry<V>>
 {
 public:
-    void Publish(Inquiry<V> data)       // print the inquiry data into the file
+    void Publish(Inquiry<V>& data)      // print the inquiry data into the file
     {
         ofstream out(INQUIRIES_FILE_PATH, ios::app);
         string state;
@@ -212,7 +297,7 @@ public:
         else
             side = "SELL";
         
-        out << data.GetProduct().GetProductId() << ", " << data.GetInquiryId()
+        out << data.GetProduct().GetProductId() << ", " << IdToString(data.GetInquiryId())
             << ", " << side << ", " << data.GetPrice() << ", " << state << endl;
         out.close();
     }
@@ -271,6 +356,7 @@ public:
             vector<string> line_seg;
             while (getline(in, line))
             {
+                ++g_replay_time;
                 string seg;
                 line_seg.clear();
                 stringstream line_stream(line);
@@ -281,7 +367,7 @@ public:
 
                 string productID = line_seg[0];
                 V product = static_cast<V>(Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]));
-                string tradeID = line_seg[1];
+                CompactId tradeID = ParseId(line_seg[1], TRADE_ID);
                 string book = line_seg[2];
                 double price;
                 try {
@@ -322,6 +408,7 @@ class PricingConnector : public Connector<Price<V>>
 {
 private:
     PricingService<V>* service;
+    int counter = 0;
 
 public:
     PricingConnector(PricingService<V>* _service) : service(_service) {}
@@ -331,7 +418,6 @@ public:
     void Subscribe(string file_name)        // read price data from the given file
     {
         ifstream in(file_name);
-        int counter = 0;
         ptime cur_time;
         if (in.is_open())
         {
@@ -339,33 +425,7 @@ public:
             cout << cur_time << "  Processing price data from " << file_name << "..." << endl;
             string line;
             while (getline(in, line))
-            {
-                ++counter;
-                if (counter > 1000000)
-                    counter = 1;
-                string seg;
-                vector<string> line_seg;
-                stringstream line_stream(line);
-                while (getline(line_stream, seg, ','))      // parse the comma-separated string
-                {
-                    line_seg.push_back(seg);
-                }
-
-                string productID = line_seg[0];
-                if (counter % 100000 == 0)
-                {
-                    cur_time = microsec_clock::local_time();
-                    cout << cur_time << "  " << counter << " prices processed for " << productID << ".\n";
-                }
-                V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
-                double bid = ConvertFractionalToPrice(line_seg[1]);
-                double ask = ConvertFractionalToPrice(line_seg[2]);
-                double mid = (bid + ask) / 2;
-                double spread = ask - bid;
-
-                Price<V> price(product, mid, spread);
-                service->OnMessage(price);
-            }
+                ReadLine(line);
             cur_time = microsec_clock::local_time();
             cout << cur_time << "  Price data processed.\n\n";
         }
@@ -375,6 +435,36 @@ public:
             cout << cur_time << "  ERROR: File " << file_name << " can not be opened.\n\n";
         }
     }
+
+    void ReadLine(const string& line)       // parse one line of price data and pass it to the service
+    {
+        ++g_replay_time;
+        ++counter;
+        if (counter > 1000000)
+            counter = 1;
+        string seg;
+        vector<string> line_seg;
+        stringstream line_stream(line);
+        while (getline(line_stream, seg, ','))      // parse the comma-separated string
+        {
+            line_seg.push_back(seg);
+        }
+
+        string productID = line_seg[0];
+        if (counter % 100000 == 0)
+        {
+            ptime cur_time = microsec_clock::local_time();
+            cout << cur_time << "  " << counter << " prices processed for " << productID << ".\n";
+        }
+        V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
+        double bid = ConvertFractionalToPrice(line_seg[1]);
+        double ask = ConvertFractionalToPrice(line_seg[2]);
+        double mid = (bid + ask) / 2;
+        double spread = ask - bid;
+
+        Price<V> price(product, mid, spread);
+        service->OnMessage(price);
+    }
 };
 
 
@@ -384,6 +474,7 @@ class MarketDataConnector : public Connector<OrderBook<V>>
 {
 private:
     MarketDataService<V>* service;
+    int counter = 0;
 
 public:
     MarketDataConnector(MarketDataService<V>* _service) : service(_service) {}
@@ -393,45 +484,14 @@ public:
     void Subscribe(string file_name)        // read market data from the given file
     {
         ifstream in(file_name);
-        int counter = 0;
         ptime cur_time;
         if (in.is_open())
         {
             cur_time = microsec_clock::local_time();
             cout << cur_time << "  Processing order book data from " << file_name << "..." << endl;
             string line;
-            
-            double bid_price, offer_price;
             while (getline(in, line))
-            {
-                ++counter;
-                string seg;
-                vector<string> line_seg;
-                stringstream line_stream(line);
-                while (getline(line_stream, seg, ','))      // parse the comma-separated string
-                {
-                    line_seg.push_back(seg);
-                }
-                
-                string productID = line_seg[0];
-                if (counter % 1000000 == 0)
-                {
-                    cur_time = microsec_clock::local_time();
-                    cout << cur_time << "  " << "All order book data processed for " << productID << ".\n";
-                }
-                V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
-                vector<Order> bid_stack, offer_stack;
-                for (int i = 0; i < 5; i++)
-                {
-                    bid_price = ConvertFractionalToPrice(line_seg[2 * i + 1]);
-                    offer_price = ConvertFractionalToPrice(line_seg[2 * i + 2]);
-                    bid_stack.push_back(Order(bid_price, 1000000 * (i + 1), BID));
-                    offer_stack.push_back(Order(offer_price, 1000000 * (i + 1), OFFER));
-                }
-                
-                OrderBook<V> order_book(product, bid_stack, offer_stack);
-                service->OnMessage(order_book);
-            }
+                ReadLine(line);
             cur_time = microsec_clock::local_time();
             cout << cur_time << "  Order book data processed.\n\n";
         }
@@ -441,9 +501,85 @@ public:
             cout << cur_time << "  ERROR: File " << file_name << " can not be opened.\n\n";
         }
     }
+
+    void ReadLine(const string& line)       // parse one line of market data and pass the book to the service
+    {
+        ++g_replay_time;
+        ++counter;
+        string seg;
+        vector<string> line_seg;
+        stringstream line_stream(line);
+        while (getline(line_stream, seg, ','))      // parse the comma-separated string
+        {
+            line_seg.push_back(seg);
+        }
+        
+        string productID = line_seg[0];
+        if (counter % 1000000 == 0)
+        {
+            ptime cur_time = microsec_clock::local_time();
+            cout << cur_time << "  " << "All order book data processed for " << productID << ".\n";
+        }
+        V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
+        vector<Order> bid_stack, offer_stack;
+        double bid_price, offer_price;
+        for (int i = 0; i < 5; i++)
+        {
+            bid_price = ConvertFractionalToPrice(line_seg[2 * i + 1]);
+            offer_price = ConvertFractionalToPrice(line_seg[2 * i + 2]);
+            bid_stack.push_back(Order(bid_price, 1000000 * (i + 1), BID));
+            offer_stack.push_back(Order(offer_price, 1000000 * (i + 1), OFFER));
+        }
+        
+        OrderBook<V> order_book(product, bid_stack, offer_stack);
+        service->OnMessage(order_book);
+    }
 };
 
 
+/**
+ * @brief Replay price data and order book data together, one line of each in turn.
+ *
+ * Both files are generated product by product in the same order with one price per book, so
+ * in lockstep the two feeds tick the same product at the same point of its history, and the
+ * mids that positions are marked to move along with the books that fill them. The longer
+ * file finishes alone.
+ *
+ * @tparam V The type of the product.
+ * @param pricing The connector to the pricing service.
+ * @param priceFile The price data file.
+ * @param marketData The connector to the market data service.
+ * @param bookFile The order book data file.
+ */
+template<typename V>
+void SubscribeInterleaved(PricingConnector<V>& pricing, const string& priceFile, MarketDataConnector<V>& marketData,
+    const string& bookFile)
+{
+    ifstream price_in(priceFile), book_in(bookFile);
+    ptime cur_time = microsec_clock::local_time();
+    if (!price_in.is_open() || !book_in.is_open())
+    {
+        cout << cur_time << "  ERROR: File " << (price_in.is_open() ? bookFile : priceFile) << " can not be opened.\n\n";
+        return;
+    }
+    cout << cur_time << "  Processing price data from " << priceFile << " and order book data from " << bookFile << "..." << endl;
+    string price_line, book_line;
+    while (true)
+    {
+        bool price_read = bool(getline(price_in, price_line));
+        bool book_read = bool(getline(book_in, book_line));
+        if (!price_read && !book_read)
+            break;
+        if (price_read)
+            pricing.ReadLine(price_line);
+        if (book_read)
+            marketData.ReadLine(book_line);
+    }
+    cur_time = microsec_clock::local_time();
+    cout << cur_time << "  Price and order book data processed.\n\n";
+}
+
+
 // Connector to the inquiry service
 template<typename V>
 class InquiryConnector : public Connector<Inquiry<V>>
@@ -475,10 +611,12 @@ public:
             string line;
             vector<string> line_seg;
 
-            string inquiryID, productID;
+            string productID;
+            CompactId inquiryID;
             Side side;
             while (getline(in, line))
             {
+                ++g_replay_time;
                 string seg;
                 line_seg.clear();
                 stringstream line_stream(line);
@@ -488,7 +626,7 @@ public:
                 }
 
                 productID = line_seg[0];
-                inquiryID = line_seg[1];
+                inquiryID = ParseId(line_seg[1], INQUIRY_ID);
                 V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
                 double price = ConvertFractionalToPrice(line_seg[2]);
                 long quantity = stol(line_seg[3]);
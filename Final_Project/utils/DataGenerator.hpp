@@ -48,6 +48,9 @@ map<string, date> g_dates =
 									{"OTRUSTR_30Y",date(2052,12,31)}
 								};
 
+// Valuation date of the curve, the benchmark maturities are measured from it
+date g_curve_date(2022, 12, 31);
+
 vector<string> books{ "TRSY1","TRSY2","TRSY3" };
 
 
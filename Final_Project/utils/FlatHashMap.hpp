@@ -0,0 +1,214 @@
+#ifndef FLAT_HASH_MAP_HPP
+#define FLAT_HASH_MAP_HPP
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+
+/**
+ * @brief Mix the bits of a 64-bit key with the splitmix64 finalizer.
+ *
+ * Sequential ids differ only in their low bits; mixed, they spread over a power-of-two table.
+ *
+ * @param key The key.
+ * @return The mixed key.
+ */
+uint64_t MixKey(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+/**
+ * Open-addressing hash map from 64-bit keys, such as CompactId, to values.
+ * The probe table only holds keys and the positions of their values, which are kept densely
+ * in insertion order, so the table stays small for large values and growing it never moves
+ * them. Slots are probed linearly, and erasing shifts the following slots back instead of
+ * leaving tombstones; the erased value is replaced by the last one. The table doubles once
+ * it is half full. References to values are valid until the next insertion or erase.
+ * Type V is the value type.
+ */
+template<typename V>
+class FlatHashMap
+{
+public:
+    // ctor
+    FlatHashMap(int _capacity = 16);
+
+    // Get the value of a key, inserting a default value if the key is absent
+    V& operator[](uint64_t key);
+
+    // Get the value of a key, or nullptr if the key is absent
+    V* Find(uint64_t key);
+    const V* Find(uint64_t key) const;
+
+    // Erase a key, returns false if it was absent
+    bool Erase(uint64_t key);
+
+    // Get the number of keys stored
+    int GetSize() const;
+
+    // Call f(key, value) for every entry
+    template<typename F>
+    void ForEach(F f) const;
+
+private:
+    struct Slot
+    {
+        uint64_t key;
+        int index;      // position of the value, -1 if the slot is empty
+    };
+
+    vector<Slot> slots;
+    vector<uint64_t> keys;
+    vector<V> values;
+    uint64_t mask;
+
+    // Get the home slot of a key
+    uint64_t Home(uint64_t key) const;
+
+    // Get the slot holding a key, or -1
+    int64_t Locate(uint64_t key) const;
+
+    // Double the table and reinsert every key
+    void Grow();
+};
+
+
+template<typename V>
+FlatHashMap<V>::FlatHashMap(int _capacity)
+{
+    int capacity = 16;
+    while (capacity < 2 * _capacity)
+        capacity <<= 1;
+    slots.assign(capacity, Slot{ 0, -1 });
+    mask = capacity - 1;
+}
+
+template<typename V>
+uint64_t FlatHashMap<V>::Home(uint64_t key) const
+{
+    return MixKey(key) & mask;
+}
+
+template<typename V>
+int64_t FlatHashMap<V>::Locate(uint64_t key) const
+{
+    for (uint64_t i = Home(key);; i = (i + 1) & mask)
+    {
+        if (slots[i].index == -1)
+            return -1;
+        if (slots[i].key == key)
+            return i;
+    }
+}
+
+template<typename V>
+V& FlatHashMap<V>::operator[](uint64_t key)
+{
+    int64_t found = Locate(key);
+    if (found != -1)
+        return values[slots[found].index];
+
+    if (2 * (keys.size() + 1) > slots.size())
+        Grow();
+    uint64_t i = Home(key);
+    while (slots[i].index != -1)
+        i = (i + 1) & mask;
+    slots[i] = Slot{ key, (int)values.size() };
+    keys.push_back(key);
+    values.emplace_back();
+    return values.back();
+}
+
+template<typename V>
+V* FlatHashMap<V>::Find(uint64_t key)
+{
+    int64_t found = Locate(key);
+    return found == -1 ? nullptr : &values[slots[found].index];
+}
+
+template<typename V>
+const V* FlatHashMap<V>::Find(uint64_t key) const
+{
+    int64_t found = Locate(key);
+    return found == -1 ? nullptr : &values[slots[found].index];
+}
+
+/**
+ * @brief Erase a key.
+ *
+ * The slots of the probe run after the erased one are shifted back into the hole whenever
+ * their home slot does not lie between the hole and their current slot. The last value then
+ * moves into the position of the erased one, and its slot is pointed there.
+ *
+ * @param key The key to erase.
+ * @return false if the key was absent.
+ */
+template<typename V>
+bool FlatHashMap<V>::Erase(uint64_t key)
+{
+    int64_t found = Locate(key);
+    if (found == -1)
+        return false;
+
+    int index = slots[found].index;
+    uint64_t hole = found;
+    for (uint64_t i = (hole + 1) & mask; slots[i].index != -1; i = (i + 1) & mask)
+    {
+        uint64_t home = Home(slots[i].key);
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    slots[hole].index = -1;
+
+    int last = values.size() - 1;
+    if (index != last)
+    {
+        values[index] = move(values[last]);
+        keys[index] = keys[last];
+        slots[Locate(keys[index])].index = index;
+    }
+    values.pop_back();
+    keys.pop_back();
+    return true;
+}
+
+template<typename V>
+int FlatHashMap<V>::GetSize() const
+{
+    return values.size();
+}
+
+template<typename V>
+template<typename F>
+void FlatHashMap<V>::ForEach(F f) const
+{
+    for (size_t i = 0; i < values.size(); ++i)
+        f(keys[i], values[i]);
+}
+
+template<typename V>
+void FlatHashMap<V>::Grow()
+{
+    slots.assign(slots.size() * 2, Slot{ 0, -1 });
+    mask = slots.size() - 1;
+    for (size_t index = 0; index < keys.size(); ++index)
+    {
+        uint64_t i = Home(keys[index]);
+        while (slots[i].index != -1)
+            i = (i + 1) & mask;
+        slots[i] = Slot{ keys[index], (int)index };
+    }
+}
+
+#endif
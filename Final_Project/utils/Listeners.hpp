@@ -9,6 +9,19 @@
 #include "AlgoExecutionService.hpp"
 #include "AlgoStreamingService.hpp"
 #include "InquiryService.hpp"
+#include "CurveService.hpp"
+#include "SmartOrderRouter.hpp"
+#include "IcebergManager.hpp"
+#include "PreTradeRiskGate.hpp"
+#include "Backtester.hpp"
+#include "TradeAllocator.hpp"
+#include "PnLService.hpp"
+#include "ShardedPositionService.hpp"
+#include "ScenarioEngine.hpp"
+#include "VaRService.hpp"
+#include "KeyRateRiskService.hpp"
+#include "HedgeService.hpp"
+#include "RiskHierarchy.hpp"
 
 using namespace std;
 
@@ -107,13 +120,13 @@ private:
     HistoricalExecutionService<T>* service;
 public:
     HistoricalExecutionListener(HistoricalExecutionService<T>* _service) : service(_service) {}
-    void ProcessAdd(ExecutionOrder<T>& data)
+    void ProcessAdd(ExecutionOrder<T>& data) {}
+    virtual void ProcessRemove(ExecutionOrder<T>& data) {}
+    virtual void ProcessUpdate(ExecutionOrder<T>& data)        // persist every fill, cancel and reject
     {
         string id = data.GetProduct().GetProductId();
         service->PersistData(id, data);
     }
-    virtual void ProcessRemove(ExecutionOrder<T>& data) {}
-    virtual void ProcessUpdate(ExecutionOrder<T>& data) {}
 };
 
 
@@ -127,7 +140,7 @@ public:
     HistoricalInquiryListener(HistoricalInquiryService<T>* _service) : service(_service) {}
     void ProcessAdd(Inquiry<T>& data)
     {
-        string id = data.GetInquiryId();
+        string id = data.GetProduct().GetProductId();
         service->PersistData(id, data);
     }
     virtual void ProcessRemove(Inquiry<T>& data) {}
@@ -135,6 +148,58 @@ public:
 };
 
 
+template <typename T, typename C = HistoricalBucketedRiskConnector<T> >
+class HistoricalBucketedRiskListener :public ServiceListener<PV01<BucketedSector<T>>>
+{
+private:
+    HistoricalBucketedRiskService<T, C>* service;
+
+public:
+    HistoricalBucketedRiskListener(HistoricalBucketedRiskService<T, C>* _service) : service(_service) {}
+    void ProcessAdd(PV01<BucketedSector<T>>& data)
+    {
+        service->PersistData(data.GetProduct().GetName(), data);
+    }
+    void ProcessRemove(PV01<BucketedSector<T>>& data) {}
+    void ProcessUpdate(PV01<BucketedSector<T>>& data) {}
+};
+
+
+template <typename T>
+class HistoricalAggregateRiskListener :public ServiceListener<AggregateRisk>
+{
+private:
+    HistoricalAggregateRiskService<T>* service;
+
+public:
+    HistoricalAggregateRiskListener(HistoricalAggregateRiskService<T>* _service) : service(_service) {}
+    void ProcessAdd(AggregateRisk& data)
+    {
+        service->PersistData(data.GetName(), data);
+    }
+    void ProcessRemove(AggregateRisk& data) {}
+    void ProcessUpdate(AggregateRisk& data) {}
+};
+
+
+template <typename T>
+class HistoricalPnLListener :public ServiceListener<PnL<T> >
+{
+private:
+    HistoricalPnLService<T>* service;
+
+public:
+    HistoricalPnLListener(HistoricalPnLService<T>* _service) : service(_service) {}
+    void ProcessAdd(PnL<T>& data)
+    {
+        string id = data.GetProduct().GetProductId();
+        service->PersistData(id, data);
+    }
+    void ProcessRemove(PnL<T>& data) {}
+    void ProcessUpdate(PnL<T>& data) {}
+};
+
+
 // Listener to the GUI service
 template<typename T>
 class GUIServiceListener : public ServiceListener<Price<T> >
@@ -179,7 +244,7 @@ public:
     ExecutionServiceListener(ExecutionService<T>* _service) : service(_service) {}
     void ProcessAdd(ExecutionOrder<T>& data)
     {
-        service->ExecuteOrder(data, CME);
+        service->ExecuteOrder(data, data.GetMarket());
     }
     void ProcessRemove(ExecutionOrder<T>& data) {}
     void ProcessUpdate(ExecutionOrder<T>& data) {}
@@ -191,9 +256,9 @@ template <typename T>
 class AlgoStreamingServiceListener :public ServiceListener<Price<T> >
 {
 private:
-    AlgoStreamingService<T>* service;
+    AlgoStreamingServiceBase<T>* service;
 public:
-    AlgoStreamingServiceListener(AlgoStreamingService<T>* _service) : service(_service) {}
+    AlgoStreamingServiceListener(AlgoStreamingServiceBase<T>* _service) : service(_service) {}
     void ProcessAdd(Price<T>& data)
     {
         service->PublishPrice(data);
@@ -208,9 +273,9 @@ template <typename T>
 class AlgoExecutionServiceListener :public ServiceListener<OrderBook <T> >
 {
 private:
-    AlgoExecutionService<T>* service;
+    AlgoExecutionServiceBase<T>* service;
 public:
-    AlgoExecutionServiceListener(AlgoExecutionService<T>* _service) : service(_service) {}
+    AlgoExecutionServiceListener(AlgoExecutionServiceBase<T>* _service) : service(_service) {}
     void ProcessAdd(OrderBook<T>& data)
     {
         service->ExecuteOrder(data);
@@ -220,44 +285,481 @@ public:
 };
 
 
-// Listener to the trade booking service
+// Listener to the curve service
+template<typename T>
+class CurveServiceListener : public ServiceListener<Price<T> >
+{
+private:
+    CurveService<T>* service;
+public:
+    CurveServiceListener(CurveService<T>* _service) : service(_service) {}
+    void ProcessAdd(Price<T>& data)
+    {
+        service->UpdateBenchmark(data);
+    }
+    void ProcessRemove(Price<T>& data) {}
+    void ProcessUpdate(Price<T>& data) {}
+};
+
+
+// Listener publishing aggregate and per-book positions to the inventory snapshot
+template<typename T>
+class InventorySnapshotListener : public ServiceListener<Position<T> >
+{
+private:
+    InventorySnapshot* snapshot;
+public:
+    InventorySnapshotListener(InventorySnapshot* _snapshot) : snapshot(_snapshot) {}
+    void ProcessAdd(Position<T>& data)
+    {
+        int index = GetProductIndex(data.GetProduct().GetProductId());
+        snapshot->SetPosition(index, data.GetAggregatePosition());
+        const auto& positions = data.GetBookPositions();
+        for (int book = 0; book < data.GetBookCount(); ++book)
+            snapshot->SetBookPosition(index, book, positions[book]);
+    }
+    void ProcessRemove(Position<T>& data) {}
+    void ProcessUpdate(Position<T>& data) {}
+};
+
+
+// Listener publishing PV01 risk to the inventory snapshot
+template<typename T>
+class RiskSnapshotListener : public ServiceListener<PV01<T> >
+{
+private:
+    InventorySnapshot* snapshot;
+public:
+    RiskSnapshotListener(InventorySnapshot* _snapshot) : snapshot(_snapshot) {}
+    void ProcessAdd(PV01<T>& data)
+    {
+        snapshot->SetRisk(GetProductIndex(data.GetProduct().GetProductId()), data.GetPV01() * data.GetQuantity());
+    }
+    void ProcessRemove(PV01<T>& data) {}
+    void ProcessUpdate(PV01<T>& data) {}
+};
+
+
+// Listener publishing mids to the price snapshot
+template<typename T>
+class PriceSnapshotListener : public ServiceListener<Price<T> >
+{
+private:
+    PriceSnapshot* snapshot;
+public:
+    PriceSnapshotListener(PriceSnapshot* _snapshot) : snapshot(_snapshot) {}
+    void ProcessAdd(Price<T>& data)
+    {
+        snapshot->SetMid(data.GetProductIndex(), data.GetMid());
+    }
+    void ProcessRemove(Price<T>& data) {}
+    void ProcessUpdate(Price<T>& data) {}
+};
+
+
+// Listener feeding market data to the venues of the execution service
+template<typename T>
+class ExecutionMarketDataListener :public ServiceListener<OrderBook<T> >
+{
+private:
+    ExecutionService<T>* service;
+public:
+    ExecutionMarketDataListener(ExecutionService<T>* _service) : service(_service) {}
+    void ProcessAdd(OrderBook<T>& data)
+    {
+        service->OnMarketData(data);
+    }
+    void ProcessRemove(OrderBook<T>& data) {}
+    void ProcessUpdate(OrderBook<T>& data) {}
+};
+
+
+// Listener to the iceberg manager
+template<typename T>
+class IcebergManagerListener :public ServiceListener<ExecutionOrder<T> >
+{
+private:
+    IcebergManager<T>* service;
+public:
+    IcebergManagerListener(IcebergManager<T>* _service) : service(_service) {}
+    void ProcessAdd(ExecutionOrder<T>& data)
+    {
+        service->Submit(data);
+    }
+    void ProcessRemove(ExecutionOrder<T>& data) {}
+    void ProcessUpdate(ExecutionOrder<T>& data) {}
+};
+
+
+// Listener feeding executions back to the iceberg manager to refresh its slices
+template<typename T>
+class IcebergFillListener :public ServiceListener<ExecutionOrder<T> >
+{
+private:
+    IcebergManager<T>* service;
+public:
+    IcebergFillListener(IcebergManager<T>* _service) : service(_service) {}
+    void ProcessAdd(ExecutionOrder<T>& data) {}
+    void ProcessRemove(ExecutionOrder<T>& data) {}
+    void ProcessUpdate(ExecutionOrder<T>& data)
+    {
+        service->OnExecution(data);
+    }
+};
+
+
+// Listener to the pre-trade risk gate
+template<typename T>
+class PreTradeRiskGateListener :public ServiceListener<ExecutionOrder<T> >
+{
+private:
+    PreTradeRiskGate<T>* service;
+public:
+    PreTradeRiskGateListener(PreTradeRiskGate<T>* _service) : service(_service) {}
+    void ProcessAdd(ExecutionOrder<T>& data)
+    {
+        service->Submit(data);
+    }
+    void ProcessRemove(ExecutionOrder<T>& data) {}
+    void ProcessUpdate(ExecutionOrder<T>& data) {}
+};
+
+
+// Listener releasing the open exposure held by the pre-trade risk gate as orders fill or end
+template<typename T>
+class RiskGateExecutionListener :public ServiceListener<ExecutionOrder<T> >
+{
+private:
+    PreTradeRiskGate<T>* service;
+public:
+    RiskGateExecutionListener(PreTradeRiskGate<T>* _service) : service(_service) {}
+    void ProcessAdd(ExecutionOrder<T>& data) {}
+    void ProcessRemove(ExecutionOrder<T>& data) {}
+    void ProcessUpdate(ExecutionOrder<T>& data)
+    {
+        service->OnExecution(data);
+    }
+};
+
+
+// Listener counting book updates for the message-rate limit of the pre-trade risk gate
+template<typename T>
+class RiskGateMarketDataListener :public ServiceListener<OrderBook<T> >
+{
+private:
+    PreTradeRiskGate<T>* service;
+public:
+    RiskGateMarketDataListener(PreTradeRiskGate<T>* _service) : service(_service) {}
+    void ProcessAdd(OrderBook<T>& data)
+    {
+        service->OnBookUpdate();
+    }
+    void ProcessRemove(OrderBook<T>& data) {}
+    void ProcessUpdate(OrderBook<T>& data) {}
+};
+
+
+// Listener to the smart order router
+template<typename T>
+class SmartOrderRouterListener :public ServiceListener<ExecutionOrder<T> >
+{
+private:
+    SmartOrderRouter<T>* service;
+public:
+    SmartOrderRouterListener(SmartOrderRouter<T>* _service) : service(_service) {}
+    void ProcessAdd(ExecutionOrder<T>& data)
+    {
+        service->Route(data);
+    }
+    void ProcessRemove(ExecutionOrder<T>& data) {}
+    void ProcessUpdate(ExecutionOrder<T>& data) {}
+};
+
+
+// Listener feeding book updates to the smart order router
+template<typename T>
+class RouterMarketDataListener :public ServiceListener<OrderBook<T> >
+{
+private:
+    SmartOrderRouter<T>* service;
+public:
+    RouterMarketDataListener(SmartOrderRouter<T>* _service) : service(_service) {}
+    void ProcessAdd(OrderBook<T>& data)
+    {
+        service->OnMarketData(data);
+    }
+    void ProcessRemove(OrderBook<T>& data) {}
+    void ProcessUpdate(OrderBook<T>& data) {}
+};
+
+
+// Listener resting the orders of a backtested strategy in the simulated fill model
+template<typename T>
+class BacktestOrderListener :public ServiceListener<ExecutionOrder<T> >
+{
+private:
+    BacktestRun<T>* run;
+public:
+    BacktestOrderListener(BacktestRun<T>* _run) : run(_run) {}
+    void ProcessAdd(ExecutionOrder<T>& data)
+    {
+        run->OnOrder(data);
+    }
+    void ProcessRemove(ExecutionOrder<T>& data) {}
+    void ProcessUpdate(ExecutionOrder<T>& data) {}
+};
+
+
+// Listener attributing executions back to the algo's parent orders
+template <typename T>
+class AlgoExecutionFillListener :public ServiceListener<ExecutionOrder <T> >
+{
+private:
+    AlgoExecutionServiceBase<T>* service;
+public:
+    AlgoExecutionFillListener(AlgoExecutionServiceBase<T>* _service) : service(_service) {}
+    void ProcessAdd(ExecutionOrder<T>& data) {}
+    void ProcessRemove(ExecutionOrder<T>& data) {}
+    void ProcessUpdate(ExecutionOrder<T>& data)
+    {
+        service->OnExecution(data);
+    }
+};
+
+
+// Listener to the trade booking service, allocating each fill to the books
 template<typename T>
 class TradeBookingServiceListener :public ServiceListener<ExecutionOrder <T> >
 {
 private:
     TradeBookingService<T>* service;
-    int counter;
+    TradeAllocator<T>* allocator;
+    long fill_counter;
+    vector<Trade<T>> batch;
 
 public:
-    TradeBookingServiceListener(TradeBookingService<T>* _service) : service(_service), counter(0) {}
-    void ProcessAdd(ExecutionOrder <T>& data)
+    TradeBookingServiceListener(TradeBookingService<T>* _service, TradeAllocator<T>* _allocator) :
+        service(_service), allocator(_allocator), fill_counter(0) {}
+    void ProcessAdd(ExecutionOrder <T>& data) {}
+
+    void ProcessUpdate(ExecutionOrder <T>& data)     // book the trades of each fill
     {
-        T product = data.GetProduct();
-        string tradeid = data.GetOrderId();
-        double price = data.GetPrice();
-        string book;
-        if (counter % 3 == 0)
-            book = "TRSY1";
-        else if (counter % 3 == 1)
-            book = "TRSY2";
-        else
-            book = "TRSY3";
+        if (data.GetStatus() != ORDER_PARTIALLY_FILLED && data.GetStatus() != ORDER_FILLED)
+            return;
+        batch.clear();
+        allocator->Allocate(data, ++fill_counter, batch);
+        service->BookTrades(batch);
+    }
+    void ProcessRemove(ExecutionOrder <T>& data) {}
+};
 
-        double quantity = data.GetVisibleQuantity();
-        PricingSide side = data.GetPricingSide();
-        Side order_side;
-        if (side == BID)
-            order_side = BUY;
-        else
-            order_side = SELL;
 
-        Trade<T> trade(product, tradeid, price, book, quantity, order_side);
-        service->OnMessage(trade);
+// Listener booking each trade into the P&L service
+template<typename T>
+class PnLTradeListener : public ServiceListener<Trade<T> >
+{
+private:
+    PnLService<T>* service;
+public:
+    PnLTradeListener(PnLService<T>* _service) : service(_service) {}
+    void ProcessAdd(Trade<T>& data)
+    {
+        service->AddTrade(data);
     }
+    void ProcessRemove(Trade<T>& data) {}
+    void ProcessUpdate(Trade<T>& data) {}
+};
 
-    void ProcessRemove(ExecutionOrder <T>& data) {}
-    void ProcessUpdate(ExecutionOrder <T>& data) {}
+
+// Listener marking the P&L service to each new mid
+template<typename T>
+class PnLPriceListener : public ServiceListener<Price<T> >
+{
+private:
+    PnLService<T>* service;
+public:
+    PnLPriceListener(PnLService<T>* _service) : service(_service) {}
+    void ProcessAdd(Price<T>& data)
+    {
+        service->OnPrice(data);
+    }
+    void ProcessRemove(Price<T>& data) {}
+    void ProcessUpdate(Price<T>& data) {}
+};
+
+
+// Listener submitting each trade to the sharded position service from the producer slot of its connector,
+// told apart by the source of the trade id: booked from the trade file, or allocated from a fill
+template<typename T>
+class ShardedPositionListener : public ServiceListener<Trade<T> >
+{
+private:
+    ShardedPositionService<T>* service;
+    int file_producer;
+    int fill_producer;
+public:
+    ShardedPositionListener(ShardedPositionService<T>* _service, int _fileProducer, int _fillProducer) :
+        service(_service), file_producer(_fileProducer), fill_producer(_fillProducer) {}
+    void ProcessAdd(Trade<T>& data)
+    {
+        service->Submit(GetIdSource(data.GetTradeId()) == FILL_ID ? fill_producer : file_producer, data);
+    }
+    void ProcessRemove(Trade<T>& data) {}
+    void ProcessUpdate(Trade<T>& data) {}
+};
+
+
+// Listener moving the scenario totals by each position change
+template<typename T>
+class ScenarioPositionListener : public ServiceListener<Position<T> >
+{
+private:
+    ScenarioEngine<T>* engine;
+public:
+    ScenarioPositionListener(ScenarioEngine<T>* _engine) : engine(_engine) {}
+    void ProcessAdd(Position<T>& data)
+    {
+        engine->OnPosition(data);
+    }
+    void ProcessRemove(Position<T>& data) {}
+    void ProcessUpdate(Position<T>& data) {}
+};
+
+
+// Listener handing each new zero curve to the scenario engine
+template<typename T>
+class ScenarioCurveListener : public ServiceListener<ZeroCurve>
+{
+private:
+    ScenarioEngine<T>* engine;
+public:
+    ScenarioCurveListener(ScenarioEngine<T>* _engine) : engine(_engine) {}
+    void ProcessAdd(ZeroCurve& data)
+    {
+        engine->OnCurve(data);
+    }
+    void ProcessRemove(ZeroCurve& data) {}
+    void ProcessUpdate(ZeroCurve& data) {}
+};
+
+
+// Listener handing each new mid to the VaR service
+template<typename T>
+class VaRPriceListener : public ServiceListener<Price<T> >
+{
+private:
+    VaRService<T>* service;
+public:
+    VaRPriceListener(VaRService<T>* _service) : service(_service) {}
+    void ProcessAdd(Price<T>& data)
+    {
+        service->OnPrice(data);
+    }
+    void ProcessRemove(Price<T>& data) {}
+    void ProcessUpdate(Price<T>& data) {}
+};
+
+
+// Listener moving the VaR service's day P&Ls by each position change
+template<typename T>
+class VaRPositionListener : public ServiceListener<Position<T> >
+{
+private:
+    VaRService<T>* service;
+public:
+    VaRPositionListener(VaRService<T>* _service) : service(_service) {}
+    void ProcessAdd(Position<T>& data)
+    {
+        service->OnPosition(data);
+    }
+    void ProcessRemove(Position<T>& data) {}
+    void ProcessUpdate(Position<T>& data) {}
+};
+
+
+// Listener moving the key-rate risk by each position change
+template<typename T>
+class KeyRatePositionListener : public ServiceListener<Position<T> >
+{
+private:
+    KeyRateRiskService<T>* service;
+public:
+    KeyRatePositionListener(KeyRateRiskService<T>* _service) : service(_service) {}
+    void ProcessAdd(Position<T>& data)
+    {
+        service->OnPosition(data);
+    }
+    void ProcessRemove(Position<T>& data) {}
+    void ProcessUpdate(Position<T>& data) {}
+};
+
+
+// Listener handing each new zero curve to the key-rate risk service
+template<typename T>
+class KeyRateCurveListener : public ServiceListener<ZeroCurve>
+{
+private:
+    KeyRateRiskService<T>* service;
+public:
+    KeyRateCurveListener(KeyRateRiskService<T>* _service) : service(_service) {}
+    void ProcessAdd(ZeroCurve& data)
+    {
+        service->OnCurve(data);
+    }
+    void ProcessRemove(ZeroCurve& data) {}
+    void ProcessUpdate(ZeroCurve& data) {}
+};
+
+
+// Listener handing each sector risk update to the hedge service
+template<typename T>
+class HedgeRiskListener : public ServiceListener<PV01<BucketedSector<T>> >
+{
+private:
+    HedgeService<T>* service;
+public:
+    HedgeRiskListener(HedgeService<T>* _service) : service(_service) {}
+    void ProcessAdd(PV01<BucketedSector<T>>& data)
+    {
+        service->OnRisk(data);
+    }
+    void ProcessRemove(PV01<BucketedSector<T>>& data) {}
+    void ProcessUpdate(PV01<BucketedSector<T>>& data) {}
+};
+
+
+// Listener moving the risk hierarchy by each position change
+template<typename T>
+class HierarchyPositionListener : public ServiceListener<Position<T> >
+{
+private:
+    RiskHierarchy<T>* hierarchy;
+public:
+    HierarchyPositionListener(RiskHierarchy<T>* _hierarchy) : hierarchy(_hierarchy) {}
+    void ProcessAdd(Position<T>& data)
+    {
+        hierarchy->OnPosition(data);
+    }
+    void ProcessRemove(Position<T>& data) {}
+    void ProcessUpdate(Position<T>& data) {}
+};
+
+
+// Listener moving the risk hierarchy by each P&L update
+template<typename T>
+class HierarchyPnLListener : public ServiceListener<PnL<T> >
+{
+private:
+    RiskHierarchy<T>* hierarchy;
+public:
+    HierarchyPnLListener(RiskHierarchy<T>* _hierarchy) : hierarchy(_hierarchy) {}
+    void ProcessAdd(PnL<T>& data)
+    {
+        hierarchy->OnPnL(data);
+    }
+    void ProcessRemove(PnL<T>& data) {}
+    void ProcessUpdate(PnL<T>& data) {}
 };
 
 
-#endif 
+#endif
@@ -0,0 +1,95 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * A file mapped read-only into memory.
+ * The pages are shared by every thread, and by every process mapping the same file, so
+ * several readers can scan one copy of a large data file. The mapping is released when the
+ * object is destroyed.
+ */
+class MappedFile
+{
+public:
+    // ctor
+    MappedFile(const string& path);
+
+    // dtor
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Get the first byte of the file
+    const char* GetData() const;
+
+    // Get the size of the file in bytes
+    size_t GetSize() const;
+
+private:
+    const char* data;
+    size_t size;
+};
+
+
+/**
+ * @brief Map a file read-only.
+ *
+ * The kernel is told the file will be read sequentially, so it reads ahead aggressively.
+ *
+ * @param path The path of the file.
+ * @throws runtime_error if the file can not be opened or mapped.
+ */
+MappedFile::MappedFile(const string& path) : data(nullptr), size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw runtime_error("Can not open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        close(fd);
+        throw runtime_error("Can not stat " + path);
+    }
+    size = info.st_size;
+    if (size > 0)
+    {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close(fd);
+            throw runtime_error("Can not map " + path);
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+        munmap(const_cast<char*>(data), size);
+}
+
+const char* MappedFile::GetData() const
+{
+    return data;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return size;
+}
+
+#endif
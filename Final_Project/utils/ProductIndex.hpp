@@ -0,0 +1,113 @@
+#ifndef PRODUCT_INDEX_HPP
+#define PRODUCT_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include "DataGenerator.hpp"
+
+using namespace std;
+
+// Capacity of the per-product flat arrays
+const int MAX_PRODUCTS = 16384;
+
+// Dense index of every product seen, so per-product state can live in flat arrays
+unordered_map<string, int> g_product_index;
+vector<string> g_indexed_product_Ids;
+
+/**
+ * @brief Get the dense index of a product, assigning the next free one on first sight.
+ *
+ * The on-the-run benchmarks are registered first, so their indices follow g_product_Ids.
+ *
+ * @param productId The product identifier.
+ * @return The index of the product in [0, MAX_PRODUCTS).
+ * @throws runtime_error if more than MAX_PRODUCTS products are registered.
+ */
+int GetProductIndex(const string& productId)
+{
+    if (g_indexed_product_Ids.empty())
+    {
+        for (const auto& id : g_product_Ids)
+        {
+            g_product_index[id] = g_indexed_product_Ids.size();
+            g_indexed_product_Ids.push_back(id);
+        }
+    }
+
+    auto it = g_product_index.find(productId);
+    if (it != g_product_index.end())
+        return it->second;
+
+    if (g_indexed_product_Ids.size() >= MAX_PRODUCTS)
+        throw runtime_error("Too many products for the product index");
+    int index = g_indexed_product_Ids.size();
+    g_product_index[productId] = index;
+    g_indexed_product_Ids.push_back(productId);
+    return index;
+}
+
+// Get the number of products registered in the index
+int GetProductCount()
+{
+    return g_indexed_product_Ids.size();
+}
+
+
+// Capacity of the per-book flat arrays
+const int MAX_BOOKS = 16;
+
+// Dense index of every book seen, so books are interned as small integers
+unordered_map<string, int> g_book_index;
+vector<string> g_indexed_books;
+
+/**
+ * @brief Get the dense index of a book, assigning the next free one on first sight.
+ *
+ * The trading books are registered first, so their indices follow books. Room for
+ * MAX_BOOKS names is reserved up front, so references to book names stay valid.
+ *
+ * @param book The book name.
+ * @return The index of the book in [0, MAX_BOOKS).
+ * @throws runtime_error if more than MAX_BOOKS books are registered.
+ */
+int GetBookIndex(const string& book)
+{
+    if (g_indexed_books.empty())
+    {
+        g_indexed_books.reserve(MAX_BOOKS);
+        for (const auto& name : books)
+        {
+            g_book_index[name] = g_indexed_books.size();
+            g_indexed_books.push_back(name);
+        }
+    }
+
+    auto it = g_book_index.find(book);
+    if (it != g_book_index.end())
+        return it->second;
+
+    if (g_indexed_books.size() >= MAX_BOOKS)
+        throw runtime_error("Too many books for the book index");
+    int index = g_indexed_books.size();
+    g_book_index[book] = index;
+    g_indexed_books.push_back(book);
+    return index;
+}
+
+// Get the number of books registered in the index
+int GetBookCount()
+{
+    if (g_indexed_books.empty())
+        GetBookIndex(books[0]);
+    return g_indexed_books.size();
+}
+
+// Get the name of a book from its index
+const string& GetBookName(int bookIndex)
+{
+    return g_indexed_books[bookIndex];
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * Bounded lock-free queue between exactly one producer thread and one consumer thread.
+ * The capacity is a power of two so positions wrap with a mask. The producer and consumer
+ * positions sit on their own cache lines, and each side keeps a cached copy of the other's
+ * position, so it only reads the shared one when the queue looks full or empty.
+ * Type V is the element type.
+ */
+template<typename V>
+class SPSCQueue
+{
+public:
+    // ctor
+    SPSCQueue(size_t _capacity = 4096);
+
+    // Append an element, returns false if the queue is full; producer only
+    bool TryPush(const V& value);
+
+    // Take the oldest element, returns false if the queue is empty; consumer only
+    bool TryPop(V& value);
+
+    // Get the number of elements pushed so far
+    size_t GetPushedCount() const;
+
+    // Get the number of elements popped so far
+    size_t GetPoppedCount() const;
+
+private:
+    size_t mask;
+    unique_ptr<V[]> slots;
+
+    alignas(64) atomic<size_t> tail;    // next position to write
+    size_t cached_head;                 // producer's copy of head
+    alignas(64) atomic<size_t> head;    // next position to read
+    size_t cached_tail;                 // consumer's copy of tail
+};
+
+
+/**
+ * @brief Construct a queue.
+ *
+ * @tparam V The type of the elements.
+ * @param _capacity The number of elements the queue holds, a power of two.
+ * @throws invalid_argument if the capacity is not a power of two.
+ */
+template<typename V>
+SPSCQueue<V>::SPSCQueue(size_t _capacity) :
+    mask(_capacity - 1), slots(new V[_capacity]), tail(0), cached_head(0), head(0), cached_tail(0)
+{
+    if (_capacity == 0 || (_capacity & (_capacity - 1)) != 0)
+        throw invalid_argument("The capacity of a queue must be a power of two");
+}
+
+template<typename V>
+bool SPSCQueue<V>::TryPush(const V& value)
+{
+    size_t position = tail.load(memory_order_relaxed);
+    if (position - cached_head > mask)
+    {
+        cached_head = head.load(memory_order_acquire);
+        if (position - cached_head > mask)
+            return false;
+    }
+    slots[position & mask] = value;
+    tail.store(position + 1, memory_order_release);
+    return true;
+}
+
+template<typename V>
+bool SPSCQueue<V>::TryPop(V& value)
+{
+    size_t position = head.load(memory_order_relaxed);
+    if (position == cached_tail)
+    {
+        cached_tail = tail.load(memory_order_acquire);
+        if (position == cached_tail)
+            return false;
+    }
+    value = slots[position & mask];
+    head.store(position + 1, memory_order_release);
+    return true;
+}
+
+template<typename V>
+size_t SPSCQueue<V>::GetPushedCount() const
+{
+    return tail.load(memory_order_acquire);
+}
+
+template<typename V>
+size_t SPSCQueue<V>::GetPoppedCount() const
+{
+    return head.load(memory_order_acquire);
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef SLAB_TABLE_HPP
+#define SLAB_TABLE_HPP
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * Table of values living in fixed-size slabs and addressed by 64-bit handles.
+ * A handle packs the slot in its low 32 bits and the generation of the slot in its high 32
+ * bits, so a lookup is two array accesses and a handle to an erased value is detected even
+ * after its slot is reused. Slabs are never moved, so references to values stay valid while
+ * other values are inserted.
+ * Type V is the value type, stored in slabs of 2^SLAB_BITS slots.
+ */
+template<typename V, int SLAB_BITS = 10>
+class SlabTable
+{
+public:
+    // ctor
+    SlabTable();
+
+    // Store a value and get its handle
+    uint64_t Insert(const V& value);
+
+    // Get the value of a handle, or nullptr if it was erased
+    V* Find(uint64_t handle);
+
+    // Erase the value of a handle, returns false if it was already erased
+    bool Erase(uint64_t handle);
+
+    // Get the number of values stored
+    int GetSize() const;
+
+private:
+    struct Slot
+    {
+        V value;
+        uint32_t generation;
+        int nextFree;
+        bool used;
+    };
+
+    vector<unique_ptr<Slot[]>> slabs;
+    int free_head;
+    int capacity;
+    int size;
+
+    // Access a slot
+    Slot& At(int slot);
+};
+
+
+template<typename V, int SLAB_BITS>
+SlabTable<V, SLAB_BITS>::SlabTable() : free_head(-1), capacity(0), size(0)
+{
+}
+
+template<typename V, int SLAB_BITS>
+typename SlabTable<V, SLAB_BITS>::Slot& SlabTable<V, SLAB_BITS>::At(int slot)
+{
+    return slabs[slot >> SLAB_BITS][slot & ((1 << SLAB_BITS) - 1)];
+}
+
+/**
+ * @brief Store a value and get its handle.
+ *
+ * A free slot is reused if there is one, otherwise a new slab is added and its slots are
+ * chained on the free list.
+ *
+ * @param value The value to store.
+ * @return The handle of the value, never 0.
+ */
+template<typename V, int SLAB_BITS>
+uint64_t SlabTable<V, SLAB_BITS>::Insert(const V& value)
+{
+    if (free_head == -1)
+    {
+        int slab_size = 1 << SLAB_BITS;
+        slabs.emplace_back(new Slot[slab_size]);
+        for (int i = slab_size - 1; i >= 0; --i)
+        {
+            Slot& slot = slabs.back()[i];
+            slot.generation = 1;
+            slot.used = false;
+            slot.nextFree = free_head;
+            free_head = capacity + i;
+        }
+        capacity += slab_size;
+    }
+
+    int index = free_head;
+    Slot& slot = At(index);
+    free_head = slot.nextFree;
+    slot.value = value;
+    slot.used = true;
+    ++size;
+    return (uint64_t(slot.generation) << 32) | uint32_t(index);
+}
+
+template<typename V, int SLAB_BITS>
+V* SlabTable<V, SLAB_BITS>::Find(uint64_t handle)
+{
+    int index = int(handle & 0xFFFFFFFF);
+    if (index >= capacity)
+        return nullptr;
+    Slot& slot = At(index);
+    if (!slot.used || slot.generation != uint32_t(handle >> 32))
+        return nullptr;
+    return &slot.value;
+}
+
+template<typename V, int SLAB_BITS>
+bool SlabTable<V, SLAB_BITS>::Erase(uint64_t handle)
+{
+    if (Find(handle) == nullptr)
+        return false;
+    int index = int(handle & 0xFFFFFFFF);
+    Slot& slot = At(index);
+    slot.used = false;
+    if (++slot.generation == 0)
+        slot.generation = 1;
+    slot.nextFree = free_head;
+    free_head = index;
+    --size;
+    return true;
+}
+
+template<typename V, int SLAB_BITS>
+int SlabTable<V, SLAB_BITS>::GetSize() const
+{
+    return size;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+/**
+ * Fixed pool of worker threads running parallel loops.
+ * ParallelFor hands out the iterations of a loop one at a time through an atomic counter,
+ * with the calling thread taking iterations alongside the workers, and returns once every
+ * iteration has run. Workers sleep on a condition variable between loops. One loop runs at
+ * a time, so ParallelFor must not be called from inside an iteration.
+ */
+class ThreadPool
+{
+public:
+    // ctor, 0 threads uses one worker per core besides the caller
+    ThreadPool(int threads = 0);
+
+    // dtor, joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Call f(i) for every i in [0, count) across the pool and wait for all of them
+    void ParallelFor(size_t count, const function<void(size_t)>& f);
+
+    // Get the number of threads running iterations, the caller included
+    int GetThreadCount() const;
+
+private:
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake;
+    condition_variable done;
+    const function<void(size_t)>* task;
+    size_t task_count;
+    atomic<size_t> next;
+    int active;
+    uint64_t generation;
+    bool stopping;
+
+    // Run iterations of the current loop until none are left
+    void RunTasks();
+
+    // Wait for loops and run them until stopped
+    void Work();
+};
+
+
+ThreadPool::ThreadPool(int threads) :
+    task(nullptr), task_count(0), next(0), active(0), generation(0), stopping(false)
+{
+    if (threads <= 0)
+        threads = max(1u, thread::hardware_concurrency()) - 1;
+    for (int i = 0; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::RunTasks()
+{
+    for (size_t i = next.fetch_add(1, memory_order_relaxed); i < task_count; i = next.fetch_add(1, memory_order_relaxed))
+        (*task)(i);
+}
+
+void ThreadPool::Work()
+{
+    uint64_t seen = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [this, seen]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        RunTasks();
+        {
+            lock_guard<mutex> guard(lock);
+            if (--active == 0)
+                done.notify_one();
+        }
+    }
+}
+
+/**
+ * @brief Call f(i) for every i in [0, count) across the pool and wait for all of them.
+ *
+ * @param count The number of iterations.
+ * @param f The body of the loop.
+ */
+void ThreadPool::ParallelFor(size_t count, const function<void(size_t)>& f)
+{
+    if (workers.empty() || count <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            f(i);
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        task = &f;
+        task_count = count;
+        next.store(0, memory_order_relaxed);
+        active = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+    RunTasks();
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [this]() { return active == 0; });
+    task = nullptr;
+}
+
+int ThreadPool::GetThreadCount() const
+{
+    return workers.size() + 1;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef THROTTLE_HPP
+#define THROTTLE_HPP
+
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+// Replay time: the number of input records the connectors have read, so stamps and pacing
+// taken from it are the same on every run
+uint64_t g_replay_time = 0;
+
+/**
+ * Token bucket refilled at a constant rate up to a burst capacity.
+ * Time is passed in by the caller in any unit, such as nanoseconds or a count of events,
+ * with the rate given per unit, so a check is a few arithmetic operations.
+ */
+class TokenBucket
+{
+public:
+    // ctor
+    TokenBucket() = default;
+    TokenBucket(double _ratePerUnit, double _capacity);
+
+    // Refill the bucket up to the given time and take one token if there is one
+    bool TryConsume(uint64_t now);
+
+    // Refill the bucket up to the given time and check whether a token is available
+    bool HasToken(uint64_t now);
+
+private:
+    double ratePerUnit = 0;
+    double capacity = 0;
+    double tokens = 0;
+    uint64_t last = 0;
+
+    // Add the tokens accrued since the last refill
+    void Refill(uint64_t now);
+};
+
+
+TokenBucket::TokenBucket(double _ratePerUnit, double _capacity) :
+    ratePerUnit(_ratePerUnit), capacity(_capacity), tokens(_capacity), last(0)
+{
+}
+
+void TokenBucket::Refill(uint64_t now)
+{
+    if (now > last)
+    {
+        tokens = min(capacity, tokens + (now - last) * ratePerUnit);
+        last = now;
+    }
+}
+
+bool TokenBucket::TryConsume(uint64_t now)
+{
+    Refill(now);
+    if (tokens < 1.0)
+        return false;
+    tokens -= 1.0;
+    return true;
+}
+
+bool TokenBucket::HasToken(uint64_t now)
+{
+    Refill(now);
+    return tokens >= 1.0;
+}
+
+#endif
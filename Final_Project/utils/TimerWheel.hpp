@@ -0,0 +1,92 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * Hashed timer wheel over integer ticks.
+ * Timers are identified by small integer ids (e.g. pool slots) and are chained through an
+ * intrusive next array, so scheduling and firing do not allocate once the ids are known.
+ * Timers further out than one revolution stay in their slot until their expiry tick.
+ */
+class TimerWheel
+{
+public:
+    // ctor, the number of slots is rounded up to a power of two
+    TimerWheel(int _slots = 1024);
+
+    // Schedule a timer id to fire at an absolute tick
+    void Schedule(int id, uint64_t expiry);
+
+    // Advance the wheel by one tick and call fire(id) for every expired timer
+    template<typename F>
+    void Advance(F fire);
+
+    // Get the current tick
+    uint64_t GetTick() const;
+
+private:
+    vector<int> heads;
+    vector<int> next;
+    vector<uint64_t> expiries;
+    uint64_t mask;
+    uint64_t tick;
+};
+
+
+TimerWheel::TimerWheel(int _slots) : tick(0)
+{
+    int slots = 1;
+    while (slots < _slots)
+        slots <<= 1;
+    heads.assign(slots, -1);
+    mask = slots - 1;
+}
+
+void TimerWheel::Schedule(int id, uint64_t expiry)
+{
+    if (id >= (int)next.size())
+    {
+        next.resize(id + 1, -1);
+        expiries.resize(id + 1, 0);
+    }
+    if (expiry <= tick)
+        expiry = tick + 1;
+    expiries[id] = expiry;
+    uint64_t slot = expiry & mask;
+    next[id] = heads[slot];
+    heads[slot] = id;
+}
+
+template<typename F>
+void TimerWheel::Advance(F fire)
+{
+    ++tick;
+    uint64_t slot = tick & mask;
+    int id = heads[slot];
+    heads[slot] = -1;
+    while (id != -1)
+    {
+        int following = next[id];
+        if (expiries[id] <= tick)
+        {
+            fire(id);
+        }
+        else
+        {
+            next[id] = heads[slot];
+            heads[slot] = id;
+        }
+        id = following;
+    }
+}
+
+uint64_t TimerWheel::GetTick() const
+{
+    return tick;
+}
+
+#endif